@@ -42,6 +42,13 @@
 #define NS_RCC_GFF_ID	0x011F
 #define NS_RCC_GID_PN	0x0121
 #define NS_RCC_GA_NXT	0x0100
+#define NS_RCC_GPN_FT	0x0172
+#define NS_RCC_GID_PT	0x01A1
+
+/* FC-4 types */
+#define FC4_TYPE_FCP		0x08
+#define FC4_TYPE_SB2_CHANNEL	0x1b
+#define FC4_TYPE_SB2_CU		0x1c
 
 #define GS_REJECT_RESPONSE_CT_IU 0x8001
 #define GS_ACCEPT_RESPONSE_CT_IU 0x8002
@@ -369,6 +376,7 @@ struct adapter_attr *fc_get_hba_handle(char *arg)
 	HBA_HANDLE hba_handle;
 	HBA_ADAPTERATTRIBUTES hba_attr;
 	HBA_PORTATTRIBUTES port_attr;
+	HBA_WWN hba_wwn;
 	struct adapter_attr *aa;
 	enum addr_type hba_adr_type;
 	uint64_t hba_id = 0;
@@ -397,6 +405,21 @@ struct adapter_attr *fc_get_hba_handle(char *arg)
 			hba_adr_type = NPORT;
 	}
 
+	/* open an adapter given by WWPN directly, scan if not supported */
+	if (hba_adr_type == WWPN) {
+		memcpy(hba_wwn.wwn, &hba_id, sizeof(hba_wwn.wwn));
+		if (HBA_OpenAdapterByWWN(&hba_handle, hba_wwn) ==
+		    HBA_STATUS_OK) {
+			rc = HBA_GetAdapterAttributes(hba_handle, &hba_attr) |
+			     HBA_GetAdapterPortAttributes(hba_handle, 0,
+							  &port_attr);
+			if (rc == HBA_STATUS_OK &&
+			    *(uint64_t *)port_attr.PortWWN.wwn == hba_id)
+				goto out;
+			HBA_CloseAdapter(hba_handle);
+		}
+	}
+
 	for (cnt = 0; cnt < hba_cnt; cnt++) {
 		if (HBA_GetAdapterName(cnt, hba_name) != HBA_STATUS_OK)
 			continue;
@@ -450,6 +473,66 @@ out:
 	return aa;
 }
 
+/*
+ * Request and response buffers are page aligned. Buffers released with
+ * put_ct_buf() are kept and handed out again by get_ct_buf(), so sending
+ * many requests does not allocate memory each time.
+ */
+#define CT_BUF_POOL_SIZE	8
+
+struct ct_buf {
+	struct ct_buf *next;
+	uint32_t size;
+	uint32_t len;
+};
+
+static struct ct_buf *ct_buf_pool;
+static int ct_buf_pool_cnt;
+
+char *get_ct_buf(uint32_t size)
+{
+	struct ct_buf **prev, *buf;
+
+	for (prev = &ct_buf_pool; *prev; prev = &(*prev)->next) {
+		if ((*prev)->size >= size) {
+			buf = *prev;
+			*prev = buf->next;
+			ct_buf_pool_cnt--;
+			goto out;
+		}
+	}
+
+	if (posix_memalign((void *)&buf, PAGE_SIZE, PAGE_SIZE + size))
+		return NULL;
+	buf->size = size;
+out:
+	buf->len = size;
+	memset((char *)buf + PAGE_SIZE, 0, size);
+	return (char *)buf + PAGE_SIZE;
+}
+
+void put_ct_buf(char *data)
+{
+	struct ct_buf *buf;
+
+	if (!data)
+		return;
+
+	buf = (struct ct_buf *)(data - PAGE_SIZE);
+	if (ct_buf_pool_cnt >= CT_BUF_POOL_SIZE) {
+		free(buf);
+		return;
+	}
+	buf->next = ct_buf_pool;
+	ct_buf_pool = buf;
+	ct_buf_pool_cnt++;
+}
+
+uint32_t ct_buf_size(char *data)
+{
+	return ((struct ct_buf *)(data - PAGE_SIZE))->len;
+}
+
 char *send_ct_pt(HBA_HANDLE handle, uint32_t req_s, uint32_t resp_s, 
 		 uint16_t cmd, char *c_param, uint8_t gs_subtype, 
 		 uint8_t gs_type)
@@ -460,14 +543,13 @@ char *send_ct_pt(HBA_HANDLE handle, uint32_t req_s, uint32_t resp_s,
 	uint32_t i;
 	uint16_t code;
 
-        if (posix_memalign((void *)&req, PAGE_SIZE, req_s))
-                return NULL;
-
-        if (posix_memalign((void *)&resp, PAGE_SIZE, resp_s))
-                goto out_mem;
+	req = get_ct_buf(req_s);
+	if (!req)
+		return NULL;
 
-        memset(req, 0, req_s);
-        memset(resp, 0, resp_s);
+	resp = get_ct_buf(resp_s);
+	if (!resp)
+		goto out_mem;
 
         p = (struct ct_iu_preamble *) req;
 
@@ -481,6 +563,20 @@ char *send_ct_pt(HBA_HANDLE handle, uint32_t req_s, uint32_t resp_s,
 
         rc = HBA_SendCTPassThru(handle, req, req_s, resp, resp_s);
 
+	/* a residual size in the accept means the response was truncated */
+	code = ((struct ct_iu_preamble *) resp)->code;
+	i = ((struct ct_iu_preamble *) resp)->size;
+	if (!rc && code == GS_ACCEPT_RESPONSE_CT_IU && i &&
+	    p->size + i <= 0xffff) {
+		put_ct_buf(resp);
+		resp_s += i << 2;
+		resp = get_ct_buf(resp_s);
+		if (!resp)
+			goto out_mem;
+		p->size += i;
+		rc = HBA_SendCTPassThru(handle, req, req_s, resp, resp_s);
+	}
+
 	if (display_detail & DEBUG) {
 		printf("--- REQUEST cmd = 0x%04x ---\n", cmd);
 		print_code(req, req_s);
@@ -488,11 +584,11 @@ char *send_ct_pt(HBA_HANDLE handle, uint32_t req_s, uint32_t resp_s,
 		print_code(resp, resp_s);
 	}
 	if (rc) {
-		free(resp);
+		put_ct_buf(resp);
 		resp = NULL;
         }  
 out_mem:
-	free(req);
+	put_ct_buf(req);
 	return resp;
 }
 
@@ -186,12 +186,12 @@ HBA_STATUS send_fc_ping(struct adapter_attr *aa, char *dest, unsigned int token,
 			print_error_statement();
 			goto err_out;
 		}
-		free(resp);
+		put_ct_buf(resp);
 	}
 
 	return HBA_STATUS_OK;
 err_out:
-	free(resp);
+	put_ct_buf(resp);
 	return HBA_STATUS_ERROR;
 }
 
@@ -31,12 +31,11 @@ char *send_ct(HBA_HANDLE handle, uint32_t req_s, uint32_t resp_s,
 	uint8_t retries = 3;
 
 	while (retries--) {
+		/* the library paces requests and retries busy rejects */
 		resp = send_ct_pt(handle, req_s, resp_s, cmd, c_param, 
 				  gs_subtype, gs_type);
-		if (!resp) {
-			sleep(1);
+		if (!resp)
 			continue;
-		}
 
 		code = *(uint16_t *)(resp + CT_IU_CODE_OFFSET);
 
@@ -49,15 +48,14 @@ char *send_ct(HBA_HANDLE handle, uint32_t req_s, uint32_t resp_s,
 			/* non-conforming return code */
 			if (!retries)
 				print_error_statement();
-			else
-				sleep(1);
 		} 
-		free(resp);
+		put_ct_buf(resp);
 	}
 	return NULL;
 }
 
-void show_ns_info(HBA_HANDLE handle, uint64_t value)
+/* walk the name server one port at a time */
+void show_ns_walk(HBA_HANDLE handle, uint64_t value)
 {
 	char *resp, *payload;
 	uint32_t tmp = 0, port_id = 0;
@@ -66,8 +64,6 @@ void show_ns_info(HBA_HANDLE handle, uint64_t value)
 	char *pt[] = PORT_TYPE;
 	char prot_str[255];
 
-	printf("\nLocal Port List:\n");
-
 	do {
 		resp = send_ct(handle, CT_IU_PREAMBLE_SIZE + 4,
 			       CT_IU_PREAMBLE_SIZE + 640,
@@ -107,10 +103,185 @@ void show_ns_info(HBA_HANDLE handle, uint64_t value)
 		else
 			printf("\n");
 
-		free(resp);
+		put_ct_buf(resp);
 	} while (1);
 }
 
+#define NS_LAST_ENTRY	0x80
+#define NS_FT_ENTRIES	1024
+
+struct ns_port {
+	uint32_t port_id;
+	uint64_t port_name;
+	uint32_t proto;
+	uint8_t type;
+};
+
+static int cmp_ns_port(const void *a, const void *b)
+{
+	const struct ns_port *p1 = a, *p2 = b;
+
+	return (p1->port_id > p2->port_id) - (p1->port_id < p2->port_id);
+}
+
+/* add the ports of a FC-4 type, returns -1 if the list is not available */
+int get_ns_ports(HBA_HANDLE handle, uint8_t fc4_type, struct ns_port **ports,
+		 uint32_t *cnt)
+{
+	struct ns_port *p;
+	char *resp, *entry;
+	uint32_t param = fc4_type, off;
+
+	resp = send_ct_pt(handle, CT_IU_PREAMBLE_SIZE + 4,
+			  CT_IU_PREAMBLE_SIZE + NS_FT_ENTRIES * 16,
+			  NS_RCC_GPN_FT, (char *)&param,
+			  SUBTYPE_NAME_SERVER, GS_TYPE_DIRECTORY_SERVICE);
+	if (!resp)
+		return -1;
+	if (*(uint16_t *)(resp + CT_IU_CODE_OFFSET) !=
+	    GS_ACCEPT_RESPONSE_CT_IU) {
+		put_ct_buf(resp);
+		return -1;
+	}
+
+	for (off = CT_IU_PREAMBLE_SIZE; off + 16 <= ct_buf_size(resp);
+	     off += 16) {
+		entry = resp + off;
+		p = realloc(*ports, (*cnt + 1) * sizeof(struct ns_port));
+		if (!p)
+			break;
+		*ports = p;
+		p += (*cnt)++;
+		p->port_id = (*(uint32_t *) entry) & 0xffffff;
+		p->port_name = *(uint64_t *) (entry + 8);
+		p->proto = 1 << (fc4_type % 32);
+		p->type = UNIDENTIFIED;
+		if (*entry & NS_LAST_ENTRY)
+			break;
+	}
+
+	put_ct_buf(resp);
+	return 0;
+}
+
+/* get the port type of the listed ports that are N_Ports */
+void get_ns_nports(HBA_HANDLE handle, struct ns_port *ports, uint32_t cnt)
+{
+	struct ns_port key, *p;
+	char *resp, *entry;
+	uint32_t param = N_PORT << 24, off;
+
+	resp = send_ct_pt(handle, CT_IU_PREAMBLE_SIZE + 4,
+			  CT_IU_PREAMBLE_SIZE + NS_FT_ENTRIES * 4,
+			  NS_RCC_GID_PT, (char *)&param,
+			  SUBTYPE_NAME_SERVER, GS_TYPE_DIRECTORY_SERVICE);
+	if (!resp)
+		return;
+	if (*(uint16_t *)(resp + CT_IU_CODE_OFFSET) !=
+	    GS_ACCEPT_RESPONSE_CT_IU) {
+		put_ct_buf(resp);
+		return;
+	}
+
+	for (off = CT_IU_PREAMBLE_SIZE; off + 4 <= ct_buf_size(resp);
+	     off += 4) {
+		entry = resp + off;
+		key.port_id = (*(uint32_t *) entry) & 0xffffff;
+		p = bsearch(&key, ports, cnt, sizeof(struct ns_port),
+			    cmp_ns_port);
+		if (p)
+			p->type = N_PORT;
+		if (*entry & NS_LAST_ENTRY)
+			break;
+	}
+
+	put_ct_buf(resp);
+}
+
+/* get the port type of a port with GA_NXT */
+uint8_t get_ns_port_type(HBA_HANDLE handle, uint32_t port_id)
+{
+	char *resp, *payload;
+	uint32_t param = port_id - 1;
+	uint8_t type = UNIDENTIFIED;
+
+	resp = send_ct(handle, CT_IU_PREAMBLE_SIZE + 4,
+		       CT_IU_PREAMBLE_SIZE + 640, NS_RCC_GA_NXT,
+		       (char *)&param, SUBTYPE_NAME_SERVER,
+		       GS_TYPE_DIRECTORY_SERVICE);
+	if (!resp)
+		return type;
+
+	payload = resp + CT_IU_PREAMBLE_SIZE;
+	if ((*(uint32_t *) payload & 0xffffff) == port_id)
+		type = *payload;
+
+	put_ct_buf(resp);
+	return type;
+}
+
+/*
+ * List the FCP and FICON ports with GPN_FT and take the port type of
+ * N_Ports from GID_PT, a handful of requests regardless of the fabric size.
+ * Only ports of other types are queried one by one.
+ */
+void show_ns_info(HBA_HANDLE handle, uint64_t value)
+{
+	struct ns_port *ports = NULL, *p;
+	uint32_t cnt = 0, i, j;
+	char *pt[] = PORT_TYPE;
+	char prot_str[255];
+
+	printf("\nLocal Port List:\n");
+
+	if (get_ns_ports(handle, FC4_TYPE_FCP, &ports, &cnt)) {
+		free(ports);
+		show_ns_walk(handle, value);
+		return;
+	}
+	get_ns_ports(handle, FC4_TYPE_SB2_CHANNEL, &ports, &cnt);
+	get_ns_ports(handle, FC4_TYPE_SB2_CU, &ports, &cnt);
+
+	/* merge the lists */
+	qsort(ports, cnt, sizeof(struct ns_port), cmp_ns_port);
+	for (i = 0, j = 0; i < cnt; i++) {
+		if (j && ports[j - 1].port_id == ports[i].port_id)
+			ports[j - 1].proto |= ports[i].proto;
+		else
+			ports[j++] = ports[i];
+	}
+	cnt = j;
+
+	get_ns_nports(handle, ports, cnt);
+
+	for (i = 0; i < cnt; i++) {
+		p = &ports[i];
+		if ((display_detail & ATTACHMENT) &&
+		    !(value == p->port_id || value == p->port_name))
+			continue;
+
+		if (p->type == UNIDENTIFIED)
+			p->type = get_ns_port_type(handle, p->port_id);
+
+		memset(prot_str, 0, 255);
+
+		printf("\t 0x%016lx / 0x%x [%s] ", p->port_name, p->port_id,
+			pt[p->type]);
+
+		if (p->proto & 0x100)
+			strcat(prot_str, " SCSI-FCP ");
+		if ((p->proto & 0x18000000) == 0x18000000)
+			strcat(prot_str, " FICON ");
+
+		if (strlen(prot_str))
+			printf("proto =%s\n", prot_str);
+		else
+			printf("\n");
+	}
+
+	free(ports);
+}
+
 uint32_t get_ice_list(HBA_HANDLE handle, struct interconnect_element **p_ice)
 {
 	struct interconnect_element *ice = NULL;
@@ -140,7 +311,7 @@ uint32_t get_ice_list(HBA_HANDLE handle, struct interconnect_element **p_ice)
 	}
 
 	*p_ice = ice;
-	free(resp);
+	put_ct_buf(resp);
 	return entries;
 }
 
@@ -175,7 +346,7 @@ uint32_t get_port_list(HBA_HANDLE handle, uint64_t const ice_name, struct port_l
 	}
 
 	*pple = ple;
-	free(resp);
+	put_ct_buf(resp);
 	return entries;
 }
 
@@ -210,7 +381,7 @@ uint32_t get_att_port_list(HBA_HANDLE handle, uint64_t const icep_name,
 	}
 
 	*papn = apn;
-	free(resp);
+	put_ct_buf(resp);
 	return entries;
 }
 
@@ -230,7 +401,7 @@ uint8_t get_domain_id(HBA_HANDLE handle, uint64_t icep_name)
 
 	domain_id = *(uint16_t *)(resp + CT_IU_PREAMBLE_SIZE);
 
-	free(resp);
+	put_ct_buf(resp);
 	return domain_id & 0xff;
 }
 
@@ -251,7 +422,7 @@ uint8_t get_port_state(HBA_HANDLE handle, uint64_t port_name)
 
 	port_state = *(uint8_t *)(resp + CT_IU_PREAMBLE_SIZE + 7);
 
-	free(resp);
+	put_ct_buf(resp);
 	return port_state;
 }
 
@@ -271,7 +442,7 @@ uint32_t get_ppn(HBA_HANDLE handle, uint64_t port_name)
 
 	ppn = *(uint32_t *) (resp + CT_IU_PREAMBLE_SIZE);
 
-        free(resp);
+        put_ct_buf(resp);
         return ppn;
 }
 
@@ -296,7 +467,7 @@ char * get_information_list(HBA_HANDLE handle, uint64_t name)
 	if (ret_str)
 		memcpy(ret_str, payload + offset, length);
 
-        free(resp);
+        put_ct_buf(resp);
         return ret_str;
 }
 
@@ -319,7 +490,7 @@ char * get_ice_logical_name(HBA_HANDLE handle, uint64_t name)
 	if (ret_str)
 		strncpy(ret_str, payload + 1 , *(uint8_t *)payload);
 
-        free(resp);
+        put_ct_buf(resp);
         return ret_str;
 }
 
@@ -339,7 +510,7 @@ uint32_t get_destination_id(HBA_HANDLE handle, uint64_t port_name)
 
         d_id = *(uint32_t *)(resp + CT_IU_PREAMBLE_SIZE);
 
-        free(resp);
+        put_ct_buf(resp);
         return d_id & 0xFFFFFF;
 }
 
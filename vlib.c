@@ -94,6 +94,39 @@ void _initvlib(void)
 		}
 	}
 
+	vlib_data.sg_fd_cache.size = VLIB_SG_FD_CACHE_DEFAULT;
+	env = getenv(VLIB_ENV_SG_FD_CACHE);
+	if (env != NULL && atoi(env) >= 0)
+		vlib_data.sg_fd_cache.size = atoi(env);
+
+	vlib_data.wlun_pool.idle = VLIB_WLUN_IDLE_DEFAULT;
+	env = getenv(VLIB_ENV_WLUN_IDLE);
+	if (env != NULL && atoi(env) >= 0)
+		vlib_data.wlun_pool.idle = atoi(env);
+
+	vlib_data.inquiry_cache.ttl = VLIB_INQUIRY_TTL_DEFAULT;
+	env = getenv(VLIB_ENV_INQUIRY_TTL);
+	if (env != NULL && atoi(env) >= 0)
+		vlib_data.inquiry_cache.ttl = atoi(env);
+	vlib_data.inquiry_cache.uevent_fd = -1;
+	vlib_data.adapterUeventFd = -1;
+	vlib_data.seqnumFd = -1;
+
+	vlib_data.ctRate = VLIB_CT_RATE_DEFAULT;
+	env = getenv(VLIB_ENV_CT_RATE);
+	if (env != NULL && atoi(env) >= 0)
+		vlib_data.ctRate = atoi(env);
+
+	vlib_data.ctCoalesce = 1;
+	env = getenv(VLIB_ENV_CT_COALESCE);
+	if (env != NULL && atoi(env) == 0)
+		vlib_data.ctCoalesce = 0;
+
+	vlib_data.nsMirror = 1;
+	env = getenv(VLIB_ENV_NS_MIRROR);
+	if (env != NULL && atoi(env) == 0)
+		vlib_data.nsMirror = 0;
+
 	/* start logging */
 	if (vlib_data.loglevel > 0) {
 		char timestr[32];
@@ -106,6 +139,9 @@ void _initvlib(void)
 	}
 
 	pthread_mutex_init(&vlib_data.mutex, &mutexattr);
+	pthread_mutex_init(&vlib_data.inquiry_cache.mutex, &mutexattr);
+	pthread_mutex_init(&vlib_data.ns_mutex, &mutexattr);
+	pthread_cond_init(&vlib_data.wlun_pool.cond, NULL);
 }
 
 /** @ingroup InitAndFini
@@ -116,6 +152,9 @@ void _finivlib(void)
 	if (vlib_data.errfp != stderr)
 		fclose(vlib_data.errfp);
 
+	pthread_cond_destroy(&vlib_data.wlun_pool.cond);
+	pthread_mutex_destroy(&vlib_data.inquiry_cache.mutex);
+	pthread_mutex_destroy(&vlib_data.ns_mutex);
 	pthread_mutex_destroy(&vlib_data.mutex);
 }
 
@@ -199,7 +238,11 @@ HBA_STATUS HBA_FreeLibrary(void)
 		return HBA_STATUS_ERROR;
 	}
 
+	releaseAllWLUNs();
 	closeAllAdapters();
+	sgutils_freeFdCache();
+	sgutils_freeInquiryCache();
+	sg_io_freeBufferPool();
 
 	vlib_data.isLoaded = 0;
 	vlib_data.unloading = 0;
@@ -429,6 +472,10 @@ void HBA_RefreshInformation(HBA_HANDLE handle)
 		VLIB_LOG("ERROR: invalid adapter handle or "
 			 "adapter unavailable\n");
 	} else {
+		invalidateAdapterAttributes(adapter);
+		invalidateAdapterPortAttributes(adapter);
+		invalidatePortAttributesByDid(adapter, 0, 0);
+		compactAdapter(adapter);
 		updateAdapter(adapter);
 	}
 
@@ -457,11 +504,24 @@ void HBA_RefreshAdapterConfiguration(void)
  * @note  We do not report HBA_STATUS_ERROR_STALE_DATA, because we use
  *	semistatic tables internally. We just make use of
  *	HBA_STATUS_ERROR_UNAVAILABLE (e.g. if an adapter is removed).
+ *
+ * If the uevent sequence number changed since the adapters were read, they
+ * are read again. Adapters that are gone are closed, the ports and units of
+ * the others are reconciled (see updateAdapter()). Otherwise nothing but
+ * the sequence number is read. The repository generation only changes if
+ * adapters, ports or units came or went.
  */
 void HBA_RefreshAdapterConfiguration(void)
 {
+	unsigned long long seqnum;
+
 	VLIB_MUTEX_LOCK(&vlib_data.mutex);
 
+	if (vlib_data.isLoaded && vlib_data.isValid &&
+	    !(vlib_data.haveSeqnum && sysfs_readSeqnum(&seqnum) == 0 &&
+	      seqnum == vlib_data.seqnum))
+		vlib_data.isValid = 0;
+
 	revalidateRepository();
 
 	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
@@ -570,14 +630,50 @@ HBA_HANDLE HBA_OpenAdapter(char *pAdaptername)
 	return handle;
 }
 
-/** @ingroup UnSupportedHBAAPIs
- * @return HBA_STATUS_ERROR_NOT_SUPPORTED
- * @note This function is currently not supported.
+/** @ingroup SupportedHBAAPIs
+ * @brief Open an adapter by its WWPN or WWNN.
+ * @param *pHandle returns the handle of the adapter
+ * @param wwn port name or node name of the adapter
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pHandle is NULL
+ *	- HBA_STATUS_ERROR_ILLEGAL_WWN if no adapter has that WWN
+ *	- HBA_STATUS_ERROR_AMBIGUOUS_WWN if more than one adapter has that WWN
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The adapter is looked up in the WWN index of the repository.
  */
 HBA_STATUS HBA_OpenAdapterByWWN(HBA_HANDLE *pHandle, HBA_WWN wwn)
 {
-	/* note: wwn is either node name or port name of adapter */
-	return HBA_STATUS_ERROR_NOT_SUPPORTED;
+	HBA_STATUS status;
+	wwn_t adapterwwn;
+	int index;
+
+	if (!pHandle)
+		return HBA_STATUS_ERROR_ARG;
+
+	vlib_HBA_WWN_to_wwn(&wwn, &adapterwwn);
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	index = getAdapterIndexByWWN(adapterwwn, &status);
+	if (index >= 0) {
+		*pHandle = openAdapterByIndex(index);
+		if (*pHandle == VLIB_INVALID_HANDLE)
+			status = HBA_STATUS_ERROR;
+	}
+
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return status;
 }
 
 /** @ingroup SupportedHBAAPIs
@@ -623,13 +719,20 @@ void HBA_CloseAdapter(HBA_HANDLE handle)
  *	lock/unlock of vlib_data.mutex
  * @note ZFCP HBA API does not set the adapter attributes OptionROMVersion
  *	and NodeSymbolicName.
+ *
+ * The attributes are cached per adapter. The cache is dropped by uevents of
+ * the ccw device of the adapter, by link up and link down events (adapter
+ * recovery), by HBA_RefreshInformation() and ZFCP_RefreshAdapterAttributes().
+ * Without a uevent socket, the attributes are read from sysfs each time.
  */
 HBA_STATUS HBA_GetAdapterAttributes(HBA_HANDLE handle,
 				    HBA_ADAPTERATTRIBUTES *pAdapterattributes)
 {
 	HBA_STATUS status;
-	int ret;
 	struct vlib_adapter *adapter;
+	unsigned short host;
+	unsigned int generation;
+	int cache;
 
 	VLIB_MUTEX_LOCK(&vlib_data.mutex);
 
@@ -645,9 +748,59 @@ HBA_STATUS HBA_GetAdapterAttributes(HBA_HANDLE handle,
 		return status;
 	}
 
+	sysfs_readAdapterUevents();
+	if (adapter->attrCache.isValid) {
+		*pAdapterattributes = adapter->attrCache.attrs;
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_OK;
+	}
+	cache = sysfs_watchAdapters() == 0;
+	host = adapter->ident.host;
+	generation = adapter->attrCache.generation;
+
 	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
 	status = sysfs_getAdapterAttributes(&pAdapterattributes, adapter);
+	if (status != HBA_STATUS_OK || !cache)
+		return status;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHostNo(host);
+	if (adapter && adapter->attrCache.generation == generation) {
+		adapter->attrCache.attrs = *pAdapterattributes;
+		adapter->attrCache.isValid = 1;
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return status;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Drop the cached attributes of an adapter and its port.
+ * @param handle of an opened adapter
+ * @return
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ * 	- HBA_STATUS_OK on success.
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The next HBA_GetAdapterAttributes() and HBA_GetAdapterPortAttributes()
+ * read the attributes from sysfs again. Unlike HBA_RefreshInformation(), the
+ * ports and units of the adapter are not read again.
+ */
+HBA_STATUS ZFCP_RefreshAdapterAttributes(HBA_HANDLE handle)
+{
+	HBA_STATUS status;
+	struct vlib_adapter *adapter;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHandle(handle, &status);
+	if (adapter) {
+		invalidateAdapterAttributes(adapter);
+		invalidateAdapterPortAttributes(adapter);
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
 	return status;
 }
@@ -672,6 +825,15 @@ HBA_STATUS HBA_GetAdapterAttributes(HBA_HANDLE handle,
  *	this adapter (see revalidatePorts()).
  * @note ZFCP HBA API does not set the port attributes FabricName,
  *	OSDeviceName and PortSymbolicName for an adapter port.
+ * @note NumberofDiscoveredPorts is the number of ports in the repository,
+ *	which uevents of the remote ports keep current. Ports that have gone
+ *	since are counted, HBA_GetDiscoveredPortAttributes() returns
+ *	HBA_STATUS_ERROR_UNAVAILABLE for them. Without a uevent socket, the
+ *	ports are reconciled with sysfs if the uevent sequence number changed
+ *	(see updateAdapter()).
+ * @note The other attributes are cached until a link up or link down event
+ *	or a call of HBA_RefreshInformation() or
+ *	ZFCP_RefreshAdapterAttributes().
  */
 HBA_STATUS HBA_GetAdapterPortAttributes(HBA_HANDLE handle,
 					HBA_UINT32 portindex,
@@ -679,7 +841,9 @@ HBA_STATUS HBA_GetAdapterPortAttributes(HBA_HANDLE handle,
 {
 	HBA_STATUS status;
 	struct vlib_adapter *adapter;
-	int ret;
+	unsigned short host;
+	unsigned int generation;
+	int cache;
 
 	VLIB_MUTEX_LOCK(&vlib_data.mutex);
 
@@ -700,14 +864,112 @@ HBA_STATUS HBA_GetAdapterPortAttributes(HBA_HANDLE handle,
 		return HBA_STATUS_ERROR_ILLEGAL_INDEX;
 	}
 
+	cache = sysfs_watchAdapters() == 0;
 	if (revalidatePorts(adapter) < 0) {
 		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 		return HBA_STATUS_ERROR;
 	}
 
+	sysfs_readAdapterUevents();
+	if (adapter->portsStale)
+		sysfs_createAndReadConfigPorts(adapter);
+	else if (!cache)
+		updateAdapter(adapter);
+
+	if (adapter->portCache.isValid) {
+		*pPortattributes = adapter->portCache.attrs;
+		pPortattributes->NumberofDiscoveredPorts = adapter->ports.used;
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_OK;
+	}
+	host = adapter->ident.host;
+	generation = adapter->portCache.generation;
+
 	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
 	status = sysfs_getAdapterPortAttributes(&pPortattributes, adapter);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHostNo(host);
+	if (adapter) {
+		if (cache && adapter->portCache.generation == generation) {
+			adapter->portCache.attrs = *pPortattributes;
+			adapter->portCache.isValid = 1;
+		}
+		pPortattributes->NumberofDiscoveredPorts = adapter->ports.used;
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return status;
+}
+
+/**
+ * @brief Return the attributes of a discovered port, from its cache if
+ *	possible.
+ * @param *adapter through which the port is reached
+ * @param *port the discovered port
+ * @param *pPortattributes pointer to return atributes
+ * @return
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if the port is unavailable
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ * 	- HBA_STATUS_OK on success.
+ * @par Locks:
+ *	vlib_data.mutex must be held, it is released before return
+ *
+ * On a cache miss, the attributes are read from sysfs without vlib_data.mutex
+ * and stored unless the cache was invalidated meanwhile. Without a uevent
+ * socket nothing is cached.
+ */
+static HBA_STATUS getDiscoveredPortAttributes(struct vlib_adapter *adapter,
+					      struct vlib_port *port,
+					      HBA_PORTATTRIBUTES *pPortattributes)
+{
+	HBA_STATUS status;
+	struct vlib_port copy;
+	unsigned short host;
+	unsigned int index, generation;
+	int cache;
+
+	/* uevents might add ports and thereby move the port array */
+	index = port - getPortByIndex(adapter, 0);
+	cache = sysfs_watchAdapters() == 0;
+	sysfs_readAdapterUevents();
+	port = getPortByIndex(adapter, index);
+
+	if (port->isInvalid) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR_UNAVAILABLE;
+	}
+
+	if (port->attrCache.isValid) {
+		*pPortattributes = port->attrCache.attrs;
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_OK;
+	}
+
+	/* the port array might be reallocated while the lock is dropped */
+	copy = *port;
+	host = adapter->ident.host;
+	generation = port->attrCache.generation;
+
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	status = sysfs_getDiscoveredPortAttributes(&pPortattributes, &copy);
+	if (status != HBA_STATUS_OK || !cache)
+		return status;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHostNo(host);
+	port = adapter ? getPortByIndex(adapter, index) : NULL;
+	if (port && !port->isInvalid && strcmp(port->name, copy.name) == 0 &&
+	    port->attrCache.generation == generation) {
+		port->attrCache.attrs = *pPortattributes;
+		port->attrCache.isValid = 1;
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
 	return status;
 }
 
@@ -738,6 +1000,10 @@ HBA_STATUS HBA_GetAdapterPortAttributes(HBA_HANDLE handle,
  * @note For PortSupportedFc4Types and PortActive Fc4Types we do not follow
  *	FC-HBA Rev 10. We do not store them "little-endian" but "big-endian" as
  *	it is suggested by Editors Note 1.
+ * @note The attributes are cached per port until a uevent of the remote
+ *	port, a RSCN page covering its D_ID, a link up or link down event or
+ *	HBA_RefreshInformation(). A port that is gone returns
+ *	HBA_STATUS_ERROR_UNAVAILABLE, whether its attributes are cached or not.
  */
 HBA_STATUS HBA_GetDiscoveredPortAttributes(HBA_HANDLE handle,
 					   HBA_UINT32 portindex,
@@ -745,7 +1011,6 @@ HBA_STATUS HBA_GetDiscoveredPortAttributes(HBA_HANDLE handle,
 					   HBA_PORTATTRIBUTES *pPortattributes)
 {
 	HBA_STATUS status;
-	int ret;
 	struct vlib_adapter *adapter;
 	struct vlib_port *port;
 
@@ -774,26 +1039,213 @@ HBA_STATUS HBA_GetDiscoveredPortAttributes(HBA_HANDLE handle,
 		return HBA_STATUS_ERROR_ILLEGAL_INDEX;
 	}
 
-	if (port->isInvalid) {
+	return getDiscoveredPortAttributes(adapter, port, pPortattributes);
+}
+
+/** @ingroup SupportedHBAAPIs
+ * @brief Return attributes of the adapter port or a discovered port by WWPN.
+ * @param handle to an opened adapter
+ * @param PortWWN WWPN of the adapter port or of a discovered port
+ * @param pPortattributes pointer to return atributes
+ * @return
+ *	- HBA_STATUS_NOT_LOADED if library is not loaded
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter or port is unavailable
+ *	- HBA_STATUS_ERROR_ILLEGAL_WWN if no such port is known to the adapter
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ * 	- HBA_STATUS_OK on success.
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ * @note The attributes are the ones of HBA_GetAdapterPortAttributes() and
+ *	HBA_GetDiscoveredPortAttributes(), resp. The discovered port is looked
+ *	up in the WWN index of the repository.
+ */
+HBA_STATUS HBA_GetPortAttributesByWWN(HBA_HANDLE handle, HBA_WWN PortWWN,
+				      HBA_PORTATTRIBUTES *pPortattributes)
+{
+	HBA_STATUS status;
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	wwn_t wwpn;
+
+	vlib_HBA_WWN_to_wwn(&PortWWN, &wwpn);
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status) {
 		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-		return HBA_STATUS_ERROR_UNAVAILABLE;
+		return status;
+	}
+
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
 	}
 
-	status = sysfs_getDiscoveredPortAttributes(&pPortattributes, port);
+	if (revalidatePorts(adapter) < 0) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR;
+	}
 
-	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	if (wwpn == adapter->ident.wwpn) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_GetAdapterPortAttributes(handle, 0,
+						    pPortattributes);
+	}
 
-	return status;
+	port = getPortByWWPN(adapter, wwpn);
+	if (NULL == port) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR_ILLEGAL_WWN;
+	}
+
+	return getDiscoveredPortAttributes(adapter, port, pPortattributes);
 }
 
-/** @ingroup UnSupportedHBAAPIs
- * @return HBA_STATUS_ERROR_NOT_SUPPORTED
- * @note This function is currently not supported.
- */
-HBA_STATUS HBA_GetPortAttributesByWWN(HBA_HANDLE handle, HBA_WWN PortWWN,
-				      HBA_PORTATTRIBUTES *pPortattributes)
+/** @ingroup ZfcpExtensions
+ * @brief Return attributes of all discovered ports of an adapter.
+ * @param handle to an opened adapter
+ * @param *pNumberOfEntries number of entries in pPortattributes, returns
+ *	the number of discovered ports
+ * @param *pPortattributes array to return the attributes
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if an argument is NULL
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in
+ *	pPortattributes, *pNumberOfEntries is set to the required number
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ * 	- HBA_STATUS_OK on success.
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The attributes are the ones of HBA_GetDiscoveredPortAttributes(), in the
+ * order of the discovered port index. Ports that disappeared from sysfs in
+ * the meantime are left out. Cached attributes are copied while the ports
+ * are listed under vlib_data.mutex. The others are read in one pass without
+ * it, see sysfs_getRemotePortsAttributes(), and cached afterwards.
+ */
+HBA_STATUS ZFCP_GetAllDiscoveredPortAttributes(HBA_HANDLE handle,
+					       HBA_UINT32 *pNumberOfEntries,
+					       HBA_PORTATTRIBUTES *pPortattributes)
 {
-	return HBA_STATUS_ERROR_NOT_SUPPORTED;
+	HBA_STATUS status;
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	struct sysfs_rport *rports;
+	struct {
+		unsigned int index;
+		unsigned int generation;
+	} *missed;
+	HBA_UINT32 count = 0, found = 0, misses = 0;
+	unsigned short host;
+	unsigned int i, j;
+	int cache;
+
+	if (!pNumberOfEntries || (!pPortattributes && *pNumberOfEntries))
+		return HBA_STATUS_ERROR_ARG;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	if (revalidatePorts(adapter) < 0) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR;
+	}
+
+	cache = sysfs_watchAdapters() == 0;
+	sysfs_readAdapterUevents();
+
+	rports = calloc(adapter->ports.used ? adapter->ports.used : 1,
+			sizeof(*rports));
+	missed = calloc(adapter->ports.used ? adapter->ports.used : 1,
+			sizeof(*missed));
+	if (!rports || !missed) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		free(rports);
+		free(missed);
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	port = getPortByIndex(adapter, 0);
+	for (i = 0; port && i < adapter->ports.used; ++i, ++port) {
+		if (port->isInvalid)
+			continue;
+		if (count >= *pNumberOfEntries) {
+			count++;
+			continue;
+		}
+		if (port->attrCache.isValid) {
+			pPortattributes[count++] = port->attrCache.attrs;
+			continue;
+		}
+		strcpy(rports[misses].name, port->name);
+		rports[misses].attrs = &pPortattributes[count++];
+		missed[misses].index = i;
+		missed[misses].generation = port->attrCache.generation;
+		misses++;
+	}
+	host = adapter->ident.host;
+
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	if (count > *pNumberOfEntries) {
+		*pNumberOfEntries = count;
+		status = HBA_STATUS_ERROR_MORE_DATA;
+		goto out;
+	}
+
+	status = sysfs_getRemotePortsAttributes(rports, misses);
+	if (status != HBA_STATUS_OK)
+		goto out;
+
+	if (cache) {
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		adapter = getAdapterByHostNo(host);
+		for (j = 0; adapter && j < misses; j++) {
+			port = getPortByIndex(adapter, missed[j].index);
+			if (rports[j].status != HBA_STATUS_OK || !port ||
+			    port->isInvalid ||
+			    strcmp(port->name, rports[j].name) != 0 ||
+			    port->attrCache.generation != missed[j].generation)
+				continue;
+			port->attrCache.attrs = *rports[j].attrs;
+			port->attrCache.isValid = 1;
+		}
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	}
+
+	/* drop ports that disappeared, the misses are in the same order */
+	for (i = 0, j = 0; i < count; i++) {
+		if (j < misses && rports[j].attrs == &pPortattributes[i]) {
+			if (rports[j++].status != HBA_STATUS_OK)
+				continue;
+		}
+		if (found != i)
+			pPortattributes[found] = pPortattributes[i];
+		found++;
+	}
+	*pNumberOfEntries = found;
+
+out:
+	free(rports);
+	free(missed);
+
+	return status;
 }
 
 /** @ingroup SupportedHBAAPIs
@@ -893,79 +1345,99 @@ HBA_STATUS HBA_SetBindingSupport(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 	return HBA_STATUS_ERROR_NOT_SUPPORTED;
 }
 
-/** @ingroup SupportedHBAAPIs
- * @brief Retrieve mappings between OS SCSI targets/units and FCP targets/units.
- * @param handle to an opened adapter
- * @param *pMapping pointer to return target mappings
+/**
+ * @brief Fill in the target mapping of a unit.
+ * @param *adapter the adapter
+ * @param *port the port of the unit
+ * @param *unit the unit
+ * @param *entry V1 entry to be filled in, NULL if entryV2 is used
+ * @param *entryV2 V2 entry to be filled in, NULL if entry is used
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+static void fillFcpTargetMapping(struct vlib_adapter *adapter,
+				 struct vlib_port *port,
+				 struct vlib_unit *unit,
+				 HBA_FCPSCSIENTRY *entry,
+				 HBA_FCPSCSIENTRYV2 *entryV2)
+{
+	HBA_SCSIID *scsiId;
+	HBA_FCPID *fcpId;
+
+	if (entryV2) {
+		scsiId = &entryV2->ScsiId;
+		fcpId = &entryV2->FcpId;
+		entryV2->LUID = unit->luid;
+	} else {
+		scsiId = &entry->ScsiId;
+		fcpId = &entry->FcpId;
+	}
+
+	scsiId->ScsiBusNumber = unit->channel;
+	scsiId->ScsiTargetNumber = unit->target;
+	scsiId->ScsiOSLun = unit->lun;
+	snprintf(scsiId->OSDeviceName, sizeof(scsiId->OSDeviceName),
+		 "/dev/bsg/%d:%d:%d:%d", adapter->ident.host, unit->channel,
+		 unit->target, unit->lun);
+
+	fcpId->FcId = vlib_FCID_to_hbaFCID(port->did);
+	vlib_wwn_to_HBA_WWN(port->wwnn, &fcpId->NodeWWN);
+	vlib_wwn_to_HBA_WWN(port->wwpn, &fcpId->PortWWN);
+	fcpId->FcpLun = unit->fcLun;
+}
+
+/**
+ * @brief Write the target mappings of an adapter into the caller's array.
+ * @param *adapter the adapter
+ * @param *entry array of V1 entries, NULL if entryV2 is used
+ * @param *entryV2 array of V2 entries, NULL if entry is used
+ * @param *NumberOfEntries size of the array, returns the number of mappings
  * @return
- *	- HBA_STATUS_NOT_LOADED if library is not loaded
- *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
- *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
- *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pMapping
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in the array
  *	to return complete mapping information
  *	- HBA_STATUS_ERROR if any other internal error occurs
  * 	- HBA_STATUS_OK on success.
  * @par Locks:
- *	lock/unlock of vlib_data.mutex
- * @note An OSDeviceName is not provided for target mappings.
- * @note Additionally this function triggers creation of unit configuration for
- *	this adapter (see revalidateUnits()).
- */
-HBA_STATUS HBA_GetFcpTargetMapping(HBA_HANDLE handle,
-				   HBA_FCPTARGETMAPPING *pMapping)
+ *	vlib_data.mutex must be held
+ *
+ * Used by HBA_GetFcpTargetMapping() and HBA_GetFcpTargetMappingV2(), so
+ * the entries are written in one pass without an intermediate buffer. V2
+ * entries additionally get the LUID cached in the unit.
+ */
+static HBA_STATUS emitFcpTargetMapping(struct vlib_adapter *adapter,
+				       HBA_FCPSCSIENTRY *entry,
+				       HBA_FCPSCSIENTRYV2 *entryV2,
+				       HBA_UINT32 *NumberOfEntries)
 {
 	unsigned int i, j;
-	struct vlib_adapter *adapter;
 	struct vlib_port *port;
 	struct vlib_unit *unit;
 	HBA_UINT32 total, free;
-	HBA_STATUS status;
-	HBA_FCPSCSIENTRY *entry;
-
-	VLIB_MUTEX_LOCK(&vlib_data.mutex);
-
-	status = revalidateRepository();
-	if (HBA_STATUS_OK != status) {
-		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-		return status;
-	}
 
-	adapter = getAdapterByHandle(handle, &status);
-	if (NULL == adapter) {
-		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-		return status;
-	}
-
-	if (revalidatePorts(adapter) < 0) {
-		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	if (revalidatePorts(adapter) < 0)
 		return HBA_STATUS_ERROR;
-	}
 
 	port = getPortByIndex(adapter, 0);
-	if (NULL == port) {
-		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	if (NULL == port)
 		return HBA_STATUS_ERROR;
-	}
 
-	free = pMapping->NumberOfEntries;
-	entry = pMapping->entry;
+	free = *NumberOfEntries;
 	total = 0;
 
 	for (i = 0; i < adapter->ports.used; ++i, ++port) {
 		if (port->isInvalid)
 			continue;
 
-		if (revalidateUnits(port) < 0) {
-			VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		if (revalidateUnits(port) < 0)
 			return HBA_STATUS_ERROR;
-		}
 
 		unit = getUnitByIndex(port, 0);
 		if (NULL == unit)
 			continue;
 
 		for (j = 0; j < port->units.used; ++j, ++unit) {
-			if (unit->isInvalid)
+			/* the report luns WLUN addresses the target, no LUN */
+			if (unit->isInvalid || unit->fcLun == REPORTLUNS_WLUN)
 				continue;
 
 			++total;
@@ -977,38 +1449,69 @@ HBA_STATUS HBA_GetFcpTargetMapping(HBA_HANDLE handle,
 				   returned in the NumberOfEntries field */
 				continue;
 
-			strcpy(entry->ScsiId.OSDeviceName, "");
-			entry->ScsiId.ScsiBusNumber = unit->channel;
-			entry->ScsiId.ScsiTargetNumber = unit->target;
-			entry->ScsiId.ScsiOSLun = unit->lun;
-			snprintf(entry->ScsiId.OSDeviceName,
-				sizeof(entry->ScsiId.OSDeviceName),
-				"/dev/bsg/%d:%d:%d:%d",
-				adapter->ident.host,
-				unit->channel,
-				unit->target,
-				unit->lun);
-
-			entry->FcpId.FcId = vlib_FCID_to_hbaFCID(port->did);
-			vlib_wwn_to_HBA_WWN(port->wwnn,
-					    &entry->FcpId.NodeWWN);
-			vlib_wwn_to_HBA_WWN(port->wwpn,
-					    &entry->FcpId.PortWWN);
-			entry->FcpId.FcpLun = unit->fcLun;
-
-			++entry;
+			fillFcpTargetMapping(adapter, port, unit, entry,
+					     entryV2);
+			if (entryV2)
+				++entryV2;
+			else
+				++entry;
+
 			--free;
 		}
 	}
 
-	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	if (total > *NumberOfEntries) {
+		*NumberOfEntries = total;
+		return HBA_STATUS_ERROR_MORE_DATA;
+	}
 
-	if (total > pMapping->NumberOfEntries)
-		status = HBA_STATUS_ERROR_MORE_DATA;
-	else
-		status = HBA_STATUS_OK;
+	*NumberOfEntries = total;
 
-	pMapping->NumberOfEntries = total;
+	return HBA_STATUS_OK;
+}
+
+/** @ingroup SupportedHBAAPIs
+ * @brief Retrieve mappings between OS SCSI targets/units and FCP targets/units.
+ * @param handle to an opened adapter
+ * @param *pMapping pointer to return target mappings
+ * @return
+ *	- HBA_STATUS_NOT_LOADED if library is not loaded
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pMapping
+ *	to return complete mapping information
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ * 	- HBA_STATUS_OK on success.
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ * @note An OSDeviceName is not provided for target mappings.
+ * @note Additionally this function triggers creation of unit configuration for
+ *	this adapter (see revalidateUnits()).
+ */
+HBA_STATUS HBA_GetFcpTargetMapping(HBA_HANDLE handle,
+				   HBA_FCPTARGETMAPPING *pMapping)
+{
+	struct vlib_adapter *adapter;
+	HBA_STATUS status;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	status = emitFcpTargetMapping(adapter, pMapping->entry, NULL,
+				      &pMapping->NumberOfEntries);
+
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
 	return status;
 }
@@ -1021,20 +1524,102 @@ HBA_STATUS HBA_GetFcpTargetMapping(HBA_HANDLE handle,
  * @return see HBA_GetFcpTargetMapping
  * @par Locks:
  *	lock/unlock of vlib_data.mutex
- * @note HBA_LUID is not provided for target mappings.
+ * @note LUID is the device identification descriptor of VPD page 0x83
+ *	(see inventory_identifyUnits()). The pages of all units without a
+ *	current LUID are requested concurrently before the mapping is built.
+ *	LUID is empty if the unit has no suitable descriptor or if the caller
+ *	is not root.
  * @note Our "adapters" have only one port, so the WWN parameter is
- *	superfluous. We only check if it matches to the adapter handle,
- * 	if yes, we call HBA_GetFcpTargetMapping
+ *	superfluous. We only check if it matches to the adapter handle.
  */
 HBA_STATUS HBA_GetFcpTargetMappingV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 				     HBA_FCPTARGETMAPPINGV2 *pMappingV2)
 {
 	struct vlib_adapter *adapter;
 	wwn_t wwpn;
-	int size;
-	int i;
+	unsigned int host;
+	HBA_STATUS status;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	vlib_HBA_WWN_to_wwn(&hbaPortWWN, &wwpn);
+	if (wwpn != adapter->ident.wwpn) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR_ILLEGAL_WWN;
+	}
+	host = adapter->ident.host;
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	/* sends SCSI commands, so this must not be done under the lock */
+	inventory_identifyUnits(host);
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	status = emitFcpTargetMapping(adapter, NULL, pMappingV2->entry,
+				      &pMappingV2->NumberOfEntries);
+
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return status;
+}
+
+/** @brief Position of a cursor over the target mappings of an adapter */
+struct ZFCP_FcpMappingCursor {
+	HBA_HANDLE handle;		/**< @brief the adapter */
+	unsigned long generation;	/**< @brief repository generation the
+					   cursor was opened at */
+	unsigned int port;		/**< @brief index of the next port */
+	unsigned int unit;		/**< @brief index of the next unit */
+};
+
+/** @ingroup ZfcpExtensions
+ * @brief Open a cursor over the target mappings of an adapter.
+ * @param handle to an opened adapter
+ * @param hbaPortWWN WWPN of the local adapter port
+ * @param *pCursor to return the cursor
+ * @return
+ *	- HBA_STATUS_ERROR_NOT_LOADED if library is not loaded
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_ILLEGAL_WWN if hbaPortWWN does not match the adapter
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ * 	- HBA_STATUS_OK on success.
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The port and unit configuration of the adapter is read and the LUIDs are
+ * harvested like in HBA_GetFcpTargetMappingV2(). The mappings are then
+ * returned in chunks by ZFCP_GetNextFcpTargetMappings(), so the caller
+ * neither has to size a buffer for all mappings nor to traverse them twice.
+ * The cursor must be closed with ZFCP_CloseFcpTargetMappingCursor().
+ */
+HBA_STATUS ZFCP_OpenFcpTargetMappingCursor(HBA_HANDLE handle,
+					   HBA_WWN hbaPortWWN,
+					   ZFCP_FCPMAPPINGCURSOR *pCursor)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	struct ZFCP_FcpMappingCursor *cursor;
+	unsigned int i, host;
+	wwn_t wwpn;
 	HBA_STATUS status;
-	HBA_FCPTARGETMAPPING *pMapping;
 
 	VLIB_MUTEX_LOCK(&vlib_data.mutex);
 	adapter = getAdapterByHandle(handle, &status);
@@ -1048,31 +1633,134 @@ HBA_STATUS HBA_GetFcpTargetMappingV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 		return HBA_STATUS_ERROR_ILLEGAL_WWN;
 	}
+	host = adapter->ident.host;
 	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
-	size = pMappingV2->NumberOfEntries;
-	pMapping = malloc(sizeof(HBA_FCPTARGETMAPPING) +
-					sizeof(HBA_FCPSCSIENTRY) * size);
-	if (pMapping == NULL)
+	/* sends SCSI commands, so this must not be done under the lock */
+	inventory_identifyUnits(host);
+
+	cursor = calloc(1, sizeof(*cursor));
+	if (!cursor) {
+		VLIB_PERROR(ENOMEM, "ERROR");
 		return HBA_STATUS_ERROR;
+	}
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
 
-	pMapping->NumberOfEntries = size;
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status)
+		goto out;
 
-	status =  HBA_GetFcpTargetMapping(handle, pMapping);
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter)
+		goto out;
 
-	pMappingV2->NumberOfEntries = pMapping->NumberOfEntries;
+	if (revalidatePorts(adapter) < 0) {
+		status = HBA_STATUS_ERROR;
+		goto out;
+	}
 
-	for (i = 0; i < size && i < pMapping->NumberOfEntries; i++) {
-		memcpy(&pMappingV2->entry[i], &pMapping->entry[i],
-				sizeof(HBA_FCPSCSIENTRY));
-		pMappingV2->entry[i].LUID.buffer[0] = '\0';
+	port = getPortByIndex(adapter, 0);
+	for (i = 0; port && i < adapter->ports.used; ++i, ++port) {
+		if (!port->isInvalid && revalidateUnits(port) < 0) {
+			status = HBA_STATUS_ERROR;
+			goto out;
+		}
 	}
 
-	free(pMapping);
+	cursor->handle = handle;
+	cursor->generation = vlib_data.generation;
+	*pCursor = cursor;
+	cursor = NULL;
+
+out:
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	free(cursor);
 
 	return status;
 }
 
+/** @ingroup ZfcpExtensions
+ * @brief Return the next target mappings of a cursor.
+ * @param cursor cursor opened with ZFCP_OpenFcpTargetMappingCursor()
+ * @param *pMapping buffer for the mappings, NumberOfEntries is the size of
+ *	the buffer on input and the number of returned mappings on output
+ * @return
+ *	- HBA_STATUS_ERROR_NOT_LOADED if library is not loaded
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if the adapter was closed
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_STALE_DATA if the configuration changed since the
+ *	cursor was opened
+ *	- HBA_STATUS_OK on success, NumberOfEntries is 0 after the last mapping
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * All chunks returned by a cursor belong to the same version of the
+ * configuration. If it changes, the cursor cannot continue and
+ * HBA_STATUS_ERROR_STALE_DATA is returned; the caller has to open a new
+ * cursor to start over.
+ */
+HBA_STATUS ZFCP_GetNextFcpTargetMappings(ZFCP_FCPMAPPINGCURSOR cursor,
+					 HBA_FCPTARGETMAPPINGV2 *pMapping)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	struct vlib_unit *unit;
+	HBA_UINT32 count = 0;
+	HBA_STATUS status;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	if (!vlib_data.isLoaded) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR_NOT_LOADED;
+	}
+
+	adapter = getAdapterByHandle(cursor->handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	/* an invalid repository is about to be reread */
+	if (!vlib_data.isValid || cursor->generation != vlib_data.generation) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR_STALE_DATA;
+	}
+
+	while (count < pMapping->NumberOfEntries &&
+	       cursor->port < adapter->ports.used) {
+		port = getPortByIndex(adapter, cursor->port);
+		if (port->isInvalid || cursor->unit >= port->units.used) {
+			cursor->port++;
+			cursor->unit = 0;
+			continue;
+		}
+
+		unit = getUnitByIndex(port, cursor->unit++);
+		if (unit->isInvalid || unit->fcLun == REPORTLUNS_WLUN)
+			continue;
+
+		fillFcpTargetMapping(adapter, port, unit, NULL,
+				     &pMapping->entry[count++]);
+	}
+
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	pMapping->NumberOfEntries = count;
+
+	return HBA_STATUS_OK;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Close a cursor over target mappings.
+ * @param cursor cursor opened with ZFCP_OpenFcpTargetMappingCursor()
+ */
+void ZFCP_CloseFcpTargetMappingCursor(ZFCP_FCPMAPPINGCURSOR cursor)
+{
+	free(cursor);
+}
+
 /** @ingroup UnSupportedHBAAPIs
  * @return HBA_STATUS_ERROR_NOT_SUPPORTED
  * @note This function is currently not supported.
@@ -1147,16 +1835,16 @@ static HBA_STATUS _HBA_SendScsiInquiry(HBA_HANDLE handle, HBA_WWN PortWWN,
 			       HBA_UINT64 fcLUN, HBA_UINT8 EVPD,
 			       HBA_UINT32 PageCode,
 			       void *pRspBuffer, HBA_UINT32 *RspBufferSize,
-			       void *pSenseBuffer, HBA_UINT32 *SenseBufferSize)
+			       HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+			       HBA_UINT32 *SenseBufferSize)
 {
 	struct vlib_adapter *adapter;
 	wwn_t wwpn;
 	HBA_STATUS status;
 	struct vlib_port *port;
-	struct vlib_unit *unit;
-
-	pSenseBuffer = NULL;
-	*SenseBufferSize = 0;
+	struct vlib_unit *unit, sdev;
+	unsigned long generation;
+	int sg_fd;
 
 	/* you need to be root to access /dev/sg* */
 	if (getuid())
@@ -1182,10 +1870,28 @@ static HBA_STATUS _HBA_SendScsiInquiry(HBA_HANDLE handle, HBA_WWN PortWWN,
 		return HBA_STATUS_ERROR_INVALID_LUN;
 	}
 
+	if (sgutils_getCachedInquiry(unit, EVPD, PageCode, pRspBuffer,
+				     RspBufferSize, &generation) == 0) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		if (pScsiStatus)
+			*pScsiStatus = 0;
+		if (SenseBufferSize)
+			*SenseBufferSize = 0;
+		return HBA_STATUS_OK;
+	}
+
+	sdev = *unit;
+	sg_fd = sgutils_getUnitFd(unit);
 	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
-	status = sgutils_SendScsiInquiry(unit->sg_dev, EVPD, PageCode,
-					pRspBuffer, RspBufferSize);
+	status = sgutils_SendScsiInquiry(sg_fd, EVPD, PageCode,
+					pRspBuffer, RspBufferSize, pScsiStatus,
+					pSenseBuffer, SenseBufferSize);
+	sgutils_putUnitFd(sg_fd, &sdev, status);
+
+	if (status == HBA_STATUS_OK)
+		sgutils_cacheInquiry(&sdev, generation, EVPD, PageCode,
+				     pRspBuffer, *RspBufferSize);
 
 	return status;
 }
@@ -1219,6 +1925,8 @@ static HBA_STATUS _HBA_SendScsiInquiry(HBA_HANDLE handle, HBA_WWN PortWWN,
  *	with SCSI target ports.
  *	- HBA_STATUS_ERROR_TARGET_BUSY is not returned because zfcp cannot
  *	detect SCSI command overlap situations in general.
+ *	- Responses are returned from the INQUIRY cache for
+ *	LIB_ZFCP_HBAAPI_INQUIRY_TTL seconds, see @ref tuning.
  *	- ZFCP HBA API sends INQUIRY as untagged if the unit is not previously
  *	registered at the SCSI mid layer. If the device is already registered
  *	there, untagged/tagged is chosen as indicated in the associated
@@ -1235,7 +1943,7 @@ HBA_STATUS HBA_SendScsiInquiry(HBA_HANDLE handle, HBA_WWN PortWWN,
 			       void *pSenseBuffer, HBA_UINT32 SenseBufferSize)
 {
 	return _HBA_SendScsiInquiry(handle, PortWWN, fcLUN, EVPD, PageCode,
-					pRspBuffer, &RspBufferSize,
+					pRspBuffer, &RspBufferSize, NULL,
 					pSenseBuffer, &SenseBufferSize);
 }
 
@@ -1258,6 +1966,7 @@ HBA_STATUS HBA_SendScsiInquiry(HBA_HANDLE handle, HBA_WWN PortWWN,
  *	- HBA_STATUS_ERROR_INVALID_LUN if there is no unit for the the specified
  *	fcLUN configured
  *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pRspBuffer
+ *	- HBA_STATUS_SCSI_CHECK_CONDITION if a SCSI CHECK_CONDITION occurs
  *	- HBA_STATUS_ERROR if any other internal error occurs
  * 	- HBA_STATUS_OK on success.
  * @par Locks:
@@ -1267,6 +1976,8 @@ HBA_STATUS HBA_SendScsiInquiry(HBA_HANDLE handle, HBA_WWN PortWWN,
  *	with SCSI target ports.
  *	- HBA_STATUS_ERROR_TARGET_BUSY is not returned because zfcp cannot
  *	detect SCSI command overlap situations in general.
+ *	- Responses are returned from the INQUIRY cache for
+ *	LIB_ZFCP_HBAAPI_INQUIRY_TTL seconds, see @ref tuning.
  */
 HBA_STATUS HBA_ScsiInquiryV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 			     HBA_WWN discoveredPortWWN, HBA_UINT64 fcLUN,
@@ -1278,7 +1989,7 @@ HBA_STATUS HBA_ScsiInquiryV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 	*pScsiStatus = 0;
 	return _HBA_SendScsiInquiry(handle, discoveredPortWWN, fcLUN,
 					CDB_Byte1, CDB_Byte2,
-					pRspBuffer, pRspBufferSize,
+					pRspBuffer, pRspBufferSize, pScsiStatus,
 					pSenseBuffer, pSenseBufferSize);
 }
 
@@ -1290,17 +2001,17 @@ HBA_STATUS HBA_ScsiInquiryV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
  */
 static HBA_STATUS _HBA_SendReportLUNs(HBA_HANDLE handle, HBA_WWN portWWN,
 			      void *pRspBuffer, HBA_UINT32 *RspBufferSize,
-			      void *pSenseBuffer, HBA_UINT32 *SenseBufferSize)
+			      HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+			      HBA_UINT32 *SenseBufferSize)
 {
 	struct vlib_adapter *adapter;
 	wwn_t wwpn;
-	HBA_STATUS status;
+	HBA_STATUS status, ret;
 	struct vlib_port *port;
-	char *sg_dev;
-	int wlunattached = 0;
-
-	pSenseBuffer = NULL;
-	*SenseBufferSize = 0;
+	struct vlib_unit *unit, sdev;
+	char bus_dev_name[sizeof(adapter->ident.bus_dev_name)];
+	unsigned int host, channel, target;
+	int sg_fd = -1, wlunattached = 0;
 
 	/* you need to be root to access /dev/sg* */
 	if (getuid())
@@ -1320,17 +2031,58 @@ static HBA_STATUS _HBA_SendReportLUNs(HBA_HANDLE handle, HBA_WWN portWWN,
 		return HBA_STATUS_ERROR_ILLEGAL_WWN;
 	}
 
-	sg_dev = getSgDevFromPort(port);
-	if (!sg_dev) {
-		sg_dev = getAttachedWLUN(adapter, port);
+	unit = getSgUnitFromPort(port);
+	if (!unit) {
+		/* attaching waits for the sg device, do not block others */
+		strcpy(bus_dev_name, adapter->ident.bus_dev_name);
+		host = port->host;
+		channel = port->channel;
+		target = port->target;
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+		attachWLUN(bus_dev_name, wwpn, host, channel, target);
 		wlunattached = 1;
+
+		/* adapters and ports might have moved meanwhile */
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		adapter = getAdapterByHandle(handle, &status);
+		port = adapter ? getPortByWWPN(adapter, wwpn) : NULL;
+		if (port == NULL) {
+			VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+			return adapter ? HBA_STATUS_ERROR_ILLEGAL_WWN : status;
+		}
+		unit = getAttachedWLUN(port);
 	}
 
-	status = sgutils_SendReportLUNs(sg_dev, pRspBuffer, RspBufferSize);
+	if (!unit) {
+		if (wlunattached)
+			detachWLUN(adapter, port);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR;
+	}
+
+	sdev = *unit;
+	if (sdev.fcLun == REPORTLUNS_WLUN)
+		/* a pooled wlun must not expire while it is used */
+		keepWLUN(adapter, port, 0);
+	if (!wlunattached)
+		sg_fd = sgutils_getUnitFd(unit);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
 	if (wlunattached)
-		detachWLUN(adapter, port);
+		sg_fd = sgutils_waitForUnitFd(&sdev);
+	status = sgutils_SendReportLUNs(sg_fd, pRspBuffer, RspBufferSize,
+					pScsiStatus, pSenseBuffer,
+					SenseBufferSize);
+	sgutils_putUnitFd(sg_fd, &sdev, status);
 
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHandle(handle, &ret);
+	port = adapter ? getPortByWWPN(adapter, wwpn) : NULL;
+	if (port && sdev.fcLun == REPORTLUNS_WLUN)
+		keepWLUN(adapter, port, wlunattached);
+	else if (port && wlunattached)
+		detachWLUN(adapter, port);
 	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
 	return status;
@@ -1356,14 +2108,14 @@ static HBA_STATUS _HBA_SendReportLUNs(HBA_HANDLE handle, HBA_WWN portWWN,
  * @note
  * 	Lun Scanning only works if we have at least Lun 0 attached.
  * 	In all other cases we cannot scan the Luns (yet).
- * 	In addition, no SCSI sense data will be returned.
+ * 	On a SCSI CHECK_CONDITION the sense data is returned in pSenseBuffer.
  */
 HBA_STATUS HBA_SendReportLUNs(HBA_HANDLE handle, HBA_WWN portWWN,
 			      void *pRspBuffer, HBA_UINT32 RspBufferSize,
 			      void *pSenseBuffer, HBA_UINT32 SenseBufferSize)
 {
 	return _HBA_SendReportLUNs(handle, portWWN, pRspBuffer, &RspBufferSize,
-						pSenseBuffer, &SenseBufferSize);
+					NULL, pSenseBuffer, &SenseBufferSize);
 }
 /** @ingroup SupportedHBAAPIs
  * @brief Send a SCSI REPORT LUNS command to a target.
@@ -1386,7 +2138,7 @@ HBA_STATUS HBA_SendReportLUNs(HBA_HANDLE handle, HBA_WWN portWWN,
  * @note
  * 	Lun Scanning only works if we have at least Lun 0 attached.
  * 	In all other cases we cannot scan the Luns (yet).
- * 	In addition, no SCSI sense data will be returned.
+ * 	On a SCSI CHECK_CONDITION the sense data is returned in pSenseBuffer.
  * 	The only real difference to the V1 function is the additional
  * 	parameter for the local port. Since our "adapters" have only one port,
  * 	we can omit it.
@@ -1397,8 +2149,10 @@ HBA_STATUS HBA_ScsiReportLUNsV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 				HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
 				HBA_UINT32 *pSenseBufferSize)
 {
+	*pScsiStatus = 0;
 	return _HBA_SendReportLUNs(handle, discoveredPortWWN, pRspBuffer,
-			pRspBufferSize, pSenseBuffer, pSenseBufferSize);
+			pRspBufferSize, pScsiStatus, pSenseBuffer,
+			pSenseBufferSize);
 }
 
 /**
@@ -1410,7 +2164,8 @@ HBA_STATUS HBA_ScsiReportLUNsV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 static HBA_STATUS _HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
 				HBA_UINT64 fcLUN,
 				void *pRspBuffer, HBA_UINT32 *RspBufferSize,
-				void *pSenseBuffer, HBA_UINT32 *SenseBufferSize)
+				HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+				HBA_UINT32 *SenseBufferSize)
 {
 	int ret;
 	struct vlib_adapter *adapter;
@@ -1418,10 +2173,8 @@ static HBA_STATUS _HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
 	HBA_STATUS status;
 	wwn_t wwpn;
 	struct vlib_port *port;
-	struct vlib_unit *unit;
-
-	pSenseBuffer = NULL;
-	*SenseBufferSize = 0;
+	struct vlib_unit *unit, sdev;
+	int sg_fd;
 
 	if (*RspBufferSize < READCAP10LEN)
 		/* to small to hold the smallest response */
@@ -1455,9 +2208,13 @@ static HBA_STATUS _HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
 		return HBA_STATUS_ERROR_INVALID_LUN;
 	}
 
+	sdev = *unit;
+	sg_fd = sgutils_getUnitFd(unit);
 	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 
-	status = sgutils_SendReadCap(unit->sg_dev, pRspBuffer, RspBufferSize);
+	status = sgutils_SendReadCap(sg_fd, pRspBuffer, RspBufferSize,
+				     pScsiStatus, pSenseBuffer, SenseBufferSize);
+	sgutils_putUnitFd(sg_fd, &sdev, status);
 
 	return status;
 }
@@ -1477,6 +2234,7 @@ static HBA_STATUS _HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
  *	- HBA_STATUS_ERROR_INVALID_LUN if there is no unit for the the specified
  *	fcLUN configured
  *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pRspBuffer
+ *	- HBA_STATUS_SCSI_CHECK_CONDITION if a SCSI CHECK_CONDITION occurs
  *	- HBA_STATUS_ERROR if any other internal error occurs
  * 	- HBA_STATUS_OK on success.
  * @par Locks:
@@ -1486,8 +2244,8 @@ static HBA_STATUS _HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
  *	with SCSI target ports.
  *	- HBA_STATUS_ERROR_TARGET_BUSY is not returned because zfcp cannot
  *	detect SCSI command overlap situations in general.
- *	- ZFCP HBA API sends READ CAPACITY via libsgutils. Sense date is not
- * 	supported that way, so the sensebuffer is always NULL
+ *	- READ CAPACITY is sent with SG_IO on the bsg or sg device. On a
+ *	SCSI CHECK_CONDITION the sense data is returned in pSenseBuffer.
  */
 HBA_STATUS HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
 				HBA_UINT64 fcLUN,
@@ -1495,7 +2253,8 @@ HBA_STATUS HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
 				void *pSenseBuffer, HBA_UINT32 SenseBufferSize)
 {
 	return _HBA_SendReadCapacity(handle, portWWN, fcLUN, pRspBuffer,
-				&RspBufferSize, pSenseBuffer, &SenseBufferSize);
+				&RspBufferSize, NULL, pSenseBuffer,
+				&SenseBufferSize);
 }
 /** @ingroup SupportedHBAAPIs
  * @brief Send a SCSI READ CAPACITY command to a FCP LUN.
@@ -1513,6 +2272,7 @@ HBA_STATUS HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
  *	- HBA_STATUS_ERROR_INVALID_LUN if there is no unit for the the specified
  *	fcLUN configured
  *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pRspBuffer
+ *	- HBA_STATUS_SCSI_CHECK_CONDITION if a SCSI CHECK_CONDITION occurs
  *	- HBA_STATUS_ERROR if any other internal error occurs
  * 	- HBA_STATUS_OK on success.
  * @par Locks:
@@ -1522,8 +2282,8 @@ HBA_STATUS HBA_SendReadCapacity(HBA_HANDLE handle, HBA_WWN portWWN,
  *	with SCSI target ports.
  *	- HBA_STATUS_ERROR_TARGET_BUSY is not returned because zfcp cannot
  *	detect SCSI command overlap situations in general.
- *	- ZFCP HBA API sends READ CAPACITY via libsgutils. Sense date is not
- * 	supported that way, so the sensebuffer is always NULL
+ *	- READ CAPACITY is sent with SG_IO on the bsg or sg device. On a
+ *	SCSI CHECK_CONDITION the sense data is returned in pSenseBuffer.
  */
 HBA_STATUS HBA_ScsiReadCapacityV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 				  HBA_WWN discoveredPortWWN, HBA_UINT64 fcLUN,
@@ -1533,7 +2293,139 @@ HBA_STATUS HBA_ScsiReadCapacityV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 {
 	*pScsiStatus = 0;
 	return _HBA_SendReadCapacity(handle, discoveredPortWWN, fcLUN,
-		pRspBuffer, pRspBufferSize, pSenseBuffer, pSenseBufferSize);
+		pRspBuffer, pRspBufferSize, pScsiStatus, pSenseBuffer,
+		pSenseBufferSize);
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Send an arbitrary SCSI command to a FCP LUN.
+ * @param handle to an opened adapter
+ * @param discoveredPortWWN WWPN of the target port
+ * @param fcLUN FCP LUN of the unit
+ * @param *pCdb the command descriptor block
+ * @param CdbLength length of the CDB, at most 252 bytes
+ * @param Direction ZFCP_SCSI_DATA_NONE, ZFCP_SCSI_DATA_IN or
+ *	ZFCP_SCSI_DATA_OUT
+ * @param *pDataBuffer data to be sent or buffer to return data
+ * @param *pDataBufferSize size of the data buffer, returns number of bytes
+ *	transferred
+ * @param Timeout timeout in milliseconds, 0 for the default timeout
+ * @param *pScsiStatus pointer to return the SCSI status
+ * @param *pSenseBuffer pointer to return sense data on SCSI CHECK_CONDITION
+ * @param *pSenseBufferSize size of the sense buffer, returns length of the
+ *	sense data
+ * @return
+ *	- HBA_STATUS_ERROR_NOT_LOADED if library is not loaded
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_ILLEGAL_WWN if there is no such target port
+ *	- HBA_STATUS_ERROR_INVALID_LUN if there is no unit for the the specified
+ *	fcLUN configured
+ *	- HBA_STATUS_ERROR_ARG if CdbLength or Direction is invalid or a
+ *	required pointer is NULL
+ *	- HBA_STATUS_SCSI_CHECK_CONDITION if a SCSI CHECK_CONDITION occurs
+ *	- HBA_STATUS_ERROR if any other error occurs or the SCSI status is
+ *	neither GOOD nor CHECK_CONDITION
+ * 	- HBA_STATUS_OK on success.
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The command is sent through the bsg device of the unit. Data is
+ * transferred directly from/to pDataBuffer. Unless the command is known to
+ * only read, the cached INQUIRY data and LUID of the unit are dropped.
+ */
+HBA_STATUS ZFCP_ScsiPassThru(HBA_HANDLE handle, HBA_WWN discoveredPortWWN,
+			     HBA_UINT64 fcLUN, const void *pCdb,
+			     HBA_UINT32 CdbLength, HBA_UINT32 Direction,
+			     void *pDataBuffer, HBA_UINT32 *pDataBufferSize,
+			     HBA_UINT32 Timeout, HBA_UINT8 *pScsiStatus,
+			     void *pSenseBuffer, HBA_UINT32 *pSenseBufferSize)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	struct vlib_unit *unit, sdev;
+	struct vlib_scsi_cmd cmd;
+	HBA_STATUS status;
+	wwn_t wwpn;
+	int sg_fd;
+
+	if (!pCdb || !pDataBufferSize || !pScsiStatus || !pSenseBufferSize)
+		return HBA_STATUS_ERROR_ARG;
+
+	*pScsiStatus = 0;
+
+	if (CdbLength == 0 || CdbLength > SCSI_MAX_CDB_LEN ||
+	    Direction > ZFCP_SCSI_DATA_OUT)
+		return HBA_STATUS_ERROR_ARG;
+
+	/* you need to be root to access bsg devices */
+	if (getuid())
+		return HBA_STATUS_ERROR;
+
+	vlib_HBA_WWN_to_wwn(&discoveredPortWWN, &wwpn);
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	port = getPortByWWPN(adapter, wwpn);
+	if (port == NULL) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR_ILLEGAL_WWN;
+	}
+
+	if (revalidateUnits(port) < 0) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR;
+	}
+
+	unit = getUnitByFcLun(port, fcLUN);
+	if (unit == NULL) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR_INVALID_LUN;
+	}
+
+	sdev = *unit;
+	sg_fd = sgutils_getUnitFd(unit);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.cdb = (unsigned char *)pCdb;
+	cmd.cdbLen = CdbLength;
+	cmd.dir = Direction;
+	cmd.buf = pDataBuffer;
+	cmd.bufLen = Direction == ZFCP_SCSI_DATA_NONE ? 0 : *pDataBufferSize;
+	cmd.sense = pSenseBuffer;
+	cmd.senseLen = *pSenseBufferSize;
+	cmd.timeout = Timeout ? Timeout : SCSI_TIMEOUT;
+
+	status = sg_io_sendScsiCmd(sg_fd, &cmd);
+	if (status == HBA_STATUS_SCSI_CHECK_CONDITION)
+		sgutils_checkUnitAttention(sg_fd, cmd.sense, cmd.senseLen);
+	sgutils_putUnitFd(sg_fd, &sdev, status);
+
+	/* any other command might have changed INQUIRY data or the LUID */
+	if (!sgutils_isReadOnlyCdb(cmd.cdb)) {
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		sgutils_invalidateUnits(sdev.host, sdev.channel, sdev.target,
+					sdev.lun);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	}
+
+	*pScsiStatus = cmd.scsiStatus;
+	*pSenseBufferSize = cmd.senseLen;
+	*pDataBufferSize = cmd.bufLen - cmd.resid;
+
+	return status;
 }
 
 
@@ -1559,31 +2451,16 @@ HBA_STATUS HBA_ScsiReadCapacityV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
  *      - HBA_STATUS_OK on success.
  * @par Locks:
  *      lock/unlock of vlib_data.mutex
+ *
+ * The bsg device of the adapter is kept open, the mutex is not held while
+ * the request is outstanding.
  */
 HBA_STATUS HBA_SendCTPassThru(HBA_HANDLE handle, void *pReqBuffer,
 			      HBA_UINT32 ReqBufferSize, void *pRspBuffer,
 			      HBA_UINT32 RspBufferSize)
 {
-	HBA_STATUS status;
-	struct vlib_adapter *adapter;
-
-	VLIB_MUTEX_LOCK(&vlib_data.mutex);
-
-	status = revalidateRepository();
-	if (HBA_STATUS_OK != status) {
-		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-		return status;
-	}
-
-	adapter = getAdapterByHandle(handle, &status);
-	if (NULL == adapter) {
-		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-		return status;
-	}
-	status = sg_io_performCTPassThru(adapter, pReqBuffer, ReqBufferSize,
-						pRspBuffer, RspBufferSize);
-	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-	return status;
+	return pt_sendCT(handle, pReqBuffer, ReqBufferSize, pRspBuffer,
+			 RspBufferSize, NULL, CT_PASSTHRU_TIMEOUT);
 }
 
 /** @ingroup SupportedHBAAPIs
@@ -1594,7 +2471,8 @@ HBA_STATUS HBA_SendCTPassThru(HBA_HANDLE handle, void *pReqBuffer,
  * @param *pReqBuffer pointer to CT frame
  * @param ReqBufferSize size of the request buffer
  * @param *pRspBuffer pointer to return response data
- * @param RspBufferSize size of the response buffer
+ * @param *pRspBufferSize size of the response buffer, returns the length
+ *	of the response
  * @return
  *      - HBA_STATUS_NOT_LOADED if library is not loaded
  *      - HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
@@ -1604,13 +2482,55 @@ HBA_STATUS HBA_SendCTPassThru(HBA_HANDLE handle, void *pReqBuffer,
  *      - HBA_STATUS_OK on success.
  * @par Locks:
  *      lock/unlock of vlib_data.mutex
+ *
+ * The length of the response is derived from the residual count of the bsg
+ * request. If the CT accept reports a residual size, the response was
+ * truncated by the maximum size of the request; see
+ * ZFCP_SendCTPassThruAlloc().
  */
 HBA_STATUS HBA_SendCTPassThruV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 				void *pReqBuffer, HBA_UINT32 ReqBufferSize,
 				void *pRspBuffer, HBA_UINT32 *pRspBufferSize)
 {
-	return HBA_SendCTPassThru(handle, pReqBuffer, ReqBufferSize,
-						pRspBuffer, *pRspBufferSize);
+	return pt_sendCT(handle, pReqBuffer, ReqBufferSize, pRspBuffer,
+			 *pRspBufferSize, pRspBufferSize, CT_PASSTHRU_TIMEOUT);
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Get a buffer for CT pass-thru requests and responses.
+ * @param size of the buffer
+ * @return
+ *	- NULL if out of memory
+ *	- pointer to a zeroed, page aligned buffer
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The buffer must be released with ZFCP_FreePassThruBuffer(). Released
+ * buffers are kept by the library and handed out again, so applications
+ * sending many requests do not allocate memory for each of them.
+ */
+void *ZFCP_AllocPassThruBuffer(HBA_UINT32 size)
+{
+	void *buf;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	buf = sg_io_allocBuffer(size);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return buf;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Release a buffer obtained with ZFCP_AllocPassThruBuffer().
+ * @param *buf the buffer, might be NULL
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+void ZFCP_FreePassThruBuffer(void *buf)
+{
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	sg_io_freeBuffer(buf);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
 }
 
 /** @ingroup UnSupportedHBAAPIs
@@ -1674,55 +2594,25 @@ HBA_STATUS HBA_GetRNIDMgmtInfo(HBA_HANDLE handle, HBA_MGMTINFO *pInfo)
  * 	- HBA_STATUS_OK on success (LS_ACC or LS_RJT).
  * @par Locks:
  *	lock/unlock of vlib_data.mutex
+ *
+ * The D_ID of a remote port known to zfcp is taken from the repository. Only
+ * other ports are looked up at the name server.
  */
 HBA_STATUS HBA_SendRNID(HBA_HANDLE handle, HBA_WWN wwn, HBA_WWNTYPE wwntype,
 			void *pRspBuffer, HBA_UINT32 *pRspBufferSize)
 {
-	HBA_STATUS status;
-	int ret;
-	struct vlib_adapter *adapter;
-	struct vlib_port *port;
-	wwn_t portwwn;
-
-	if (!pRspBuffer || *pRspBufferSize < 0)
-		return HBA_STATUS_ERROR_ARG;
-
-	/* you need to be root to access /dev/* */
-	if (getuid())
-		return HBA_STATUS_ERROR;
-
-	VLIB_MUTEX_LOCK(&vlib_data.mutex);
-
-	status = revalidateRepository();
-	if (HBA_STATUS_OK != status) {
-		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-		return status;
-	}
-
-	adapter = getAdapterByHandle(handle, &status);
-	if (NULL == adapter) {
-		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-		return status;
-	}
-
-	vlib_HBA_WWN_to_wwn(&wwn, &portwwn);
-
-	status = sg_io_sendRNID(adapter, portwwn, pRspBuffer, *pRspBufferSize);
-
-	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
-
-	if (status == HBA_STATUS_ERROR_ELS_REJECT)
-		status = HBA_STATUS_OK;
-
-	return status;
+	return pt_sendRNID(handle, wwn, 0, pRspBuffer, pRspBufferSize,
+			   ELS_RNID_TIMEOUT);
 }
 
 /** @ingroup SupportedHBAAPIs
  * @brief Send a RNID ELS to a port.
  * @param handle to an opened adapter
  * @param hbaPortWWN local port of adapter - not necessary in our case
- * @param wwn of port to which to send RNID ELS
- * @param wwntype deprecated
+ * @param destWWN of port to which to send RNID ELS
+ * @param destFCID PortFcId of that port, 0 if unknown
+ * @param NodeIdDataFormat not supported, general topology discovery
+ *	format is always requested
  * @param *pRspBuffer pointer to return response data
  * @param *pRspBufferSize pointer to size of response buffer
  * @return
@@ -1735,15 +2625,15 @@ HBA_STATUS HBA_SendRNID(HBA_HANDLE handle, HBA_WWN wwn, HBA_WWNTYPE wwntype,
  *      - HBA_STATUS_OK on success (LS_ACC or LS_RJT).
  * @par Locks:
  *      lock/unlock of vlib_data.mutex
- * @note this function just calls the V1 version above so the new functionality
- *       offered by V2 is not supported
+ * @note If destFCID is given, RNID is sent there without looking up destWWN.
  */
 HBA_STATUS HBA_SendRNIDV2(HBA_HANDLE handle, HBA_WWN hbaPortWWN,
 			  HBA_WWN destWWN, HBA_UINT32 destFCID,
 			  HBA_UINT32 NodeIdDataFormat, void *pRspBuffer,
 			  HBA_UINT32 *pRspBufferSize)
 {
-	return HBA_SendRNID(handle, destWWN, 0, pRspBuffer, pRspBufferSize);
+	return pt_sendRNID(handle, destWWN, destFCID, pRspBuffer,
+			   pRspBufferSize, ELS_RNID_TIMEOUT);
 }
 
 /** @ingroup UnSupportedHBAAPIs
@@ -1757,16 +2647,40 @@ HBA_STATUS HBA_SendRPL(HBA_HANDLE handle, HBA_WWN hbaPortWWN, HBA_WWN agent_wwn,
 	return HBA_STATUS_ERROR_NOT_SUPPORTED;
 }
 
-/** @ingroup UnSupportedHBAAPIs
- * @return HBA_STATUS_ERROR_NOT_SUPPORTED
- * @note This function is currently not supported.
+/** @ingroup SupportedHBAAPIs
+ * @brief Send a RPS ELS to a port or domain controller.
+ * @param handle to an opened adapter
+ * @param hbaPortWWN local port of adapter - not necessary in our case
+ * @param agent_wwn of port to which to send RPS ELS, 0 for the domain
+ *	controller of agent_domain
+ * @param agent_domain domain of the domain controller
+ * @param object_wwn WWPN of the port whose status is requested, 0 to select
+ *	it by object_port_number
+ * @param object_port_number physical port number of that port
+ * @param *pRspBuffer pointer to return response data
+ * @param *pRspBufferSize pointer to size of response buffer, returns the
+ *	length of the response
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if a buffer is NULL or agent_domain is invalid
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_ELS_REJECT if the ELS was rejected, pRspBuffer
+ *	holds the LS_RJT
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pRspBuffer
+ *	and response data is truncated
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
  */
 HBA_STATUS HBA_SendRPS(HBA_HANDLE handle, HBA_WWN hbaPortWWN, HBA_WWN agent_wwn,
 		       HBA_UINT32 agent_domain, HBA_WWN object_wwn,
 		       HBA_UINT32 object_port_number, void *pRspBuffer,
 		       HBA_UINT32 *pRspBufferSize)
 {
-	return HBA_STATUS_ERROR_NOT_SUPPORTED;
+	return pt_sendRPS(handle, agent_wwn, agent_domain, object_wwn,
+			  object_port_number, pRspBuffer, pRspBufferSize,
+			  ELS_RPS_TIMEOUT);
 }
 
 /** @ingroup UnSupportedHBAAPIs
@@ -1791,14 +2705,35 @@ HBA_STATUS HBA_SendLIRR(HBA_HANDLE handle, HBA_WWN hbaPortWWN, HBA_WWN destWWN,
 	return HBA_STATUS_ERROR_NOT_SUPPORTED;
 }
 
-/** @ingroup UnSupportedHBAAPIs
- * @return HBA_STATUS_ERROR_NOT_SUPPORTED
- * @note This function is currently not supported.
+/** @ingroup SupportedHBAAPIs
+ * @brief Send a RLS ELS to a port.
+ * @param handle to an opened adapter
+ * @param hbaPortWWN local port of adapter - not necessary in our case
+ * @param destWWN of port to which to send RLS ELS
+ * @param *pRspBuffer pointer to return response data
+ * @param *pRspBufferSize pointer to size of response buffer, returns the
+ *	length of the response
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if a buffer is NULL
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_ELS_REJECT if the ELS was rejected, pRspBuffer
+ *	holds the LS_RJT
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pRspBuffer
+ *	and response data is truncated
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The link error status block of destWWN itself is requested. Use
+ * ZFCP_GetLinkErrorStatus() to query all remote ports at once.
  */
 HBA_STATUS HBA_SendRLS(HBA_HANDLE handle, HBA_WWN hbaPortWWN, HBA_WWN destWWN,
 		       void *pRspBuffer, HBA_UINT32 *pRspBufferSize)
 {
-	return HBA_STATUS_ERROR_NOT_SUPPORTED;
+	return pt_sendRLS(handle, destWWN, 0, pRspBuffer, pRspBufferSize,
+			  ELS_RLS_TIMEOUT);
 }
 
 /** @ingroup SupportedHBAAPIs
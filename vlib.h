@@ -48,6 +48,13 @@
  * Contains function declarations, macro definitions etc. defined in @ref FCHBA
  */
 
+/**
+ * @file zfcphbaapi.h
+ * @brief C header file describing vendor specific extensions.
+ *
+ * Contains declarations of the functions listed in @ref ZfcpExtensions
+ */
+
 /**
  * @mainpage ZFCP HBA API Library
  *
@@ -67,6 +74,9 @@
  * the status HBA_STATUS_ERROR_NOT_SUPPORTED if possible and are listed in
  * @ref UnSupportedHBAAPIs.
  *
+ * In addition, ZFCP HBA API Library provides the vendor specific functions
+ * listed in @ref ZfcpExtensions. They are declared in zfcphbaapi.h.
+ *
  *
  * @section restriction Restrictions and Peculiarities
  *
@@ -79,7 +89,8 @@
  *	- If SCSI command REPORT LUNS is send to a target port a unit with
  *	FCP LUN 0xc101000000000000 is implicitly created if not yet existent.
  * 	Lifetime of that implicitly created unit is temporary. It is the
- * 	report luns "well known lun".
+ * 	report luns "well known lun". It stays attached until it was not
+ * 	used for LIB_ZFCP_HBAAPI_WLUN_IDLE seconds.
  *	- The function HBA_GetFcpTargetMapping() does not return an OSDeviceName
  *	in struct HBA_FCPTargetMapping. This is conform to @ref FCHBA since this
  *	field is optional.
@@ -109,6 +120,63 @@
  *		- if not set, stderr is used
  *		- if set, specified file is used for log output
  *
+ * @section tuning Tuning
+ *
+ * The number of sg devices the library keeps open is controlled by:
+ *
+ *	- LIB_ZFCP_HBAAPI_SG_FD_CACHE - maximal number of cached sg file
+ *	descriptors
+ *		- if not set, up to 64 sg devices are kept open (default)
+ *		- if set to 0, sg devices are opened for each SCSI command
+ *
+ * How long the report luns well known LUN stays attached is controlled by:
+ *
+ *	- LIB_ZFCP_HBAAPI_WLUN_IDLE - seconds an implicitly attached report
+ *	luns WLUN stays attached after its last use
+ *		- if not set, the WLUN is detached after 30 seconds (default)
+ *		- if set to 0, the WLUN is detached right after REPORT LUNS
+ *
+ * How long INQUIRY and VPD data of a unit is cached is controlled by:
+ *
+ *	- LIB_ZFCP_HBAAPI_INQUIRY_TTL - seconds an INQUIRY response is
+ *	returned from the cache
+ *		- if not set, responses are cached for 60 seconds (default)
+ *		- if set to 0, INQUIRY is sent to the unit for each call
+ *
+ * Cached responses of a unit are dropped earlier if a uevent reports a
+ * change of the unit or its remote port, or if the unit reports a unit
+ * attention.
+ *
+ * Identical CT queries sent concurrently through the same adapter are sent to
+ * the fabric only once, all callers get the same response. This is controlled
+ * by:
+ *
+ *	- LIB_ZFCP_HBAAPI_CT_COALESCE - coalescing of CT queries
+ *		- if not set or set to a value other than 0, queries are
+ *		coalesced (default)
+ *		- if set to 0, each query is sent to the fabric
+ *
+ * CT requests are sent unpaced until a management server rejects one as
+ * busy. The request is retried after an exponential backoff and the adapter
+ * is paced at half the rate it sent at. Each further busy reject halves the
+ * rate again, each accepted request raises it by one request per second
+ * until pacing ends at twice the rate of the last busy reject. An upper
+ * limit is controlled by:
+ *
+ *	- LIB_ZFCP_HBAAPI_CT_RATE - maximal number of CT requests per second
+ *	and adapter
+ *		- if not set or set to 0, there is no limit (default)
+ *		- if set to a value > 0, requests are never sent faster
+ *
+ * The FCP ports registered at the name server are mirrored per adapter once
+ * they are looked up. RSCN events mark the affected pages, which are queried
+ * again on the next lookup. This is controlled by:
+ *
+ *	- LIB_ZFCP_HBAAPI_NS_MIRROR - mirroring of the name server
+ *		- if not set or set to a value other than 0, the mirror is kept
+ *		(default)
+ *		- if set to 0, the name server is queried for each lookup
+ *
  *
  * @section bibliography Bibliography
  *
@@ -120,6 +188,7 @@
 
 /** @defgroup SupportedHBAAPIs Supported HBA API Functions */
 /** @defgroup UnSupportedHBAAPIs Not Supported HBA API Functions */
+/** @defgroup ZfcpExtensions Vendor Specific Extension Functions */
 /** @defgroup InitAndFini Initialization and Finalization Functions */
 /** @defgroup Intro */
 
@@ -147,11 +216,13 @@
 #include <stdint.h>
 #include <dirent.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <linux/netlink.h>
 #include <scsi/scsi_netlink_fc.h>
 #include <dirent.h>
 
 #include <hbaapi.h>
+#include <zfcphbaapi.h>
 
 
 #ifdef HBAAPI_VENDOR_LIB	/* compile as vendor specific library */
@@ -390,6 +461,77 @@ HBA_STATUS HBA_RegisterLibraryV2(HBA_ENTRYPOINTSV2 *);
 /** @brief Environment variable specifying the file which is used for logging */
 #define VLIB_ENV_LOG_FILE	"LIB_ZFCP_HBAAPI_LOG_FILE"
 
+/** @brief Environment variable specifying the number of cached sg devices */
+#define VLIB_ENV_SG_FD_CACHE	"LIB_ZFCP_HBAAPI_SG_FD_CACHE"
+
+/** @brief Default number of sg devices kept open by the library */
+#define VLIB_SG_FD_CACHE_DEFAULT 64
+
+/** @brief Environment variable specifying how long an unused report luns
+    WLUN stays attached */
+#define VLIB_ENV_WLUN_IDLE	"LIB_ZFCP_HBAAPI_WLUN_IDLE"
+
+/** @brief Default idle time in seconds of an attached report luns WLUN */
+#define VLIB_WLUN_IDLE_DEFAULT	30
+
+/** @brief Environment variable specifying how long INQUIRY data is cached */
+#define VLIB_ENV_INQUIRY_TTL	"LIB_ZFCP_HBAAPI_INQUIRY_TTL"
+
+/** @brief Default time in seconds INQUIRY data is cached */
+#define VLIB_INQUIRY_TTL_DEFAULT 60
+
+/** @brief Environment variable enabling coalescing of CT queries */
+#define VLIB_ENV_CT_COALESCE	"LIB_ZFCP_HBAAPI_CT_COALESCE"
+
+/** @brief Environment variable specifying the maximal rate of CT requests */
+#define VLIB_ENV_CT_RATE	"LIB_ZFCP_HBAAPI_CT_RATE"
+
+/** @brief Default maximal rate of CT requests per adapter and second,
+	0 for no limit */
+#define VLIB_CT_RATE_DEFAULT	0
+
+/** @brief Environment variable enabling the name server mirror */
+#define VLIB_ENV_NS_MIRROR	"LIB_ZFCP_HBAAPI_NS_MIRROR"
+
+/** @brief Number of RSCN pages noted before a mirror is seeded again */
+#define VLIB_NS_MAX_PAGES	64
+
+/** @brief Number of CT requests sent without pacing after an idle time */
+#define VLIB_CT_BURST		8
+
+/** @brief Number of retries of a CT request rejected as busy */
+#define VLIB_CT_RETRIES		6
+
+/** @brief First backoff in milliseconds after a busy reject */
+#define VLIB_CT_BACKOFF_MIN	10
+
+/** @brief Maximal backoff in milliseconds after a busy reject */
+#define VLIB_CT_BACKOFF_MAX	1000
+
+/** @brief Number of INQUIRY responses cached by the library */
+#define VLIB_INQUIRY_CACHE_SIZE	256
+
+/** @brief Maximal length of a cached INQUIRY response */
+#define VLIB_INQUIRY_MAXLEN	1024
+
+/** @brief Number of changed units noted before all LUIDs are dropped */
+#define VLIB_MAX_CHANGED	256
+
+/** @brief Maximal number of threads reading remote port attributes */
+#define VLIB_SYSFS_THREADS	4
+
+/** @brief Minimal number of remote ports read by one thread */
+#define VLIB_SYSFS_SLICE	256
+
+/** @brief Minimal number of slots of the WWN index */
+#define VLIB_WWN_INDEX_MIN	64
+
+/** @brief Number of free pass-thru buffers kept by the library */
+#define VLIB_PT_POOL_SIZE	16
+
+/** @brief Alignment of pass-thru buffers */
+#define VLIB_PT_ALIGN		4096
+
 /** @brief Prefix used to concatednate an adapter name. */
 #define VLIB_ADAPTERNAME_PREFIX "com.ibm-FICON-FCP-"
 
@@ -437,6 +579,23 @@ struct vlib_unit {
 	unsigned int lun;		/**< @brief SCSI LUN */
 	uint64_t fcLun;			/**< @brief FCP LUN */
 	char sg_dev[16];		/**< @brief name of sg device */
+	unsigned int sg_fd_slot;	/**< @brief slot in sg fd cache + 1,
+					   0 if none */
+	unsigned int luidValid:1;	/**< @brief luid was harvested */
+	unsigned long luidEpoch;	/**< @brief Incremented whenever luid
+					   is invalidated */
+	HBA_LUID luid;			/**< @brief device identification
+					   descriptor, empty if none */
+};
+
+/** @brief Cached attributes of the adapter port or of a discovered port */
+struct vlib_port_cache {
+	HBA_PORTATTRIBUTES attrs;	/**< @brief attributes read from
+					   sysfs, without
+					   NumberofDiscoveredPorts */
+	unsigned int generation;	/**< @brief Incremented whenever the
+					   attributes are invalidated */
+	unsigned int isValid:1;		/**< @brief attrs are current */
 };
 
 /** @brief Representation of a FC port in the library */
@@ -451,6 +610,8 @@ struct vlib_port {
 	unsigned int host;		/**< @brief SCSI host */
 	unsigned int channel;		/**< @brief SCSI channel */
 	unsigned int target;		/**< @brief SCSI id */
+	struct vlib_port_cache attrCache; /**< @brief attributes returned by
+					   HBA_GetDiscoveredPortAttributes() */
 };
 
 /** @brief Identification of an adapter in the library */
@@ -470,16 +631,231 @@ struct vlib_adapter_ident {
 				form  /sys/devices/css0/0.0.0010/0.0.5923*/
 };
 
+/** @brief bsg device of an fc_host, kept open for CT and ELS requests */
+struct vlib_bsg {
+	int fd;				/**< @brief file descriptor,
+					   valid if isOpen is set */
+	unsigned int isOpen:1;		/**< @brief fd is open */
+	unsigned int isStale:1;		/**< @brief fd is closed once it is
+					   no longer used */
+	unsigned int users;		/**< @brief requests using fd */
+};
+
+/** @brief Pacing of the CT requests sent through an adapter */
+struct vlib_ct_governor {
+	double rate;			/**< @brief current rate in requests per
+					   second, 0 if not paced after a busy
+					   reject */
+	double busyRate;		/**< @brief rate at the last busy
+					   reject */
+	unsigned int sent;		/**< @brief requests sent in the
+					   current second */
+	unsigned int lastSent;		/**< @brief requests sent in the
+					   previous second */
+	struct timespec second;		/**< @brief start of the current
+					   second */
+	unsigned int isPaced:1;		/**< @brief tokens are taken */
+	double tokens;			/**< @brief token bucket, negative if
+					   requests wait for tokens */
+	struct timespec last;		/**< @brief last update of tokens */
+	ZFCP_CTSTATISTICS stats;	/**< @brief statistics */
+};
+
+/** @brief D_ID of a port resolved at the name server */
+struct vlib_did {
+	wwn_t wwpn;			/**< @brief WWPN of the port */
+	fc_id_t did;			/**< @brief D_ID returned by GID_PN */
+};
+
+/** @brief Mirror of the FCP ports registered at the name server */
+struct vlib_ns_mirror {
+	struct block ports;		/**< @brief ZFCP_NSPORTDETAILS, sorted
+					   by PortFcId */
+	struct block pages;		/**< @brief RSCN pages to query again */
+	unsigned int generation;	/**< @brief Incremented whenever the
+					   mirror is invalidated */
+	unsigned int isValid:1;		/**< @brief ports were seeded */
+};
+
+/** @brief Attributes of an adapter cached by HBA_GetAdapterAttributes() */
+struct vlib_adapter_cache {
+	HBA_ADAPTERATTRIBUTES attrs;	/**< @brief attributes read from
+					   sysfs */
+	unsigned int generation;	/**< @brief Incremented whenever the
+					   attributes are invalidated */
+	unsigned int isValid:1;		/**< @brief attrs are current */
+};
+
 /** @brief Represenation of an adapter in the library */
 struct vlib_adapter {
 	unsigned int isInvalid:1;	/**< @brief Adapter invalid or not */
+	unsigned int isUnseen:1;	/**< @brief Not found (yet) by the
+					   current adapter scan */
+	unsigned int portsStale:1;	/**< @brief uevents of remote ports
+					   might have been missed */
+	unsigned int haveSeqnum:1;	/**< @brief seqnum is valid */
+	unsigned long long seqnum;	/**< @brief uevent sequence number
+					   ports and units were reconciled
+					   at */
 	struct vlib_adapter_ident ident; /**< @brief Adapter identification */
 	HBA_HANDLE handle;		/**< @brief Handle for this adapter */
 	struct block ports;		/**< @brief List of ports */
+	struct block dids;		/**< @brief D_IDs resolved with GID_PN,
+					   dropped on RSCN and link down */
+	struct vlib_bsg bsg;		/**< @brief bsg device of the fc_host */
+	struct vlib_ct_governor ctGov;	/**< @brief pacing of CT requests */
+	struct vlib_ns_mirror nsMirror;	/**< @brief name server mirror */
+	struct vlib_adapter_cache attrCache; /**< @brief adapter attributes */
+	struct vlib_port_cache portCache; /**< @brief adapter port
+					   attributes */
 	struct vlib_event_queue event_queue;     /**< @brief Event queue */
 	struct vlib_event_queue free_event_list; /**< @brief Free slots */
 };
 
+/** @brief Open sg device in the sg fd cache */
+struct vlib_sg_fd {
+	int fd;				/**< @brief file descriptor,
+					   -1 if slot is unused */
+	unsigned int host;		/**< @brief SCSI host */
+	unsigned int channel;		/**< @brief SCSI channel */
+	unsigned int target;		/**< @brief SCSI id */
+	unsigned int lun;		/**< @brief SCSI LUN */
+	char sg_dev[16];		/**< @brief name of sg device */
+	unsigned long lastUse;		/**< @brief time stamp for LRU */
+};
+
+/** @brief Cache of open sg devices, shared by all units */
+struct vlib_sg_fd_cache {
+	struct vlib_sg_fd *slots;	/**< @brief array of cache slots,
+					   allocated on first use */
+	unsigned int size;		/**< @brief number of slots */
+	unsigned long clock;		/**< @brief LRU time stamp counter */
+};
+
+/** @brief SCSI address of changed units, -1 matches all */
+struct vlib_scsi_addr {
+	int host;			/**< @brief SCSI host */
+	int channel;			/**< @brief SCSI channel */
+	int target;			/**< @brief SCSI id */
+	int lun;			/**< @brief SCSI LUN */
+};
+
+/** @brief INQUIRY response in the INQUIRY cache */
+struct vlib_inquiry {
+	unsigned char *data;		/**< @brief response data,
+					   NULL if slot is unused */
+	HBA_UINT32 len;			/**< @brief length of data */
+	unsigned int complete:1;	/**< @brief data holds the whole
+					   response, not only a prefix */
+	unsigned int host;		/**< @brief SCSI host */
+	unsigned int channel;		/**< @brief SCSI channel */
+	unsigned int target;		/**< @brief SCSI id */
+	unsigned int lun;		/**< @brief SCSI LUN */
+	uint64_t fcLun;			/**< @brief FCP LUN */
+	HBA_UINT8 evpd;			/**< @brief EVPD bit of the command */
+	HBA_UINT8 page;			/**< @brief VPD page code */
+	time_t expires;			/**< @brief end of the time to live */
+	unsigned long lastUse;		/**< @brief time stamp for LRU */
+};
+
+/** @brief Cache of INQUIRY responses, shared by all units */
+struct vlib_inquiry_cache {
+	struct vlib_inquiry *slots;	/**< @brief array of cache slots,
+					   allocated on first use */
+	unsigned int ttl;		/**< @brief time to live in seconds,
+					   0 disables the cache */
+	int uevent_fd;			/**< @brief uevent socket used to
+					   detect changed units, -1 if none */
+	unsigned long clock;		/**< @brief LRU time stamp counter */
+	unsigned long generation;	/**< @brief incremented on each
+					   invalidation */
+	struct block changed;		/**< @brief struct vlib_scsi_addr of
+					   units invalidated since the last
+					   sgutils_updateLuids() */
+	unsigned int allChanged:1;	/**< @brief all units might have
+					   changed */
+	pthread_mutex_t mutex;		/**< @brief Protects this structure,
+					   nests inside vlib_data.mutex */
+};
+
+/** @brief Header of a pass-thru buffer, see ZFCP_AllocPassThruBuffer() */
+struct vlib_pt_buffer {
+	struct vlib_pt_buffer *next;	/**< @brief next free buffer */
+	HBA_UINT32 size;		/**< @brief usable size, the data
+					   follows at VLIB_PT_ALIGN */
+};
+
+/** @brief Free pass-thru buffers kept for reuse */
+struct vlib_pt_pool {
+	struct vlib_pt_buffer *free;	/**< @brief list of free buffers */
+	unsigned int count;		/**< @brief number of free buffers */
+};
+
+/** @brief CT query in flight, answered once for all identical queries */
+struct vlib_ct_flight {
+	struct vlib_ct_flight *next;	/**< @brief next query in flight */
+	unsigned short host;		/**< @brief SCSI host of the adapter */
+	const void *req;		/**< @brief CT request */
+	HBA_UINT32 reqSize;		/**< @brief size of the request */
+	const void *rsp;		/**< @brief response buffer of the
+					   request sent */
+	HBA_UINT32 rspSize;		/**< @brief size of the response
+					   buffer */
+	HBA_UINT32 rspLen;		/**< @brief length of the response */
+	unsigned int done:1;		/**< @brief response is available */
+	HBA_STATUS status;		/**< @brief result of the request */
+	unsigned int waiters;		/**< @brief identical queries waiting
+					   for the response */
+	pthread_cond_t cond;		/**< @brief signalled on completion and
+					   when a waiter is done, used with
+					   vlib_data.mutex */
+};
+
+/** @brief Report luns WLUN kept attached by the library */
+struct vlib_wlun {
+	char bus_dev_name[9];		/**< @brief adapter as in
+					   /sys/bus/ccw/drivers/zfcp */
+	wwn_t wwpn;			/**< @brief WWPN of the target port */
+	unsigned int host;		/**< @brief SCSI host */
+	unsigned int channel;		/**< @brief SCSI channel */
+	unsigned int target;		/**< @brief SCSI id */
+	time_t lastUse;			/**< @brief time of last REPORT LUNS */
+};
+
+/** @brief Report luns WLUNs kept attached for further REPORT LUNS */
+struct vlib_wlun_pool {
+	struct block wluns;		/**< @brief List of attached WLUNs */
+	unsigned int idle;		/**< @brief idle time in seconds,
+					   0 to detach immediately */
+	unsigned int running:1;		/**< @brief reaper thread running */
+	unsigned int stop:1;		/**< @brief reaper thread to stop */
+	pthread_t reaper;		/**< @brief thread detaching WLUNs
+					   after their idle time */
+	pthread_cond_t cond;		/**< @brief wakes up the reaper,
+					   used with vlib_data.mutex */
+};
+
+/** @brief Slot of the WWN index */
+struct vlib_wwn_slot {
+	wwn_t wwn;			/**< @brief WWPN or WWNN, 0 if the slot
+					   is free */
+	uint32_t adapter;		/**< @brief index of the adapter */
+	int32_t port;			/**< @brief index of the remote port,
+					   -1 for the adapter itself */
+	unsigned int isNode:1;		/**< @brief wwn is a WWNN */
+};
+
+/** @brief Hash index of the WWNs of all adapters and remote ports */
+struct vlib_wwn_index {
+	struct vlib_wwn_slot *slots;	/**< @brief open addressed hash
+					   table */
+	size_t size;			/**< @brief number of slots, a power
+					   of 2 */
+	unsigned long generation;	/**< @brief repository generation the
+					   index was built for */
+	unsigned int isValid:1;		/**< @brief index was built */
+};
+
 /** @brief Primary data structure used in the library. */
 struct vlib_data {
 	unsigned int isLoaded:1;	/**< @brief Library loaded or not */
@@ -494,8 +870,32 @@ struct vlib_data {
 	struct block adapters;		/**< @brief List of adapters
 					   In fact this is the anchor of
 					   the library's repository. */
+	unsigned long generation;	/**< @brief Incremented on each change
+					   of the repository */
 	pthread_t id;			/**< @brief Pthread ID of event
 					   handling thread*/
+	struct vlib_sg_fd_cache sg_fd_cache; /**< @brief Open sg devices */
+	struct vlib_wlun_pool wlun_pool; /**< @brief Attached WLUNs */
+	struct vlib_inquiry_cache inquiry_cache; /**< @brief INQUIRY data */
+	struct vlib_pt_pool pt_pool;	/**< @brief Pass-thru buffers */
+	struct vlib_wwn_index wwn_index; /**< @brief WWNs of adapters and
+					   ports */
+	int seqnumFd;			/**< @brief UEVENT_SEQNUM_PATH, -1 if
+					   not open */
+	unsigned long long seqnum;	/**< @brief uevent sequence number
+					   the adapters were read at */
+	unsigned int haveSeqnum:1;	/**< @brief seqnum is valid */
+	int adapterUeventFd;		/**< @brief uevent socket used to
+					   detect changed adapters, -1 if
+					   none */
+	unsigned int ctCoalesce:1;	/**< @brief Coalesce CT queries */
+	unsigned int ctRate;		/**< @brief Maximal rate of CT requests
+					   per adapter, 0 for no limit */
+	struct vlib_ct_flight *ct_flights; /**< @brief CT queries in flight */
+	unsigned int nsMirror:1;	/**< @brief Keep name server mirrors */
+	pthread_mutex_t ns_mutex;	/**< @brief Serializes updates of the
+					   name server mirrors, taken before
+					   vlib_data.mutex */
 	pthread_mutex_t mutex;		/**< @brief Protects this structure */
 };
 
@@ -615,5 +1015,8 @@ do { \
 #include "vlib_sg_io.h"
 #include "vlib_events.h"
 #include "vlib_sfhelper.h"
+#include "vlib_inventory.h"
+#include "vlib_passthru.h"
+#include "vlib_ns.h"
 
 #endif /* _VLIB_H_ */
@@ -26,7 +26,6 @@
 /* static function declarations */
 static int block_assertSize
 	(struct block *, const size_t, const size_t, const size_t);
-static void *block_addItem(struct block *, size_t, size_t);
 
 
 /**
@@ -79,7 +78,7 @@ static int block_assertSize(struct block *block, const size_t size,
  *
  * If the new item does not fit in the array, the array is enlarged.
  */
-static void *block_addItem(struct block *block, size_t size, size_t grow)
+void *block_addItem(struct block *block, size_t size, size_t grow)
 {
 	int ret;
 	void *item;
@@ -235,6 +234,200 @@ getPortByIndex(const struct vlib_adapter *adapter, const uint32_t index)
 	return &((struct vlib_port *)adapter->ports.data)[index];
 }
 
+/**
+ * @brief Hash a WWN into the WWN index.
+ * @param wwn the WWN
+ * @param size number of slots of the index, a power of 2
+ * @return slot to start probing at
+ *
+ * WWNs of one vendor differ mostly in their low bytes, so all bits are mixed
+ * by a multiplicative hash.
+ */
+static size_t wwnHash(wwn_t wwn, size_t size)
+{
+	return (size_t) ((wwn * 0x9e3779b97f4a7c15ULL) >> 32) & (size - 1);
+}
+
+/**
+ * @brief Add a WWN to the WWN index.
+ * @param *index the index, with more slots than WWNs
+ * @param wwn the WWN, ignored if 0
+ * @param adapter index of the adapter
+ * @param port index of the remote port, -1 for the adapter itself
+ * @param isNode wwn is a WWNN
+ *
+ * WWNs equal to an earlier one are put behind it on the probe sequence, so
+ * lookups find them in the order they were added.
+ */
+static void wwnIndexAdd(struct vlib_wwn_index *index, wwn_t wwn,
+			uint32_t adapter, int32_t port, int isNode)
+{
+	struct vlib_wwn_slot *slot;
+	size_t i;
+
+	if (!wwn)
+		return;
+
+	i = wwnHash(wwn, index->size);
+	while (index->slots[i].wwn)
+		i = (i + 1) & (index->size - 1);
+
+	slot = &index->slots[i];
+	slot->wwn = wwn;
+	slot->adapter = adapter;
+	slot->port = port;
+	slot->isNode = isNode;
+}
+
+/**
+ * @brief Build the WWN index if the repository changed.
+ * @return
+ *	- -1 if out of memory
+ *	- 0 on success
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The index holds the WWPN and WWNN of all adapters and of all remote ports
+ * read so far, invalid ones included. It is rebuilt on the first lookup
+ * after repositoryChanged(), and is at most half full.
+ */
+static int revalidateWwnIndex(void)
+{
+	struct vlib_wwn_index *index = &vlib_data.wwn_index;
+	struct vlib_wwn_slot *slots;
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	size_t count, size;
+	unsigned int i, j;
+
+	if (index->isValid && index->generation == vlib_data.generation)
+		return 0;
+
+	count = vlib_data.adapters.used;
+	adapter = getAdapterByIndex(0);
+	for (i = 0; i < vlib_data.adapters.used; ++i, ++adapter)
+		count += adapter->ports.used;
+
+	for (size = VLIB_WWN_INDEX_MIN; size < 4 * count; size <<= 1)
+		;
+	if (size != index->size) {
+		slots = calloc(size, sizeof(*slots));
+		if (!slots) {
+			VLIB_PERROR(ENOMEM, "ERROR");
+			return -1;
+		}
+		free(index->slots);
+		index->slots = slots;
+		index->size = size;
+	} else {
+		memset(index->slots, 0, size * sizeof(*index->slots));
+	}
+
+	adapter = getAdapterByIndex(0);
+	for (i = 0; i < vlib_data.adapters.used; ++i, ++adapter) {
+		wwnIndexAdd(index, adapter->ident.wwpn, i, -1, 0);
+		wwnIndexAdd(index, adapter->ident.wwnn, i, -1, 1);
+		port = getPortByIndex(adapter, 0);
+		for (j = 0; j < adapter->ports.used; ++j, ++port) {
+			wwnIndexAdd(index, port->wwpn, i, j, 0);
+			wwnIndexAdd(index, port->wwnn, i, j, 1);
+		}
+	}
+
+	index->generation = vlib_data.generation;
+	index->isValid = 1;
+
+	return 0;
+}
+
+/**
+ * @brief Look up a WWN in the WWN index.
+ * @param wwn the WWN
+ * @param *slot the previous match, NULL for the first one
+ * @return
+ *	- NULL if there are no more matches
+ *	- the next slot with that WWN
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The index must have been built with revalidateWwnIndex().
+ */
+static struct vlib_wwn_slot *wwnIndexNext(wwn_t wwn,
+					  struct vlib_wwn_slot *slot)
+{
+	struct vlib_wwn_index *index = &vlib_data.wwn_index;
+	size_t i;
+
+	if (slot)
+		i = (slot - index->slots + 1) & (index->size - 1);
+	else
+		i = wwnHash(wwn, index->size);
+
+	for (; index->slots[i].wwn; i = (i + 1) & (index->size - 1)) {
+		if (index->slots[i].wwn == wwn)
+			return &index->slots[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Free the WWN index.
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+void freeWwnIndex(void)
+{
+	struct vlib_wwn_index *index = &vlib_data.wwn_index;
+
+	free(index->slots);
+	memset(index, 0, sizeof(*index));
+}
+
+/**
+ * @brief Get a valid adapter by its WWPN or WWNN.
+ * @param wwn WWPN or WWNN of the adapter
+ * @param *status pointer to return error status code
+ * @return
+ *	- -1 on error (*status contains error status code)
+ *	- index of the adapter on success
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * Possible error status codes are:
+ *	- HBA_STATUS_ERROR_ILLEGAL_WWN if no adapter has that WWN
+ *	- HBA_STATUS_ERROR_AMBIGUOUS_WWN if more than one adapter has it
+ *	- HBA_STATUS_ERROR if out of memory
+ */
+int getAdapterIndexByWWN(wwn_t wwn, HBA_STATUS *status)
+{
+	struct vlib_wwn_slot *slot = NULL;
+	struct vlib_adapter *adapter;
+	int found = -1;
+
+	if (revalidateWwnIndex() < 0) {
+		*status = HBA_STATUS_ERROR;
+		return -1;
+	}
+
+	while (slot = wwnIndexNext(wwn, slot)) {
+		if (slot->port >= 0 || (int) slot->adapter == found)
+			continue;
+		adapter = getAdapterByIndex(slot->adapter);
+		if (adapter->isInvalid)
+			continue;
+		if (found >= 0) {
+			*status = HBA_STATUS_ERROR_AMBIGUOUS_WWN;
+			return -1;
+		}
+		found = slot->adapter;
+	}
+
+	*status = found < 0 ? HBA_STATUS_ERROR_ILLEGAL_WWN : HBA_STATUS_OK;
+
+	return found;
+}
+
 /**
  * @brief Get a port by its WWPN.
  * @param *adapter to which the port belongs
@@ -244,12 +437,27 @@ getPortByIndex(const struct vlib_adapter *adapter, const uint32_t index)
  * 	- pointer to found port on success
  * @par Locks:
  * 	vlib_data.mutex must be held
+ *
+ * The port is looked up in the WWN index. Only if the index cannot be built,
+ * the ports of the adapter are searched.
  */
 struct vlib_port*
 getPortByWWPN(const struct vlib_adapter *adapter, const wwn_t wwpn)
 {
 	unsigned int i;
 	struct vlib_port *port;
+	struct vlib_wwn_slot *slot = NULL;
+	uint32_t a;
+
+	if (wwpn && revalidateWwnIndex() == 0) {
+		a = adapter - getAdapterByIndex(0);
+		while (slot = wwnIndexNext(wwpn, slot)) {
+			if (slot->adapter == a && slot->port >= 0 &&
+			    !slot->isNode)
+				return getPortByIndex(adapter, slot->port);
+		}
+		return NULL;
+	}
 
 	port = getPortByIndex(adapter, 0);
 	if (NULL == port)
@@ -263,6 +471,86 @@ getPortByWWPN(const struct vlib_adapter *adapter, const wwn_t wwpn)
 	return NULL;
 }
 
+/**
+ * @brief Resolve the D_ID of a port.
+ * @param *adapter through which the port is reached
+ * @param wwpn of the port
+ * @return
+ * 	- 0 if the port is unknown
+ * 	- D_ID of the port on success
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ *
+ * The D_ID of remote ports in the repository is read from sysfs. Other ports
+ * are looked up at the name server with GID_PN once; the result is kept
+ * until the next RSCN or link down event of the adapter (see flushDids()).
+ */
+fc_id_t resolveDid(struct vlib_adapter *adapter, wwn_t wwpn)
+{
+	unsigned int i;
+	struct vlib_port *port;
+	struct vlib_did *did;
+	fc_id_t d_id;
+
+	port = getPortByWWPN(adapter, wwpn);
+	if (port && !port->isInvalid) {
+		d_id = sysfs_getPortDid(port);
+		if (d_id)
+			return d_id;
+	}
+
+	did = adapter->dids.data;
+	for (i = 0; i < adapter->dids.used; ++i, ++did) {
+		if (did->wwpn == wwpn)
+			return did->did;
+	}
+
+	d_id = sg_io_getDidFromWWN(adapter, wwpn);
+	if (d_id == 0)
+		return 0;
+
+	did = block_addItem(&adapter->dids, sizeof(*did), VLIB_GROW_DIDS);
+	if (did) {
+		did->wwpn = wwpn;
+		did->did = d_id;
+	}
+
+	return d_id;
+}
+
+/**
+ * @brief Drop all D_IDs resolved with GID_PN for an adapter.
+ * @param *adapter whose D_IDs might have changed
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ */
+void flushDids(struct vlib_adapter *adapter)
+{
+	block_free(&adapter->dids);
+}
+
+/**
+ * @brief Drop the cached attributes of the discovered ports in a range of
+ *	D_IDs.
+ * @param *adapter through which the ports are reached
+ * @param d_id D_ID of the range
+ * @param mask of the D_ID bits that define the range, 0 for all ports
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ */
+void invalidatePortAttributesByDid(struct vlib_adapter *adapter, fc_id_t d_id,
+				   fc_id_t mask)
+{
+	unsigned int i;
+	struct vlib_port *port;
+
+	port = getPortByIndex(adapter, 0);
+	for (i = 0; port && i < adapter->ports.used; ++i, ++port) {
+		if ((port->did & mask) == (d_id & mask))
+			invalidatePortAttributes(port);
+	}
+}
+
 /**
  * @brief Get an unit by its index.
  * @param *port to which the unit belongs
@@ -346,7 +634,10 @@ static struct vlib_unit *getUnitFromRepos(struct vlib_port *port,
  *	vlib_data.mutex must be held
  *
  * If the unit specified in the event is already stored in the repository
- * it is marked as valid.
+ * it is marked as valid. A unit that reappears takes the SCSI address and sg
+ * device of the event, its device identification is harvested again. The
+ * report luns WLUN is not reported as a LUN, so it does not change the
+ * repository.
  */
 int addUnitToRepos(struct vlib_port *port,
 			    struct vlib_unit *unit)
@@ -355,6 +646,17 @@ int addUnitToRepos(struct vlib_port *port,
 
 	unitLoc = getUnitFromRepos(port, unit);
 	if (NULL != unitLoc) {
+		if (unitLoc->isInvalid) {
+			unitLoc->host = unit->host;
+			unitLoc->channel = unit->channel;
+			unitLoc->target = unit->target;
+			unitLoc->lun = unit->lun;
+			strcpy(unitLoc->sg_dev, unit->sg_dev);
+			unitLoc->luidValid = 0;
+			unitLoc->luidEpoch++;
+			if (unit->fcLun != REPORTLUNS_WLUN)
+				repositoryChanged();
+		}
 		unitLoc->isInvalid = 0;
 		return 0;
 	}
@@ -362,6 +664,8 @@ int addUnitToRepos(struct vlib_port *port,
 	unitLoc = block_addItem(&port->units, sizeof(*unit), VLIB_GROW_UNITS);
 	if (NULL == unitLoc)
 		return -1;
+	if (unit->fcLun != REPORTLUNS_WLUN)
+		repositoryChanged();
 
 	memcpy(unitLoc, unit, sizeof(struct vlib_unit));
 
@@ -378,7 +682,7 @@ int addUnitToRepos(struct vlib_port *port,
  * @par Locks:
  *	vlib_data.mutex must be held
  */
-static struct vlib_port *getPortFromRepos(struct vlib_adapter *adapter,
+struct vlib_port *getPortFromRepos(struct vlib_adapter *adapter,
 							char *sysfs_name)
 {
 	unsigned int i;
@@ -404,7 +708,8 @@ static struct vlib_port *getPortFromRepos(struct vlib_adapter *adapter,
  *	vlib_data.mutex must be held
  *
  * If the port specified in the event is already stored in the repository
- * it is marked as valid.
+ * it is marked as valid. A port that reappears takes the names and the D_ID
+ * of the event.
  */
 int addPortToRepos(struct vlib_adapter *adapter,
 			    struct vlib_port *port)
@@ -413,7 +718,14 @@ int addPortToRepos(struct vlib_adapter *adapter,
 
 	portLoc = getPortFromRepos(adapter, port->name);
 	if (NULL != portLoc) {
-		port->isInvalid = 0;
+		if (portLoc->isInvalid) {
+			portLoc->wwpn = port->wwpn;
+			portLoc->wwnn = port->wwnn;
+			portLoc->did = port->did;
+			invalidatePortAttributes(portLoc);
+			repositoryChanged();
+		}
+		portLoc->isInvalid = 0;
 		return 0;
 	}
 
@@ -421,6 +733,7 @@ int addPortToRepos(struct vlib_adapter *adapter,
 							VLIB_GROW_PORTS);
 	if (NULL == portLoc)
 		return -1;
+	repositoryChanged();
 
 	portLoc->wwpn = port->wwpn;
 	portLoc->wwnn = port->wwnn;
@@ -467,7 +780,8 @@ static struct vlib_adapter *getAdapterFromRepos(char *bus_dev_name)
  *	vlib_data.mutex must be held
  *
  * If the adapter specified in the event is already stored in the repository
- * it is marked as valid.
+ * it is marked as valid and seen. The repository only changes if the adapter
+ * is new or was invalid.
  */
 int addAdapterToRepos(struct vlib_adapter *adapter)
 {
@@ -475,7 +789,10 @@ int addAdapterToRepos(struct vlib_adapter *adapter)
 
 	adapterLoc = getAdapterFromRepos(adapter->ident.bus_dev_name);
 	if (NULL != adapterLoc) {
+		if (adapterLoc->isInvalid)
+			repositoryChanged();
 		adapterLoc->isInvalid = 0;
+		adapterLoc->isUnseen = 0;
 		return 0;
 	}
 
@@ -483,6 +800,7 @@ int addAdapterToRepos(struct vlib_adapter *adapter)
 				VLIB_GROW_ADAPTERS);
 	if (NULL == adapterLoc)
 		return -1;
+	repositoryChanged();
 
 	adapterLoc->ident.devid = adapter->ident.devid;
 	adapterLoc->ident.wwpn = adapter->ident.wwpn;
@@ -508,29 +826,94 @@ int addAdapterToRepos(struct vlib_adapter *adapter)
  * 	vlib_data.mutex must be held
  * @note Additionally this function triggers creation of unit configuration for
  *	this adapter (see getUnitsFromPort()).
+ *
+ * If the uevent sequence number did not change since the last update, no
+ * device has come or gone and sysfs is not read at all.
  */
 int updateAdapter(struct vlib_adapter *adapter)
 {
 	unsigned int i;
-	int ret;
+	int ret, haveSeqnum;
 	struct vlib_port *port;
+	unsigned long long seqnum;
 
 	if (adapter->isInvalid)
 		return 0;
 
+	haveSeqnum = sysfs_readSeqnum(&seqnum) == 0;
+	if (haveSeqnum && adapter->haveSeqnum && adapter->seqnum == seqnum)
+		return 0;
+
 	ret = sysfs_createAndReadConfigPorts(adapter);
 	if (0 == ret) {
 		port = getPortByIndex(adapter, 0);
 		for (i = 0; i < adapter->ports.used; ++i, ++port) {
+			if (port->isInvalid)
+				continue;
 			ret = sysfs_getUnitsFromPort(port);
 			if (ret < 0)
 				break;
 		}
 	}
 
+	if (0 == ret) {
+		adapter->haveSeqnum = haveSeqnum;
+		adapter->seqnum = seqnum;
+	}
+
 	return ret;
 }
 
+/**
+ * @brief Drop invalid ports and units of an adapter from the repository.
+ * @param *adapter to be compacted
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ *
+ * The indices of the remaining ports and units change, so this is only done
+ * when the application asks for it with HBA_RefreshInformation().
+ */
+void compactAdapter(struct vlib_adapter *adapter)
+{
+	unsigned int i, j, used = 0, units;
+	struct vlib_port *port, *ports;
+	struct vlib_unit *unit;
+	int changed = 0;
+
+	ports = getPortByIndex(adapter, 0);
+	for (i = 0, port = ports; i < adapter->ports.used; ++i, ++port) {
+		if (port->isInvalid) {
+			block_free(&port->units);
+			changed = 1;
+			continue;
+		}
+
+		unit = getUnitByIndex(port, 0);
+		for (j = 0, units = 0; j < port->units.used; ++j) {
+			if (unit[j].isInvalid) {
+				/* a trailing WLUN was never reported */
+				if (unit[j].fcLun != REPORTLUNS_WLUN)
+					changed = 1;
+				continue;
+			}
+			if (units != j) {
+				unit[units] = unit[j];
+				changed = 1;
+			}
+			units++;
+		}
+		port->units.used = units;
+
+		if (used != i)
+			ports[used] = *port;
+		used++;
+	}
+	adapter->ports.used = used;
+
+	if (changed)
+		repositoryChanged();
+}
+
 /**
  * @brief Revalidate adapters in the repository.
  * @return
@@ -542,6 +925,7 @@ int updateAdapter(struct vlib_adapter *adapter)
  * Port and unit configuration data is only updated if it was already generated
  * before. Generation of port and unit configuration information is triggered in
  * HBA_GetAdapterPortAttributes() and HBA_GetFcpTargetMapping(), resp.
+ * Invalid adapters were closed when they went away and are skipped.
  */
 int revalidateAdapters(void)
 {
@@ -551,14 +935,10 @@ int revalidateAdapters(void)
 
 	adapter = getAdapterByIndex(0);
 	for (i = 0; i < vlib_data.adapters.used; ++i, ++adapter) {
-		if (adapter->isInvalid) {
-			doCloseAdapter(adapter);
-		} else {
-			if (adapter->ports.allocated) {
-				ret = updateAdapter(adapter);
-				if (ret)
-					return ret;
-			}
+		if (!adapter->isInvalid && adapter->ports.allocated) {
+			ret = updateAdapter(adapter);
+			if (ret)
+				return ret;
 		}
 	}
 
@@ -647,6 +1027,12 @@ void doCloseAdapter(struct vlib_adapter *adapter)
 	struct vlib_port *port;
 
 	adapter->handle = VLIB_INVALID_HANDLE;
+	invalidateAdapterAttributes(adapter);
+	invalidateAdapterPortAttributes(adapter);
+	invalidatePortAttributesByDid(adapter, 0, 0);
+	sgutils_invalidateUnits(adapter->ident.host, -1, -1, -1);
+	sg_io_closeBsg(adapter);
+	repositoryChanged();
 
 	port = getPortByIndex(adapter, 0);
 	if (NULL != port) {
@@ -655,6 +1041,9 @@ void doCloseAdapter(struct vlib_adapter *adapter)
 
 		block_free(&adapter->ports);
 	}
+	adapter->haveSeqnum = 0;
+	flushDids(adapter);
+	ns_freeMirror(adapter);
 
 	free_event_queue(adapter);
 }
@@ -664,7 +1053,8 @@ void doCloseAdapter(struct vlib_adapter *adapter)
  * @par Locks:
  *	vlib_data.mutex must be held
  *
- * This function frees all allocated memory for the adapters.
+ * This function frees all allocated memory for the adapters and closes the
+ * uevent socket of the adapter attribute caches and UEVENT_SEQNUM_PATH.
  */
 void closeAllAdapters(void)
 {
@@ -676,6 +1066,16 @@ void closeAllAdapters(void)
 		doCloseAdapter(a);
 
 	block_free(&vlib_data.adapters);
+	freeWwnIndex();
+
+	if (vlib_data.adapterUeventFd >= 0)
+		close(vlib_data.adapterUeventFd);
+	vlib_data.adapterUeventFd = -1;
+
+	if (vlib_data.seqnumFd >= 0)
+		close(vlib_data.seqnumFd);
+	vlib_data.seqnumFd = -1;
+	vlib_data.haveSeqnum = 0;
 }
 
 /**
@@ -893,15 +1293,15 @@ HBA_COS vlibCharToIntCOS(char *s)
 }
 
 /**
- * @brief Get the first sg device from an adapter
+ * @brief Get the first unit with an sg device from a port
  * @param port* Pointer to a port
- * @note This function looks for the first lun belonging to the first port
- * 	of the adapter and returns its sg device
+ * @note This function looks for the first lun belonging to the port
+ * 	which has an sg device and returns it
  */
-char *getSgDevFromPort(struct vlib_port *port)
+struct vlib_unit *getSgUnitFromPort(struct vlib_port *port)
 {
 	struct vlib_unit *unit;
-
+	unsigned int i;
 
 	if (revalidateUnits(port) < 0)
 		return NULL;
@@ -910,67 +1310,301 @@ char *getSgDevFromPort(struct vlib_port *port)
 	if (unit == NULL)
 		return NULL;
 
-	return unit->sg_dev;
+	for (i = 0; i < port->units.used; i++, unit++)
+		if (!unit->isInvalid && unit->sg_dev[0] != '\0')
+			return unit;
+
+	return NULL;
+}
+
+/**
+ * @brief Write the WLUN to a zfcp port attribute.
+ * @param *bus_dev_name adapter as in /sys/bus/ccw/drivers/zfcp
+ * @param wwpn WWPN of the target port
+ * @param *attr either "unit_add" or "unit_remove"
+ * @return
+ *	- -1 on error
+ *	- 0 on success
+ */
+static int writeWLUN(const char *bus_dev_name, wwn_t wwpn, char *attr)
+{
+	char path[PATH_MAX], lun[32];
+
+	snprintf(path, PATH_MAX, "%s/%s/0x%016lx", ZFCP_SYSFS_PATH,
+		 bus_dev_name, wwpn);
+	snprintf(lun, sizeof(lun), "0x%016lx", REPORTLUNS_WLUN);
+
+	return sfhelper_setProperty(path, attr, lun);
+}
+
+/**
+ * @brief Remove the WLUN from the SCSI midlayer and from zfcp.
+ * @param *bus_dev_name adapter as in /sys/bus/ccw/drivers/zfcp
+ * @param wwpn WWPN of the target port
+ * @param host SCSI host of the target port
+ * @param channel SCSI channel of the target port
+ * @param target SCSI id of the target port
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ */
+static void removeWLUN(const char *bus_dev_name, wwn_t wwpn,
+		       unsigned int host, unsigned int channel,
+		       unsigned int target)
+{
+	char path[PATH_MAX];
+
+	sgutils_invalidateUnits(host, channel, target, REPORTLUNS_WLUN_DEC);
+
+	snprintf(path, PATH_MAX, "/sys/bus/scsi/devices/%u:%u:%u:%d",
+		 host, channel, target, REPORTLUNS_WLUN_DEC);
+	sfhelper_setProperty(path, "delete", "1");
+
+	writeWLUN(bus_dev_name, wwpn, "unit_remove");
+}
+
+/**
+ * @brief Invalidate the report luns WLUN unit of a port.
+ * @param *port the port
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ *
+ * The other units keep their index and sg descriptors. The WLUN is not
+ * reported as a LUN, so the repository does not change.
+ */
+static void invalidateWLUNUnit(struct vlib_port *port)
+{
+	struct vlib_unit *unit;
+
+	unit = getUnitByFcLun(port, REPORTLUNS_WLUN);
+	if (unit)
+		unit->isInvalid = 1;
+}
+
+/**
+ * @brief Try to attach the report luns wlun of a port.
+ * @param *bus_dev_name adapter as in /sys/bus/ccw/drivers/zfcp
+ * @param wwpn WWPN of the target port
+ * @param host SCSI host of the target port
+ * @param channel SCSI channel of the target port
+ * @param target SCSI id of the target port
+ * @par Locks:
+ *	vlib_data.mutex should not be held, this waits up to SG_DEV_TIMEOUT
+ * @note This function writes the wlun to unit_add of the port and waits
+ *	until the kernel created its sg device. getAttachedWLUN() adds it to
+ *	the repository afterwards.
+ */
+void attachWLUN(const char *bus_dev_name, wwn_t wwpn, unsigned int host,
+		unsigned int channel, unsigned int target)
+{
+	int uevent_fd;
+
+	/* listen before attaching, so the uevent cannot be missed */
+	uevent_fd = sysfs_openUevents();
+
+	writeWLUN(bus_dev_name, wwpn, "unit_add");
+
+	sysfs_waitForSgDev(uevent_fd, host, channel, target,
+			   REPORTLUNS_WLUN_DEC, SG_DEV_TIMEOUT);
+	if (uevent_fd >= 0)
+		close(uevent_fd);
 }
 
-#define INTERVAL	10000000
-#define RETRIES		100
+/**
+ * @brief Get the unit of the report luns wlun attached with attachWLUN().
+ * @param port* Pointer to a port
+ * @return
+ *	- NULL if the port has no unit with an sg device
+ *	- a unit of the port with an sg device
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ *
+ * Only the WLUN is added to the units of the port.
+ */
+struct vlib_unit *getAttachedWLUN(struct vlib_port *port)
+{
+	if (sysfs_getUnitsFromPort(port) < 0)
+		return NULL;
+
+	return getSgUnitFromPort(port);
+}
 
 /**
- * @brief Try to attach the report luns wlun and return its name as in "/dev"
+ * @brief Try to detach the report luns wlun
  * @param adapter* Pointer to an adapter
  * @param port* Pointer to a port
- * @note This function issues a system call to attach lun0
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ */
+void detachWLUN(struct vlib_adapter *adapter, struct vlib_port *port)
+{
+	removeWLUN(adapter->ident.bus_dev_name, port->wwpn, port->host,
+		   port->channel, port->target);
+	invalidateWLUNUnit(port);
+}
+
+/**
+ * @brief Find a WLUN in the keep-alive pool.
+ * @param *bus_dev_name adapter as in /sys/bus/ccw/drivers/zfcp
+ * @param wwpn WWPN of the target port
+ * @return
+ *	- NULL if the WLUN is not in the pool
+ *	- pointer to the pool entry
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ */
+static struct vlib_wlun *getPooledWLUN(const char *bus_dev_name, wwn_t wwpn)
+{
+	struct vlib_wlun *wlun = vlib_data.wlun_pool.wluns.data;
+	unsigned int i;
+
+	for (i = 0; i < vlib_data.wlun_pool.wluns.used; i++, wlun++)
+		if (wlun->wwpn == wwpn &&
+		    strcmp(wlun->bus_dev_name, bus_dev_name) == 0)
+			return wlun;
+
+	return NULL;
+}
+
+/**
+ * @brief Detach a WLUN of the keep-alive pool and remove it from the pool.
+ * @param *wlun the pool entry
+ * @par Locks:
+ * 	vlib_data.mutex must be held
  */
-char *getAttachedWLUN(struct vlib_adapter *adapter, struct vlib_port *port)
+static void releasePooledWLUN(struct vlib_wlun *wlun)
 {
-	char s[128];
-	int status;
-	struct timespec t;
-	char *sg_dev = NULL;
-	int count = 0;
+	struct block *wluns = &vlib_data.wlun_pool.wluns;
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
 
-	sprintf(s, "echo 0x%lx > /sys/bus/ccw/drivers/zfcp/%s/0x%lx/unit_add",
-		REPORTLUNS_WLUN, adapter->ident.bus_dev_name, port->wwpn);
-	system(s);
+	removeWLUN(wlun->bus_dev_name, wlun->wwpn, wlun->host, wlun->channel,
+		   wlun->target);
 
-	t.tv_nsec = INTERVAL;
-	t.tv_sec = 0;
+	adapter = getAdapterByHostNo(wlun->host);
+	port = adapter ? getPortByWWPN(adapter, wlun->wwpn) : NULL;
+	if (port)
+		invalidateWLUNUnit(port);
 
-	sg_dev = getSgDevFromPort(port);
-	while (!sg_dev && count < RETRIES) {
-		nanosleep(&t, NULL);
-		sg_dev = getSgDevFromPort(port);
-		count++;
+	*wlun = ((struct vlib_wlun *)wluns->data)[wluns->used - 1];
+	wluns->used--;
+}
+
+/**
+ * @brief Main function of the thread detaching idle WLUNs.
+ * @par Locks:
+ * 	lock/unlock of vlib_data.mutex
+ */
+static void *wlunReaper(void *arg)
+{
+	struct vlib_wlun_pool *pool = &vlib_data.wlun_pool;
+	struct vlib_wlun *wlun;
+	struct timespec deadline;
+	time_t now, next;
+	unsigned int i;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	while (!pool->stop) {
+		now = time(NULL);
+		next = 0;
+		wlun = pool->wluns.data;
+		for (i = 0; i < pool->wluns.used; ) {
+			if (wlun[i].lastUse + pool->idle <= now) {
+				releasePooledWLUN(&wlun[i]);
+				continue;
+			}
+			if (!next || wlun[i].lastUse + pool->idle < next)
+				next = wlun[i].lastUse + pool->idle;
+			i++;
+		}
+
+		if (!next) {
+			pthread_cond_wait(&pool->cond, &vlib_data.mutex);
+			continue;
+		}
+		deadline.tv_sec = next;
+		deadline.tv_nsec = 0;
+		pthread_cond_timedwait(&pool->cond, &vlib_data.mutex, &deadline);
 	}
-	return sg_dev;
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return NULL;
 }
 
 /**
- * @brief Try to detach lun 0
+ * @brief Keep the report luns wlun of a port attached for further use.
  * @param adapter* Pointer to an adapter
  * @param port* Pointer to a port
- * @note This function issues a system call to detach lun0
+ * @param attached set if the library just attached the wlun
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ *
+ * The wlun is detached by the reaper thread after it was not used for
+ * vlib_data.wlun_pool.idle seconds. Wluns not attached by the library are
+ * left alone.
  */
-void detachWLUN(struct vlib_adapter *adapter, struct vlib_port *port)
+void keepWLUN(struct vlib_adapter *adapter, struct vlib_port *port,
+	      int attached)
 {
-	char s[128];
+	struct vlib_wlun_pool *pool = &vlib_data.wlun_pool;
+	struct vlib_wlun *wlun;
 
-	struct vlib_unit *unit;
+	wlun = getPooledWLUN(adapter->ident.bus_dev_name, port->wwpn);
+	if (wlun) {
+		wlun->lastUse = time(NULL);
+		return;
+	}
+	if (!attached)
+		return;
 
-	revalidateUnits(port);
-	unit = getUnitByIndex(port, 0);
+	if (pool->idle == 0 || pool->stop) {
+		detachWLUN(adapter, port);
+		return;
+	}
 
-	if (unit) {
-		sprintf(s, "echo 1 > /sys/bus/scsi/devices/%d:%d:%d:%d/delete",
-				unit->host, unit->channel, unit->target,
-				REPORTLUNS_WLUN_DEC);
-		system(s);
+	if (!pool->running) {
+		if (pthread_create(&pool->reaper, NULL, wlunReaper, NULL)) {
+			detachWLUN(adapter, port);
+			return;
+		}
+		pool->running = 1;
+	}
+
+	wlun = block_addItem(&pool->wluns, sizeof(struct vlib_wlun), 8);
+	if (!wlun) {
+		detachWLUN(adapter, port);
+		return;
+	}
+	strcpy(wlun->bus_dev_name, adapter->ident.bus_dev_name);
+	wlun->wwpn = port->wwpn;
+	wlun->host = port->host;
+	wlun->channel = port->channel;
+	wlun->target = port->target;
+	wlun->lastUse = time(NULL);
+
+	pthread_cond_signal(&pool->cond);
+}
+
+/**
+ * @brief Stop the reaper thread and detach all wluns of the pool.
+ * @par Locks:
+ * 	vlib_data.mutex must be held, it is dropped while waiting for the
+ * 	reaper thread to terminate
+ */
+void releaseAllWLUNs(void)
+{
+	struct vlib_wlun_pool *pool = &vlib_data.wlun_pool;
+
+	if (pool->running) {
+		pool->stop = 1;
+		pthread_cond_signal(&pool->cond);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		pthread_join(pool->reaper, NULL);
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		pool->running = 0;
+		pool->stop = 0;
 	}
 
-	sprintf(s,
-		"echo 0x%lx > /sys/bus/ccw/drivers/zfcp/%s/0x%lx/unit_remove",
-		REPORTLUNS_WLUN, adapter->ident.bus_dev_name, port->wwpn);
-	system(s);
-	revalidateUnits(port);
+	while (pool->wluns.used)
+		releasePooledWLUN(pool->wluns.data);
+	block_free(&pool->wluns);
 }
@@ -27,27 +27,43 @@
 #define VLIB_GROW_UNITS 8
 #define VLIB_GROW_PORTS 4
 #define VLIB_GROW_ADAPTERS 2
+#define VLIB_GROW_DIDS 8
+#define VLIB_GROW_NSPORTS 256
+#define VLIB_GROW_NSPAGES 8
 
 #ifdef min
 # undef min
 #endif
 #define min(a, b) (((a) < (b)) ? (a) : (b))
+#ifdef max
+# undef max
+#endif
+#define max(a, b) (((a) > (b)) ? (a) : (b))
 
 /*
  * function declarations
  */
 
+void *block_addItem(struct block *, size_t, size_t);
+void block_free(struct block *);
+
 struct vlib_adapter *getAdapterByIndex(uint32_t);
 struct vlib_adapter *getAdapterByHandle(HBA_HANDLE, HBA_STATUS *);
 struct vlib_adapter *getAdapterByDevid(devid_t);
 struct vlib_adapter *getAdapterByHostNo(unsigned short);
 struct vlib_port *getPortByIndex(const struct vlib_adapter *, const uint32_t);
 struct vlib_port *getPortByWWPN(const struct vlib_adapter *, const wwn_t);
+int getAdapterIndexByWWN(wwn_t, HBA_STATUS *);
+void freeWwnIndex(void);
+fc_id_t resolveDid(struct vlib_adapter *, wwn_t);
+void flushDids(struct vlib_adapter *);
 struct vlib_unit *getUnitByIndex(const struct vlib_port *, const uint32_t);
 struct vlib_unit *getUnitByFcLun(const struct vlib_port *, uint64_t);
 
 int addAdapterToRepos(struct vlib_adapter *);
 int addPortToRepos(struct vlib_adapter *, struct vlib_port *);
+struct vlib_port *getPortFromRepos(struct vlib_adapter *, char *);
+void invalidatePortAttributesByDid(struct vlib_adapter *, fc_id_t, fc_id_t);
 int addUnitToRepos(struct vlib_port *, struct vlib_unit *);
 
 HBA_STATUS getAdapterConfig(void);
@@ -55,12 +71,17 @@ int getUnitsFromPort(struct vlib_port *);
 
 int findIndexByName(char *);
 HBA_HANDLE openAdapterByIndex(HBA_UINT32);
-char *getSgDevFromPort(struct vlib_port *);
-char *getAttachedWLUN(struct vlib_adapter *, struct vlib_port *);
+struct vlib_unit *getSgUnitFromPort(struct vlib_port *);
+void attachWLUN(const char *, wwn_t, unsigned int, unsigned int,
+		unsigned int);
+struct vlib_unit *getAttachedWLUN(struct vlib_port *);
 void detachWLUN(struct vlib_adapter *, struct vlib_port *);
+void keepWLUN(struct vlib_adapter *, struct vlib_port *, int);
+void releaseAllWLUNs(void);
 
 int revalidateAdapters(void);
 int updateAdapter(struct vlib_adapter *adapter);
+void compactAdapter(struct vlib_adapter *);
 void doCloseAdapter(struct vlib_adapter *);
 void closeAllAdapters(void);
 
@@ -115,18 +136,49 @@ static inline uint32_t vlib_hbaFCID_to_FCID(uint32_t fcid)
 
 
 /**
- * @brief Mark all adapters in repository as invalid.
+ * @brief Note a change of the repository, so cursors over it get stale.
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ */
+static inline void repositoryChanged(void)
+{
+	vlib_data.generation++;
+}
+
+/**
+ * @brief Drop the cached attributes of an adapter.
+ * @param *adapter the adapter
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ */
+static inline void invalidateAdapterAttributes(struct vlib_adapter *adapter)
+{
+	adapter->attrCache.isValid = 0;
+	adapter->attrCache.generation++;
+}
+
+/**
+ * @brief Drop the cached attributes of the adapter port.
+ * @param *adapter the adapter
  * @par Locks:
  * 	vlib_data.mutex must be held
  */
-static inline void invalidateAllAdapters(void)
+static inline void invalidateAdapterPortAttributes(struct vlib_adapter *adapter)
 {
-	unsigned int i;
-	struct vlib_adapter *adapter;
+	adapter->portCache.isValid = 0;
+	adapter->portCache.generation++;
+}
 
-	adapter = getAdapterByIndex(0);
-	for (i = 0; i < vlib_data.adapters.used; ++i, ++adapter)
-		adapter->isInvalid = 1;
+/**
+ * @brief Drop the cached attributes of a discovered port.
+ * @param *port the port
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ */
+static inline void invalidatePortAttributes(struct vlib_port *port)
+{
+	port->attrCache.isValid = 0;
+	port->attrCache.generation++;
 }
 
 /**
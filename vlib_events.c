@@ -153,11 +153,25 @@ static void process_event(struct fc_nl_event *fc_nle)
 
 	hba_event->EventCode = fc_nle->event_code;
 	switch (hba_event->EventCode) {
-	case HBA_EVENT_LINK_UP:
 	case HBA_EVENT_LINK_DOWN:
+		/* sg devices behind a lost link are stale */
+		sgutils_invalidateUnits(adapter->ident.host, -1, -1, -1);
+		flushDids(adapter);
+		ns_invalidateMirror(adapter);
+		/* fall through */
+	case HBA_EVENT_LINK_UP:
+		/* adapter recovery, the firmware might have been updated */
+		invalidateAdapterAttributes(adapter);
+		invalidateAdapterPortAttributes(adapter);
+		invalidatePortAttributesByDid(adapter, 0, 0);
 		hba_event->Event.Link_EventInfo.PortFcId = adapter->ident.did;
 		break;
 	case HBA_EVENT_RSCN:
+		/* ports might have moved to another D_ID */
+		flushDids(adapter);
+		ns_notePage(adapter, fc_nle->event_data);
+		invalidatePortAttributesByDid(adapter, fc_nle->event_data,
+					      ns_pageMask(fc_nle->event_data));
 		hba_event->Event.RSCN_EventInfo.PortFcId = adapter->ident.did;
 		hba_event->Event.RSCN_EventInfo.NPortPage = fc_nle->event_data;
 		break;
@@ -200,6 +214,30 @@ static void dispatch_event(struct nlmsghdr *nlh)
 	process_event(fc_nle);
 }
 
+/**
+ * @brief Drop the cached fabric state of all adapters after lost events.
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * If the socket overflowed, RSCN and link events might have been lost, so
+ * the name server mirrors, the resolved D_IDs and the cached port
+ * attributes cannot be trusted anymore.
+ */
+static void invalidateFabricState(void)
+{
+	struct vlib_adapter *adapter;
+	unsigned int a;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByIndex(0);
+	for (a = 0; adapter && a < vlib_data.adapters.used; a++, adapter++) {
+		ns_invalidateMirror(adapter);
+		flushDids(adapter);
+		invalidatePortAttributesByDid(adapter, 0, 0);
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+}
+
 static void *establish_listener()
 {
 	struct msghdr msg;
@@ -211,6 +249,7 @@ static void *establish_listener()
 	struct iovec iov;
 	int sock_fd;
 	int bytes_read;
+	int err;
 
 	sock_fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_SCSITRANSPORT);
 	memset(&src_addr, 0, sizeof(src_addr));
@@ -231,8 +270,22 @@ static void *establish_listener()
 	while (1) {
 		/* Read message from kernel */
 		bytes_read = recvmsg(sock_fd, &msg, 0);
+		if (bytes_read < 0) {
+			err = errno;
+			if (err == EINTR)
+				continue;
+			invalidateFabricState();
+			/* ENOBUFS: events were dropped, keep listening */
+			if (err == ENOBUFS)
+				continue;
+			break;
+		}
 		dispatch_event(nlh);
 	}
+
+	free(nlh);
+	close(sock_fd);
+	return NULL;
 }
 
 void cleanup_event_thread()
@@ -0,0 +1,882 @@
+/*
+ * Copyright IBM Corp. 2010
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.ibm.com/developerworks/library/os-cpl.html
+ *
+ * File:		vlib_inventory.c
+ *
+ * Description:
+ * Concurrent LUN inventory of all adapters.
+ *
+ */
+
+/**
+ * @file vlib_inventory.c
+ * @brief Concurrent LUN inventory of all adapters.
+ *
+ * The inventory sends REPORT LUNS, INQUIRY and READ CAPACITY to all
+ * configured units using a pool of worker threads. It also harvests the
+ * LUIDs returned by HBA_GetFcpTargetMappingV2(). vlib_data.mutex is only
+ * held to look up units and their sg devices, never while a SCSI command is
+ * outstanding. The number of commands in flight is limited per target port
+ * and per adapter.
+ */
+
+#include "vlib.h"
+
+/** @brief Number of worker threads used by the inventory */
+#define INV_THREADS		32
+/** @brief Maximal number of commands in flight per target port */
+#define INV_MAX_PER_TARGET	4
+/** @brief Maximal number of commands in flight per adapter */
+#define INV_MAX_PER_ADAPTER	32
+/** @brief Initial size of a REPORT LUNS response buffer */
+#define INV_REPORTLUNS_SIZE	16384
+
+#define INQUIRY_LEN		96
+#define VPD_LEN			512
+
+/** @brief Adapter taking part in an inventory */
+struct inv_adapter {
+	unsigned int inflight;		/**< @brief commands in flight */
+};
+
+/** @brief Target port taking part in an inventory */
+struct inv_target {
+	struct inv_adapter *adapter;	/**< @brief adapter of the port */
+	ZFCP_LUNINVENTORYENTRY *first;	/**< @brief first unit of the port */
+	unsigned int count;		/**< @brief number of units */
+	unsigned int next;		/**< @brief next unit to be processed */
+	unsigned int inflight;		/**< @brief commands in flight */
+	int reportLuns;			/**< @brief REPORT LUNS still to be
+					   sent */
+	char *rlBuffer;			/**< @brief REPORT LUNS response */
+	HBA_STATUS rlStatus;		/**< @brief REPORT LUNS status */
+};
+
+/** @brief State of an inventory run */
+struct inventory {
+	pthread_mutex_t lock;		/**< @brief protects this structure */
+	pthread_cond_t cond;		/**< @brief signalled on completion */
+	HBA_UINT32 flags;		/**< @brief ZFCP_INVENTORY_* flags */
+	struct inv_adapter *adapters;	/**< @brief adapters */
+	struct inv_target *targets;	/**< @brief target ports */
+	unsigned int ntargets;		/**< @brief number of target ports */
+	ZFCP_LUNINVENTORYENTRY *entries; /**< @brief configured units */
+	unsigned int nentries;		/**< @brief number of units */
+	unsigned int pending;		/**< @brief commands not yet started */
+	unsigned int cursor;		/**< @brief round robin position */
+	int host;			/**< @brief SCSI host of the adapter to
+					   be scanned, -1 for all adapters */
+	unsigned int staleLuids:1;	/**< @brief only scan units without a
+					   current LUID */
+	unsigned long *epochs;		/**< @brief luidEpoch of the units
+					   when the inventory was created */
+};
+
+/** @brief Work item of an inventory worker */
+struct inv_job {
+	struct inv_target *target;	/**< @brief target port */
+	ZFCP_LUNINVENTORYENTRY *entry;	/**< @brief unit, NULL for
+					   REPORT LUNS */
+};
+
+static inline uint32_t get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t get_be64(const unsigned char *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+/**
+ * @brief Copy a SCSI string and strip trailing blanks.
+ * @param *dst destination buffer, must hold len + 1 characters
+ * @param *src SCSI string (not null terminated)
+ * @param len length of the SCSI string
+ */
+static void inv_copyString(char *dst, const unsigned char *src, int len)
+{
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+	while (len > 0 && (dst[len - 1] == ' ' || dst[len - 1] == '\0'))
+		dst[--len] = '\0';
+}
+
+/**
+ * @brief Get the next job which does not exceed the in-flight limits.
+ * @param *inv the inventory
+ * @param *job to return the job
+ * @return
+ *	- 0 if there is no more work
+ *	- 1 if a job was returned
+ * @par Locks:
+ *	lock/unlock of inv->lock
+ *
+ * Targets are served round robin, so the commands are spread over all
+ * targets and adapters. If all targets with pending work are at their
+ * limits, the function waits for a running command to complete.
+ */
+static int inv_getJob(struct inventory *inv, struct inv_job *job)
+{
+	struct inv_target *target;
+	unsigned int i, idx;
+
+	pthread_mutex_lock(&inv->lock);
+	while (inv->pending) {
+		for (i = 0; i < inv->ntargets; i++) {
+			idx = (inv->cursor + i) % inv->ntargets;
+			target = &inv->targets[idx];
+			if (!target->reportLuns &&
+			    target->next == target->count)
+				continue;
+			if (target->inflight >= INV_MAX_PER_TARGET ||
+			    target->adapter->inflight >=
+						INV_MAX_PER_ADAPTER)
+				continue;
+
+			job->target = target;
+			if (target->reportLuns) {
+				target->reportLuns = 0;
+				job->entry = NULL;
+			} else
+				job->entry =
+					&target->first[target->next++];
+			target->inflight++;
+			target->adapter->inflight++;
+			inv->pending--;
+			inv->cursor = idx + 1;
+			pthread_mutex_unlock(&inv->lock);
+			return 1;
+		}
+		pthread_cond_wait(&inv->cond, &inv->lock);
+	}
+	pthread_mutex_unlock(&inv->lock);
+
+	return 0;
+}
+
+/**
+ * @brief Mark a job as completed.
+ * @param *inv the inventory
+ * @param *job the completed job
+ * @par Locks:
+ *	lock/unlock of inv->lock
+ */
+static void inv_putJob(struct inventory *inv, struct inv_job *job)
+{
+	pthread_mutex_lock(&inv->lock);
+	job->target->inflight--;
+	job->target->adapter->inflight--;
+	pthread_cond_broadcast(&inv->cond);
+	pthread_mutex_unlock(&inv->lock);
+}
+
+/**
+ * @brief Get a file descriptor for the sg device of an inventory entry.
+ * @param *entry the inventory entry
+ * @param anyUnit use any unit of the entry's port with an sg device
+ * @param *sdev to return a copy of the unit
+ * @return
+ *	- -1 if the unit is gone or cannot be opened
+ *	- file descriptor on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+static int inv_getFd(ZFCP_LUNINVENTORYENTRY *entry, int anyUnit,
+		     struct vlib_unit *sdev)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	struct vlib_unit *unit = NULL;
+	wwn_t wwpn;
+	int sg_fd = -1;
+
+	vlib_HBA_WWN_to_wwn(&entry->PortWWN, &wwpn);
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHostNo(entry->ScsiHostNumber);
+	port = adapter ? getPortByWWPN(adapter, wwpn) : NULL;
+	if (port)
+		unit = anyUnit ? getSgUnitFromPort(port) :
+				 getUnitByFcLun(port, entry->FcpLun);
+	if (unit) {
+		*sdev = *unit;
+		sg_fd = sgutils_getUnitFd(unit);
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return sg_fd;
+}
+
+/**
+ * @brief Send REPORT LUNS to a target port.
+ * @param *target the target port
+ * @param *entry any unit of the target port
+ *
+ * Targets without any attached unit are not scanned, since this would
+ * require to attach the REPORT LUNS well known LUN.
+ */
+static void inv_reportLuns(struct inv_target *target,
+			   ZFCP_LUNINVENTORYENTRY *entry)
+{
+	struct vlib_unit sdev;
+	HBA_UINT32 size = INV_REPORTLUNS_SIZE;
+	char *buf;
+	int sg_fd;
+
+	/* any unit with an sg device will do */
+	sg_fd = inv_getFd(entry, 1, &sdev);
+	if (sg_fd < 0) {
+		target->rlStatus = HBA_STATUS_ERROR;
+		return;
+	}
+
+	buf = malloc(size);
+	if (!buf) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		close(sg_fd);
+		target->rlStatus = HBA_STATUS_ERROR;
+		return;
+	}
+
+	target->rlStatus = sgutils_SendReportLUNs(sg_fd, buf, &size,
+						  NULL, NULL, NULL);
+	if (target->rlStatus == HBA_STATUS_ERROR_MORE_DATA) {
+		size = get_be32((unsigned char *)buf) + 8;
+		free(buf);
+		buf = malloc(size);
+		if (!buf) {
+			VLIB_PERROR(ENOMEM, "ERROR");
+			close(sg_fd);
+			target->rlStatus = HBA_STATUS_ERROR;
+			return;
+		}
+		target->rlStatus = sgutils_SendReportLUNs(sg_fd, buf, &size,
+						  NULL, NULL, NULL);
+	}
+	sgutils_putUnitFd(sg_fd, &sdev, target->rlStatus);
+
+	if (target->rlStatus != HBA_STATUS_OK) {
+		free(buf);
+		return;
+	}
+	target->rlBuffer = buf;
+}
+
+/**
+ * @brief Get an INQUIRY response from the INQUIRY cache or from the unit.
+ * @param *sdev copy of the unit
+ * @param sg_fd file descriptor of the unit
+ * @param evpd EVPD bit
+ * @param page VPD page code
+ * @param *buf buffer for the response
+ * @param *size size of the buffer, returns length of the response
+ * @param *sense buffer for sense data, or NULL
+ * @param *senseLen size of the sense buffer, returns length of the sense
+ *	data
+ * @return see sgutils_SendScsiInquiry()
+ */
+static HBA_STATUS inv_inquiry(struct vlib_unit *sdev, int sg_fd,
+			      HBA_UINT8 evpd, HBA_UINT32 page,
+			      unsigned char *buf, HBA_UINT32 *size,
+			      unsigned char *sense, HBA_UINT32 *senseLen)
+{
+	unsigned long generation;
+	HBA_STATUS status;
+
+	if (sgutils_getCachedInquiry(sdev, evpd, page, buf, size,
+				     &generation) == 0)
+		return HBA_STATUS_OK;
+
+	status = sgutils_SendScsiInquiry(sg_fd, evpd, page, buf, size,
+					 NULL, sense, senseLen);
+	if (status == HBA_STATUS_OK)
+		sgutils_cacheInquiry(sdev, generation, evpd, page, buf, *size);
+
+	return status;
+}
+
+/**
+ * @brief Select the LUID from a device identification VPD page.
+ * @param *page the VPD page 0x83
+ * @param len length of the page
+ * @param *luid to return the selected identification descriptor
+ * @return
+ *	- -1 if the page has no suitable descriptor
+ *	- 0 on success
+ *
+ * Only descriptors of the logical unit itself are considered. NAA is
+ * preferred over EUI-64, SCSI name string and T10 vendor identification.
+ * The whole descriptor including its header is returned.
+ */
+static int inv_selectLuid(const unsigned char *page, HBA_UINT32 len,
+			  HBA_LUID *luid)
+{
+	static const int prio[16] = { [3] = 4, [2] = 3, [8] = 2, [1] = 1 };
+	const unsigned char *desc, *best = NULL;
+	HBA_UINT32 end, dlen;
+
+	if (len < 4 || page[1] != 0x83)
+		return -1;
+
+	end = 4 + ((page[2] << 8) | page[3]);
+	if (end > len)
+		end = len;
+
+	for (desc = page + 4; desc + 4 <= page + end;
+	     desc += 4 + desc[3]) {
+		if (desc + 4 + desc[3] > page + end)
+			break;
+		if ((desc[1] & 0x30) != 0 || prio[desc[1] & 0xf] == 0)
+			continue;	/* not the LU or unknown type */
+		if (!best || prio[desc[1] & 0xf] > prio[best[1] & 0xf])
+			best = desc;
+	}
+	if (!best)
+		return -1;
+
+	dlen = min(4 + best[3], sizeof(luid->buffer));
+	memset(luid, 0, sizeof(*luid));
+	memcpy(luid->buffer, best, dlen);
+
+	return 0;
+}
+
+/**
+ * @brief Send INQUIRY and READ CAPACITY to a unit as requested.
+ * @param *inv the inventory
+ * @param *entry the unit
+ */
+static void inv_scanUnit(struct inventory *inv, ZFCP_LUNINVENTORYENTRY *entry)
+{
+	unsigned char buf[VPD_LEN], sense[SCSI_SENSE_LEN];
+	struct vlib_unit sdev;
+	HBA_STATUS status = HBA_STATUS_OK;
+	HBA_UINT32 size, senseLen;
+	int sg_fd;
+
+	sg_fd = inv_getFd(entry, 0, &sdev);
+	if (sg_fd < 0) {
+		if (inv->flags & ZFCP_INVENTORY_INQUIRY)
+			entry->InquiryStatus = HBA_STATUS_ERROR;
+		if (inv->flags & ZFCP_INVENTORY_READCAPACITY)
+			entry->ReadCapacityStatus = HBA_STATUS_ERROR;
+		if (inv->flags & ZFCP_INVENTORY_IDENTIFY)
+			entry->IdentifyStatus = HBA_STATUS_ERROR;
+		return;
+	}
+
+	if (inv->flags & ZFCP_INVENTORY_INQUIRY) {
+		size = INQUIRY_LEN;
+		entry->InquiryStatus = inv_inquiry(&sdev, sg_fd, 0, 0, buf,
+						   &size, NULL, NULL);
+		if (entry->InquiryStatus == HBA_STATUS_OK) {
+			entry->PeripheralDeviceType = buf[0] & 0x1f;
+			inv_copyString(entry->VendorIdentification, buf + 8, 8);
+			inv_copyString(entry->ProductIdentification,
+				       buf + 16, 16);
+			inv_copyString(entry->ProductRevisionLevel,
+				       buf + 32, 4);
+		} else
+			status = entry->InquiryStatus;
+	}
+
+	if (inv->flags & ZFCP_INVENTORY_READCAPACITY) {
+		size = READCAP16LEN;
+		entry->ReadCapacityStatus = sgutils_SendReadCap(sg_fd, buf,
+						&size, NULL, NULL, NULL);
+		if (entry->ReadCapacityStatus == HBA_STATUS_OK) {
+			if (size == READCAP10LEN) {
+				entry->NumberOfBlocks = get_be32(buf) + 1ULL;
+				entry->BlockLength = get_be32(buf + 4);
+			} else {
+				entry->NumberOfBlocks = get_be64(buf) + 1;
+				entry->BlockLength = get_be32(buf + 8);
+			}
+		} else if (status == HBA_STATUS_OK)
+			status = entry->ReadCapacityStatus;
+	}
+
+	if (inv->flags & ZFCP_INVENTORY_IDENTIFY) {
+		size = VPD_LEN;
+		senseLen = sizeof(sense);
+		entry->IdentifyStatus = inv_inquiry(&sdev, sg_fd, 1, 0x83, buf,
+						    &size, sense, &senseLen);
+		if (entry->IdentifyStatus == HBA_STATUS_SCSI_CHECK_CONDITION &&
+		    sgutils_getSenseKey(sense, senseLen) ==
+		    SCSI_ILLEGAL_REQUEST)
+			/* the unit does not support the page */
+			entry->IdentifyStatus = HBA_STATUS_ERROR_NOT_SUPPORTED;
+		else if (entry->IdentifyStatus != HBA_STATUS_OK) {
+			if (status == HBA_STATUS_OK)
+				status = entry->IdentifyStatus;
+		} else if (inv_selectLuid(buf, size, &entry->LUID) < 0)
+			entry->IdentifyStatus = HBA_STATUS_ERROR_NOT_SUPPORTED;
+	}
+
+	sgutils_putUnitFd(sg_fd, &sdev, status);
+}
+
+/**
+ * @brief Main function of the inventory worker threads.
+ * @param *arg the inventory
+ */
+static void *inv_worker(void *arg)
+{
+	struct inventory *inv = arg;
+	struct inv_job job;
+
+	while (inv_getJob(inv, &job)) {
+		if (job.entry)
+			inv_scanUnit(inv, job.entry);
+		else
+			inv_reportLuns(job.target, job.target->first);
+		inv_putJob(inv, &job);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Check if a unit takes part in an inventory.
+ * @param *inv the inventory
+ * @param *unit the unit
+ * @return
+ *	- 0 if the unit is skipped
+ *	- 1 if the unit is scanned
+ */
+static int inv_wantUnit(struct inventory *inv, struct vlib_unit *unit)
+{
+	/* the report luns WLUN addresses the target, no LUN */
+	if (unit->isInvalid || unit->fcLun == REPORTLUNS_WLUN)
+		return 0;
+
+	return !(inv->staleLuids && unit->luidValid);
+}
+
+/**
+ * @brief Create the inventory tables from the repository.
+ * @param *inv the inventory
+ * @return
+ *	- HBA_STATUS_ERROR on error
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+static HBA_STATUS inv_create(struct inventory *inv)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	struct vlib_unit *unit;
+	struct inv_target *target;
+	ZFCP_LUNINVENTORYENTRY *entry;
+	unsigned int a, p, u, nports = 0;
+
+	sgutils_updateLuids();
+
+	/* count everything first, so the tables can be allocated at once */
+	adapter = getAdapterByIndex(0);
+	for (a = 0; adapter && a < vlib_data.adapters.used; a++, adapter++) {
+		if (adapter->isInvalid ||
+		    (inv->host >= 0 && adapter->ident.host != inv->host))
+			continue;
+		if (revalidatePorts(adapter) < 0)
+			return HBA_STATUS_ERROR;
+		port = getPortByIndex(adapter, 0);
+		for (p = 0; port && p < adapter->ports.used; p++, port++) {
+			if (port->isInvalid)
+				continue;
+			if (revalidateUnits(port) < 0)
+				return HBA_STATUS_ERROR;
+			nports++;
+			unit = getUnitByIndex(port, 0);
+			for (u = 0; unit && u < port->units.used; u++, unit++)
+				if (inv_wantUnit(inv, unit))
+					inv->nentries++;
+		}
+	}
+
+	inv->adapters = calloc(vlib_data.adapters.used + 1,
+			       sizeof(struct inv_adapter));
+	inv->targets = calloc(nports + 1, sizeof(struct inv_target));
+	inv->entries = calloc(inv->nentries + 1,
+			      sizeof(ZFCP_LUNINVENTORYENTRY));
+	inv->epochs = calloc(inv->nentries + 1, sizeof(*inv->epochs));
+	if (!inv->adapters || !inv->targets || !inv->entries ||
+	    !inv->epochs) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	entry = inv->entries;
+	target = inv->targets;
+	adapter = getAdapterByIndex(0);
+	for (a = 0; adapter && a < vlib_data.adapters.used; a++, adapter++) {
+		if (adapter->isInvalid ||
+		    (inv->host >= 0 && adapter->ident.host != inv->host))
+			continue;
+		port = getPortByIndex(adapter, 0);
+		for (p = 0; port && p < adapter->ports.used; p++, port++) {
+			if (port->isInvalid)
+				continue;
+			target->adapter = &inv->adapters[a];
+			target->first = entry;
+			unit = getUnitByIndex(port, 0);
+			for (u = 0; unit && u < port->units.used; u++, unit++) {
+				if (!inv_wantUnit(inv, unit))
+					continue;
+				vlib_wwn_to_HBA_WWN(adapter->ident.wwpn,
+						    &entry->HbaPortWWN);
+				vlib_wwn_to_HBA_WWN(port->wwpn,
+						    &entry->PortWWN);
+				entry->FcpLun = unit->fcLun;
+				entry->ScsiHostNumber = adapter->ident.host;
+				entry->ScsiBusNumber = unit->channel;
+				entry->ScsiTargetNumber = unit->target;
+				entry->ScsiOSLun = unit->lun;
+				strcpy(entry->OSDeviceName, unit->sg_dev);
+				entry->InquiryStatus =
+					HBA_STATUS_ERROR_NOT_SUPPORTED;
+				entry->ReadCapacityStatus =
+					HBA_STATUS_ERROR_NOT_SUPPORTED;
+				entry->IdentifyStatus =
+					HBA_STATUS_ERROR_NOT_SUPPORTED;
+				inv->epochs[entry - inv->entries] =
+					unit->luidEpoch;
+				entry++;
+				target->count++;
+			}
+			if (target->count == 0)
+				/* nothing to scan on this port */
+				continue;
+			if (inv->flags & ZFCP_INVENTORY_REPORTLUNS) {
+				target->reportLuns = 1;
+				inv->pending++;
+			}
+			target->rlStatus = HBA_STATUS_ERROR_NOT_SUPPORTED;
+			if (inv->flags & (ZFCP_INVENTORY_INQUIRY |
+					  ZFCP_INVENTORY_READCAPACITY |
+					  ZFCP_INVENTORY_IDENTIFY))
+				inv->pending += target->count;
+			else
+				target->next = target->count;
+			target++;
+		}
+	}
+	inv->ntargets = target - inv->targets;
+
+	return HBA_STATUS_OK;
+}
+
+/**
+ * @brief Free the inventory tables.
+ * @param *inv the inventory
+ */
+static void inv_free(struct inventory *inv)
+{
+	unsigned int i;
+
+	for (i = 0; inv->targets && i < inv->ntargets; i++)
+		free(inv->targets[i].rlBuffer);
+	free(inv->targets);
+	free(inv->adapters);
+	free(inv->entries);
+	free(inv->epochs);
+}
+
+/**
+ * @brief Run the inventory workers.
+ * @param *inv the inventory
+ *
+ * The calling thread takes part in the work, so the inventory still
+ * completes if no additional thread can be created.
+ */
+static void inv_run(struct inventory *inv)
+{
+	pthread_t threads[INV_THREADS];
+	unsigned int i, nthreads;
+
+	pthread_mutex_init(&inv->lock, NULL);
+	pthread_cond_init(&inv->cond, NULL);
+
+	nthreads = inv->pending < INV_THREADS ? inv->pending : INV_THREADS;
+	for (i = 0; i + 1 < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, inv_worker, inv) != 0)
+			break;
+	nthreads = i;
+
+	inv_worker(inv);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_cond_destroy(&inv->cond);
+	pthread_mutex_destroy(&inv->lock);
+}
+
+/**
+ * @brief Store the harvested LUIDs in the units.
+ * @param *inv the inventory
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * LUIDs of units that were invalidated since the inventory was created are
+ * not stored, they are harvested again on the next request. So are units
+ * that failed VPD page 0x83, e.g. with a CHECK CONDITION during a path
+ * failover.
+ */
+static void inv_storeLuids(struct inventory *inv)
+{
+	ZFCP_LUNINVENTORYENTRY *entry;
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	struct vlib_unit *unit;
+	unsigned int i;
+	wwn_t wwpn;
+
+	if (!(inv->flags & ZFCP_INVENTORY_IDENTIFY))
+		return;
+
+	/* units that changed during the scan keep no LUID */
+	sgutils_updateLuids();
+
+	for (i = 0, entry = inv->entries; i < inv->nentries; i++, entry++) {
+		/* a unit without the page or a suitable descriptor has an
+		 * empty LUID */
+		if (entry->IdentifyStatus != HBA_STATUS_OK &&
+		    entry->IdentifyStatus != HBA_STATUS_ERROR_NOT_SUPPORTED)
+			continue;
+
+		vlib_HBA_WWN_to_wwn(&entry->PortWWN, &wwpn);
+		adapter = getAdapterByHostNo(entry->ScsiHostNumber);
+		port = adapter ? getPortByWWPN(adapter, wwpn) : NULL;
+		unit = port ? getUnitByFcLun(port, entry->FcpLun) : NULL;
+		if (!unit || unit->luidEpoch != inv->epochs[i])
+			continue;
+
+		unit->luid = entry->LUID;
+		unit->luidValid = 1;
+	}
+}
+
+static int inv_cmpLun(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+/**
+ * @brief Convert a FCP LUN to the LUN number used by the SCSI midlayer.
+ * @param fcLun the FCP LUN
+ * @return the LUN as it would be shown by the SCSI midlayer
+ */
+static HBA_UINT32 inv_fcLunToOSLun(uint64_t fcLun)
+{
+	return ((fcLun >> 48) & 0xffff) | (((fcLun >> 32) & 0xffff) << 16);
+}
+
+/**
+ * @brief Return the entries of a target, including unattached LUNs.
+ * @param *target the target port
+ * @param *pInventory the caller's buffer
+ * @param *total number of entries so far, is incremented
+ * @return
+ *	- HBA_STATUS_ERROR on error
+ *	- HBA_STATUS_OK on success
+ */
+static HBA_STATUS inv_emitTarget(struct inv_target *target,
+				 ZFCP_LUNINVENTORY *pInventory,
+				 HBA_UINT32 *total)
+{
+	ZFCP_LUNINVENTORYENTRY *entry;
+	unsigned char *rl;
+	uint64_t *luns, fcLun;
+	unsigned int i, nluns;
+
+	for (i = 0; i < target->count; i++, (*total)++)
+		if (*total < pInventory->NumberOfEntries)
+			pInventory->entry[*total] = target->first[i];
+
+	if (!target->rlBuffer)
+		return HBA_STATUS_OK;
+
+	luns = malloc(target->count * sizeof(uint64_t));
+	if (!luns) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+	for (i = 0; i < target->count; i++)
+		luns[i] = target->first[i].FcpLun;
+	qsort(luns, target->count, sizeof(uint64_t), inv_cmpLun);
+
+	rl = (unsigned char *)target->rlBuffer;
+	nluns = get_be32(rl) / 8;
+	for (i = 0; i < nluns; i++) {
+		fcLun = get_be64(rl + 8 + i * 8);
+		if (fcLun == REPORTLUNS_WLUN ||
+		    bsearch(&fcLun, luns, target->count, sizeof(uint64_t),
+			    inv_cmpLun))
+			continue;
+
+		if (*total < pInventory->NumberOfEntries) {
+			entry = &pInventory->entry[*total];
+			memset(entry, 0, sizeof(*entry));
+			entry->HbaPortWWN = target->first->HbaPortWWN;
+			entry->PortWWN = target->first->PortWWN;
+			entry->FcpLun = fcLun;
+			entry->ScsiHostNumber = target->first->ScsiHostNumber;
+			entry->ScsiBusNumber = target->first->ScsiBusNumber;
+			entry->ScsiTargetNumber =
+				target->first->ScsiTargetNumber;
+			entry->ScsiOSLun = inv_fcLunToOSLun(fcLun);
+			entry->InquiryStatus = HBA_STATUS_ERROR_INVALID_LUN;
+			entry->ReadCapacityStatus =
+				HBA_STATUS_ERROR_INVALID_LUN;
+			entry->IdentifyStatus = HBA_STATUS_ERROR_INVALID_LUN;
+		}
+		(*total)++;
+	}
+
+	free(luns);
+
+	return HBA_STATUS_OK;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Get an inventory of the LUNs of all adapters.
+ * @param Flags ZFCP_INVENTORY_* flags selecting the SCSI commands to be sent
+ * @param *pInventory buffer to return the inventory
+ * @return
+ *	- HBA_STATUS_ERROR_NOT_LOADED if library is not loaded
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in
+ *	pInventory, NumberOfEntries is set to the required number of entries
+ *	- HBA_STATUS_ERROR if any other internal error occurs
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * Returns one entry per configured unit. ZFCP_INVENTORY_INQUIRY and
+ * ZFCP_INVENTORY_READCAPACITY fill in the standard INQUIRY data and the
+ * capacity of each unit; the result of each command is returned in
+ * InquiryStatus and ReadCapacityStatus, which are
+ * HBA_STATUS_ERROR_NOT_SUPPORTED if the command was not requested.
+ * ZFCP_INVENTORY_IDENTIFY fills in the LUID like
+ * HBA_GetFcpTargetMappingV2() and returns the result in IdentifyStatus,
+ * which is HBA_STATUS_ERROR_NOT_SUPPORTED if the unit does not support VPD
+ * page 0x83 or has no suitable identification descriptor. With
+ * ZFCP_INVENTORY_REPORTLUNS, REPORT LUNS is sent to every target port with
+ * at least one attached unit, and an entry is added for each reported LUN
+ * that is not attached. Its OSDeviceName is empty and its statuses are
+ * HBA_STATUS_ERROR_INVALID_LUN.
+ *
+ * The commands are sent concurrently. The number of commands in flight is
+ * limited per target port and per adapter.
+ *
+ * @note Without ZFCP_INVENTORY_REPORTLUNS, the required size is checked
+ *	before any command is sent. With ZFCP_INVENTORY_REPORTLUNS, it is only
+ *	known after the inventory has run.
+ */
+HBA_STATUS ZFCP_GetLunInventory(HBA_UINT32 Flags,
+				ZFCP_LUNINVENTORY *pInventory)
+{
+	struct inventory inv;
+	HBA_STATUS status;
+	HBA_UINT32 total = 0;
+	unsigned int i;
+
+	/* you need to be root to access /dev/sg* */
+	if (Flags && getuid())
+		return HBA_STATUS_ERROR;
+
+	memset(&inv, 0, sizeof(inv));
+	inv.flags = Flags;
+	inv.host = -1;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	if (!vlib_data.isLoaded) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return HBA_STATUS_ERROR_NOT_LOADED;
+	}
+
+	status = revalidateRepository();
+	if (status == HBA_STATUS_OK)
+		status = inv_create(&inv);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	if (status != HBA_STATUS_OK)
+		goto out;
+
+	if (!(Flags & ZFCP_INVENTORY_REPORTLUNS) &&
+	    inv.nentries > pInventory->NumberOfEntries) {
+		pInventory->NumberOfEntries = inv.nentries;
+		status = HBA_STATUS_ERROR_MORE_DATA;
+		goto out;
+	}
+
+	inv_run(&inv);
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	inv_storeLuids(&inv);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	for (i = 0; i < inv.ntargets; i++) {
+		status = inv_emitTarget(&inv.targets[i], pInventory, &total);
+		if (status != HBA_STATUS_OK)
+			goto out;
+	}
+
+	if (total > pInventory->NumberOfEntries)
+		status = HBA_STATUS_ERROR_MORE_DATA;
+	pInventory->NumberOfEntries = total;
+
+out:
+	inv_free(&inv);
+	return status;
+}
+
+/**
+ * @brief Harvest the LUIDs of the units of an adapter.
+ * @param host SCSI host of the adapter
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * VPD page 0x83 is requested concurrently for all units without a current
+ * LUID, with the same limits as ZFCP_GetLunInventory(). Pages still held
+ * in the INQUIRY cache are not requested again.
+ */
+void inventory_identifyUnits(unsigned int host)
+{
+	struct inventory inv;
+	HBA_STATUS status;
+
+	/* you need to be root to access /dev/sg* */
+	if (getuid())
+		return;
+
+	memset(&inv, 0, sizeof(inv));
+	inv.flags = ZFCP_INVENTORY_IDENTIFY;
+	inv.host = host;
+	inv.staleLuids = 1;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	status = revalidateRepository();
+	if (status == HBA_STATUS_OK)
+		status = inv_create(&inv);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	if (status == HBA_STATUS_OK && inv.pending) {
+		inv_run(&inv);
+
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		inv_storeLuids(&inv);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	}
+
+	inv_free(&inv);
+}
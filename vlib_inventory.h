@@ -0,0 +1,20 @@
+/*
+ * Copyright IBM Corp. 2010
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.ibm.com/developerworks/library/os-cpl.html
+ *
+ * File:		vlib_inventory.h
+ *
+ * Description:
+ * Function declarations for the concurrent LUN inventory
+ *
+ */
+
+#ifndef _VLIB_INVENTORY_H_
+#define _VLIB_INVENTORY_H_
+
+void inventory_identifyUnits(unsigned int host);
+
+#endif /*_VLIB_INVENTORY_H_*/
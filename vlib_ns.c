@@ -0,0 +1,984 @@
+/*
+ * Copyright IBM Corp. 2010
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.ibm.com/developerworks/library/os-cpl.html
+ *
+ * File:		vlib_ns.c
+ *
+ * Description:
+ * Queries of the fabric name server.
+ *
+ */
+
+/**
+ * @file vlib_ns.c
+ * @brief Queries of the fabric name server.
+ *
+ * The ports with a FC-4 type are listed with a single GPN_FT request, or
+ * GID_FT if the name server does not support GPN_FT. Details of single
+ * ports are only requested on demand, with GA_NXT and GFF_ID sent
+ * concurrently through a pass-thru queue.
+ *
+ * The FCP ports of the fabric can be mirrored per adapter. The mirror is
+ * seeded with bulk queries and kept up to date from RSCN events: the
+ * affected pages are noted and queried again on the next lookup.
+ */
+
+#include "vlib.h"
+
+#include <arpa/inet.h>
+#include <scsi/fc/fc_gs.h>
+#include <scsi/fc/fc_ns.h>
+
+/** @brief Initial size of a GPN_FT or GID_FT response in words */
+#define NS_FT_WORDS		4096
+/** @brief Highest domain ID of a fabric */
+#define NS_MAX_DOMAIN		0xef
+
+/* command codes missing in fc_ns.h */
+#define NS_GNN_FT		0x0173
+#define NS_GID_FF		0x01f1
+
+/* FC-4 type and FC-4 features of FCP as defined in FC-GS */
+#define NS_FC4_TYPE_FCP		0x08
+#define NS_FCP_TARGET		0x1
+#define NS_FCP_INITIATOR	0x2
+
+/* position of a FC-4 type in the FC-4 types and features of FC-GS */
+#define NS_FC4_TYPE_BYTE(t)	(((t) / 32) * 4 + 3 - ((t) % 32) / 8)
+#define NS_FC4_TYPE_BIT(t)	(1 << ((t) % 8))
+#define NS_FC4_FEAT_BYTE(t)	(((t) / 8) * 4 + 3 - ((t) % 8) / 2)
+#define NS_FC4_FEAT_SHIFT(t)	(((t) % 2) * 4)
+
+/* address format of a RSCN page as defined in FC-LS */
+#define NS_RSCN_FORMAT(page)	(((page) >> 24) & 0x3)
+#define NS_RSCN_PORT		0
+#define NS_RSCN_AREA		1
+#define NS_RSCN_DOMAIN		2
+#define NS_RSCN_FABRIC		3
+
+/** @brief Size of the GA_NXT response payload */
+#define NS_GA_NXT_SIZE		620
+/* offsets in the GA_NXT response payload as defined in FC-GS */
+#define NS_GA_NXT_PORT_TYPE	0
+#define NS_GA_NXT_PORT_ID	1
+#define NS_GA_NXT_PORT_NAME	4
+#define NS_GA_NXT_SPN_LEN	12
+#define NS_GA_NXT_SPN		13
+#define NS_GA_NXT_NODE_NAME	268
+#define NS_GA_NXT_FC4_TYPES	560
+
+/** @brief Size of the GFF_ID response payload */
+#define NS_GFF_ID_SIZE		128
+
+/** @brief GID_FT, GPN_FT, GNN_FT or GID_FF request */
+struct ns_ft_req {
+	struct fc_ct_hdr hdr;
+	struct fc_ns_gid_ft ft;		/**< @brief scope and FC-4 type */
+	__u8 resvd[2];			/**< @brief GID_FF only */
+	__u8 features;			/**< @brief GID_FF only */
+	__u8 type;			/**< @brief GID_FF only */
+};
+
+/** @brief Request with a port identifier, as GA_NXT or GFF_ID */
+struct ns_fid_req {
+	struct fc_ct_hdr hdr;
+	struct fc_ns_fid fid;
+};
+
+/** @brief A query of a port sent through a pass-thru queue */
+struct ns_query {
+	struct ns_fid_req req;		/**< @brief the request */
+	unsigned char rsp[FC_CT_HDR_LEN + NS_GA_NXT_SIZE];
+					/**< @brief the response */
+	HBA_STATUS status;		/**< @brief result of the request */
+};
+
+/** @brief Queries of the details of a port */
+struct ns_detail {
+	struct ns_query attr;		/**< @brief GA_NXT */
+	struct ns_query feat;		/**< @brief GFF_ID */
+};
+
+/**
+ * @brief Set up the CT header of a name server request.
+ * @param *hdr the header
+ * @param cmd command code
+ * @param words maximum size of the response in words
+ */
+static void ns_initHdr(struct fc_ct_hdr *hdr, unsigned int cmd,
+		       unsigned int words)
+{
+	hdr->ct_rev = FC_CT_REV;
+	hdr->ct_fs_type = FC_FST_DIR;
+	hdr->ct_fs_subtype = FC_NS_SUBTYPE;
+	hdr->ct_cmd = htons(cmd);
+	hdr->ct_mr_size = htons(words);
+}
+
+/**
+ * @brief Convert the 3 byte port identifier of a name server entry.
+ * @param *fid the port identifier
+ * @return the D_ID
+ */
+static inline HBA_UINT32 ns_getFid(const unsigned char *fid)
+{
+	return (fid[0] << 16) | (fid[1] << 8) | fid[2];
+}
+
+/**
+ * @brief Add the ports of a GPN_FT, GNN_FT, GID_FT or GID_FF query to a list.
+ * @param handle to an opened adapter
+ * @param cmd FC_NS_GPN_FT, NS_GNN_FT, FC_NS_GID_FT or NS_GID_FF
+ * @param type FC-4 type
+ * @param features FC-4 features, only used with NS_GID_FF
+ * @param domain domain ID scope, 0 for the whole fabric
+ * @param *ports list of ZFCP_NSPORT, PortWWN is the node name with
+ *	NS_GNN_FT
+ * @param *complete returns whether the last port was received
+ * @return
+ *	- HBA_STATUS_ERROR_NOT_SUPPORTED if the name server rejects the command
+ *	- HBA_STATUS_ERROR if the request could not be sent or was rejected
+ *	- HBA_STATUS_OK on success, also if there are no such ports
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+static HBA_STATUS ns_queryFt(HBA_HANDLE handle, unsigned int cmd,
+			     HBA_UINT8 type, HBA_UINT8 features,
+			     unsigned int domain, struct block *ports,
+			     int *complete)
+{
+	struct ns_ft_req req;
+	struct fc_ct_hdr *hdr;
+	struct fc_gpn_ft_resp *entry;
+	ZFCP_NSPORT *port;
+	unsigned char *rsp;
+	HBA_UINT32 len, off, size, reqSize;
+	HBA_STATUS status;
+
+	memset(&req, 0, sizeof(req));
+	ns_initHdr(&req.hdr, cmd, NS_FT_WORDS);
+	req.ft.fn_domain_id_scope = domain;
+	if (cmd == NS_GID_FF) {
+		req.features = features;
+		req.type = type;
+		reqSize = sizeof(req);
+	} else {
+		req.ft.fn_fc4_type = type;
+		reqSize = FC_CT_HDR_LEN + sizeof(req.ft);
+	}
+
+	*complete = 0;
+	status = ZFCP_SendCTPassThruAlloc(handle, &req, reqSize,
+					  (void **) &rsp, &len);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	hdr = (struct fc_ct_hdr *) rsp;
+	size = cmd == FC_NS_GPN_FT || cmd == NS_GNN_FT ?
+	       sizeof(struct fc_gpn_ft_resp) : sizeof(struct fc_ns_fid);
+
+	if (len < FC_CT_HDR_LEN)
+		status = HBA_STATUS_ERROR;
+	else if (ntohs(hdr->ct_cmd) == FC_FS_RJT) {
+		if (hdr->ct_reason == FC_FS_RJT_CMD ||
+		    hdr->ct_reason == FC_FS_RJT_UNSUP)
+			status = HBA_STATUS_ERROR_NOT_SUPPORTED;
+		else if (hdr->ct_reason == FC_FS_RJT_UNABL)
+			*complete = 1;		/* no such ports */
+		else
+			status = HBA_STATUS_ERROR;
+	} else if (ntohs(hdr->ct_cmd) != FC_FS_ACC)
+		status = HBA_STATUS_ERROR;
+
+	for (off = FC_CT_HDR_LEN; status == HBA_STATUS_OK && !*complete &&
+	     off + size <= len; off += size) {
+		entry = (struct fc_gpn_ft_resp *) (rsp + off);
+		port = block_addItem(ports, sizeof(*port), VLIB_GROW_NSPORTS);
+		if (!port) {
+			status = HBA_STATUS_ERROR;
+			break;
+		}
+		memset(port, 0, sizeof(*port));
+		port->PortFcId = ns_getFid(entry->fp_fid);
+		if (size == sizeof(struct fc_gpn_ft_resp))
+			memcpy(&port->PortWWN, &entry->fp_wwpn,
+			       sizeof(port->PortWWN));
+		*complete = entry->fp_flags & FC_NS_FID_LAST;
+	}
+
+	ZFCP_FreePassThruBuffer(rsp);
+
+	return status;
+}
+
+/**
+ * @brief List the ports of a FC-4 type.
+ * @param handle to an opened adapter
+ * @param cmd see ns_queryFt()
+ * @param type FC-4 type
+ * @param features FC-4 features, only used with NS_GID_FF
+ * @param domain domain ID scope, 0 for the whole fabric
+ * @param *ports returns the list of ZFCP_NSPORT
+ * @return see ns_queryFt()
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * If the list of the whole fabric does not fit into the largest CT response,
+ * the remainder is requested domain by domain. The name server lists the
+ * ports in ascending order, so the continuation starts over with the domain
+ * of the last port received.
+ */
+static HBA_STATUS ns_listPorts(HBA_HANDLE handle, unsigned int cmd,
+			       HBA_UINT8 type, HBA_UINT8 features,
+			       unsigned int domain, struct block *ports)
+{
+	ZFCP_NSPORT *port;
+	HBA_STATUS status;
+	int complete;
+
+	status = ns_queryFt(handle, cmd, type, features, domain, ports,
+			    &complete);
+	if (status != HBA_STATUS_OK || complete)
+		return status;
+	if (!ports->used || domain)
+		return HBA_STATUS_ERROR;
+
+	port = ports->data;
+	domain = port[ports->used - 1].PortFcId >> 16;
+	while (ports->used && port[ports->used - 1].PortFcId >> 16 == domain)
+		ports->used--;
+
+	for (; domain <= NS_MAX_DOMAIN; domain++) {
+		status = ns_queryFt(handle, cmd, type, features, domain,
+				    ports, &complete);
+		if (status != HBA_STATUS_OK)
+			return status;
+		if (!complete) {
+			VLIB_LOG("too many ports in domain 0x%x\n", domain);
+			return HBA_STATUS_ERROR;
+		}
+	}
+
+	return HBA_STATUS_OK;
+}
+
+/**
+ * @brief List the ports of a FC-4 type with their WWPN if possible.
+ * @param handle to an opened adapter
+ * @param type FC-4 type
+ * @param domain domain ID scope, 0 for the whole fabric
+ * @param *ports returns the list of ZFCP_NSPORT
+ * @return see ns_queryFt()
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+static HBA_STATUS ns_getPorts(HBA_HANDLE handle, HBA_UINT8 type,
+			      unsigned int domain, struct block *ports)
+{
+	HBA_STATUS status;
+
+	status = ns_listPorts(handle, FC_NS_GPN_FT, type, 0, domain, ports);
+	if (status == HBA_STATUS_ERROR_NOT_SUPPORTED) {
+		ports->used = 0;
+		status = ns_listPorts(handle, FC_NS_GID_FT, type, 0, domain,
+				      ports);
+	}
+
+	return status;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief List the ports of a FC-4 type registered at the name server.
+ * @param handle to an opened adapter
+ * @param Fc4Type FC-4 type, e.g. 0x08 for FCP
+ * @param *pList returns the ports, NumberOfEntries is the number of
+ *	entries pList has space for
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pList is NULL
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pList,
+ *	NumberOfEntries is set to the required number of entries
+ *	- HBA_STATUS_ERROR if the name server could not be queried
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The whole list is requested with GPN_FT, which usually takes one or two
+ * CT requests. If the name server does not support GPN_FT, GID_FT is used
+ * and PortWWN is zero. Use ZFCP_GetNameServerPortDetails() for more
+ * attributes of a port.
+ */
+HBA_STATUS ZFCP_GetNameServerPorts(HBA_HANDLE handle, HBA_UINT8 Fc4Type,
+				   ZFCP_NSPORTLIST *pList)
+{
+	struct block ports;
+	HBA_STATUS status;
+
+	if (!pList)
+		return HBA_STATUS_ERROR_ARG;
+
+	memset(&ports, 0, sizeof(ports));
+	status = ns_getPorts(handle, Fc4Type, 0, &ports);
+	if (status != HBA_STATUS_OK)
+		goto out;
+
+	memcpy(pList->entry, ports.data,
+	       min(ports.used, pList->NumberOfEntries) * sizeof(ZFCP_NSPORT));
+	if (ports.used > pList->NumberOfEntries)
+		status = HBA_STATUS_ERROR_MORE_DATA;
+	pList->NumberOfEntries = ports.used;
+
+out:
+	block_free(&ports);
+	return status;
+}
+
+/**
+ * @brief Record the completion of a query.
+ * @param *context the query
+ * @param status result of the request
+ */
+static void ns_done(void *context, HBA_STATUS status)
+{
+	struct ns_query *query = context;
+
+	query->status = status;
+}
+
+/**
+ * @brief Submit a query of a port to a pass-thru queue.
+ * @param queue the pass-thru queue
+ * @param *query the query
+ * @param cmd command code
+ * @param fid port identifier of the request
+ * @param size size of the response payload
+ */
+static void ns_submit(ZFCP_PASSTHRUQUEUE queue, struct ns_query *query,
+		      unsigned int cmd, HBA_UINT32 fid, HBA_UINT32 size)
+{
+	HBA_STATUS status;
+
+	ns_initHdr(&query->req.hdr, cmd, size / 4);
+	query->req.fid.fp_fid[0] = fid >> 16;
+	query->req.fid.fp_fid[1] = fid >> 8;
+	query->req.fid.fp_fid[2] = fid;
+
+	/* set before submission, the callback might run right away */
+	query->status = HBA_STATUS_ERROR;
+	status = ZFCP_SubmitCTPassThru(queue, &query->req, sizeof(query->req),
+				       query->rsp, FC_CT_HDR_LEN + size, 0,
+				       ns_done, query);
+	if (status != HBA_STATUS_OK)
+		query->status = status;
+}
+
+/**
+ * @brief Check the response of a query.
+ * @param *query the completed query
+ * @return
+ *	- HBA_STATUS_ERROR_ILLEGAL_FCID if the name server rejected the query
+ *	- HBA_STATUS_ERROR if the request could not be sent
+ *	- HBA_STATUS_OK if the query was accepted
+ */
+static HBA_STATUS ns_checkQuery(const struct ns_query *query)
+{
+	const struct fc_ct_hdr *hdr = (const struct fc_ct_hdr *) query->rsp;
+
+	if (query->status != HBA_STATUS_OK)
+		return query->status;
+	if (ntohs(hdr->ct_cmd) == FC_FS_RJT)
+		return HBA_STATUS_ERROR_ILLEGAL_FCID;
+	if (ntohs(hdr->ct_cmd) != FC_FS_ACC)
+		return HBA_STATUS_ERROR;
+
+	return HBA_STATUS_OK;
+}
+
+/**
+ * @brief Fill in the attributes of a port from a GA_NXT response.
+ * @param *entry the port
+ * @param *query the completed GA_NXT query
+ */
+static void ns_parseAttributes(ZFCP_NSPORTDETAILS *entry,
+			       const struct ns_query *query)
+{
+	const unsigned char *p = query->rsp + FC_CT_HDR_LEN;
+
+	entry->Status = ns_checkQuery(query);
+	if (entry->Status != HBA_STATUS_OK)
+		return;
+
+	/* GA_NXT returns the next port, which might not be the one asked for */
+	if (ns_getFid(p + NS_GA_NXT_PORT_ID) != entry->PortFcId) {
+		entry->Status = HBA_STATUS_ERROR_ILLEGAL_FCID;
+		return;
+	}
+
+	entry->PortType = p[NS_GA_NXT_PORT_TYPE];
+	memcpy(&entry->PortWWN, p + NS_GA_NXT_PORT_NAME,
+	       sizeof(entry->PortWWN));
+	memcpy(&entry->NodeWWN, p + NS_GA_NXT_NODE_NAME,
+	       sizeof(entry->NodeWWN));
+	memcpy(entry->PortSymbolicName, p + NS_GA_NXT_SPN,
+	       p[NS_GA_NXT_SPN_LEN]);
+	entry->PortSymbolicName[p[NS_GA_NXT_SPN_LEN]] = '\0';
+	memcpy(&entry->FC4Types, p + NS_GA_NXT_FC4_TYPES,
+	       sizeof(entry->FC4Types));
+}
+
+/**
+ * @brief Fill in the FC-4 features of a port from a GFF_ID response.
+ * @param *entry the port
+ * @param *query the completed GFF_ID query
+ *
+ * A port without registered FC-4 features is rejected by the name server,
+ * its features are left zero.
+ */
+static void ns_parseFeatures(ZFCP_NSPORTDETAILS *entry,
+			     const struct ns_query *query)
+{
+	HBA_STATUS status;
+
+	status = ns_checkQuery(query);
+	if (status == HBA_STATUS_OK)
+		memcpy(entry->FC4Features, query->rsp + FC_CT_HDR_LEN,
+		       sizeof(entry->FC4Features));
+	else if (status != HBA_STATUS_ERROR_ILLEGAL_FCID &&
+		 entry->Status == HBA_STATUS_OK)
+		entry->Status = status;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Get details of ports registered at the name server.
+ * @param handle to an opened adapter
+ * @param Flags ZFCP_NS_ATTRIBUTES and ZFCP_NS_FEATURES
+ * @param Count number of entries
+ * @param *pEntries the ports, with PortFcId set by the caller
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pEntries is NULL
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR if out of memory
+ *	- HBA_STATUS_OK on success, the result for each port is in its Status
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * ZFCP_NS_ATTRIBUTES sends GA_NXT for each port and fills in the port type,
+ * the names and the FC-4 types; Status is HBA_STATUS_ERROR_ILLEGAL_FCID if
+ * no port with that PortFcId is registered. ZFCP_NS_FEATURES sends GFF_ID
+ * and fills in the FC-4 features. The requests for all ports are sent
+ * concurrently, with PT_DEFAULT_DEPTH requests in flight.
+ */
+HBA_STATUS ZFCP_GetNameServerPortDetails(HBA_HANDLE handle, HBA_UINT32 Flags,
+					 HBA_UINT32 Count,
+					 ZFCP_NSPORTDETAILS *pEntries)
+{
+	ZFCP_PASSTHRUQUEUE queue;
+	struct ns_detail *details;
+	ZFCP_NSPORTDETAILS *entry;
+	HBA_STATUS status;
+	HBA_UINT32 i, fid;
+
+	if (!pEntries && Count)
+		return HBA_STATUS_ERROR_ARG;
+
+	details = calloc(Count ? Count : 1, sizeof(*details));
+	if (!details) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	status = ZFCP_OpenPassThruQueue(handle, 0, &queue);
+	if (status != HBA_STATUS_OK) {
+		free(details);
+		return status;
+	}
+
+	for (i = 0; i < Count; i++) {
+		entry = &pEntries[i];
+		if (Flags & ZFCP_NS_ATTRIBUTES)
+			ns_submit(queue, &details[i].attr, FC_NS_GA_NXT,
+				  entry->PortFcId - 1, NS_GA_NXT_SIZE);
+		if (Flags & ZFCP_NS_FEATURES)
+			ns_submit(queue, &details[i].feat, FC_NS_GFF_ID,
+				  entry->PortFcId, NS_GFF_ID_SIZE);
+	}
+
+	/* waits for all requests */
+	ZFCP_ClosePassThruQueue(queue);
+
+	for (i = 0; i < Count; i++) {
+		entry = &pEntries[i];
+		fid = entry->PortFcId;
+		memset(entry, 0, sizeof(*entry));
+		entry->PortFcId = fid;
+		entry->Status = HBA_STATUS_OK;
+		if (Flags & ZFCP_NS_ATTRIBUTES)
+			ns_parseAttributes(entry, &details[i].attr);
+		if (Flags & ZFCP_NS_FEATURES)
+			ns_parseFeatures(entry, &details[i].feat);
+	}
+
+	free(details);
+
+	return HBA_STATUS_OK;
+}
+
+/**
+ * @brief Compare ports by PortFcId, for qsort() and bsearch().
+ * @param *a first ZFCP_NSPORTDETAILS
+ * @param *b second ZFCP_NSPORTDETAILS
+ * @return less than, equal to or greater than 0
+ */
+static int ns_cmpEntry(const void *a, const void *b)
+{
+	const ZFCP_NSPORTDETAILS *e1 = a, *e2 = b;
+
+	return (e1->PortFcId > e2->PortFcId) - (e1->PortFcId < e2->PortFcId);
+}
+
+/**
+ * @brief Compare RSCN pages by domain, for qsort().
+ * @param *a first page
+ * @param *b second page
+ * @return less than, equal to or greater than 0
+ */
+static int ns_cmpPage(const void *a, const void *b)
+{
+	HBA_UINT32 d1 = (*(const HBA_UINT32 *) a >> 16) & 0xff;
+	HBA_UINT32 d2 = (*(const HBA_UINT32 *) b >> 16) & 0xff;
+
+	return (d1 > d2) - (d1 < d2);
+}
+
+/**
+ * @brief Get the mask of the port identifiers affected by a RSCN page.
+ * @param page the RSCN page
+ * @return the mask
+ */
+HBA_UINT32 ns_pageMask(HBA_UINT32 page)
+{
+	switch (NS_RSCN_FORMAT(page)) {
+	case NS_RSCN_PORT:
+		return 0xffffff;
+	case NS_RSCN_AREA:
+		return 0xffff00;
+	case NS_RSCN_DOMAIN:
+		return 0xff0000;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Set a FCP feature of the ports listed by GID_FF.
+ * @param handle to an opened adapter
+ * @param domain domain ID scope, 0 for the whole fabric
+ * @param feature FCP feature
+ * @param *entries ZFCP_NSPORTDETAILS sorted by PortFcId
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+static void ns_addFeature(HBA_HANDLE handle, unsigned int domain,
+			  HBA_UINT8 feature, struct block *entries)
+{
+	ZFCP_NSPORTDETAILS key, *entry;
+	struct block ports;
+	ZFCP_NSPORT *port;
+	size_t i;
+
+	memset(&ports, 0, sizeof(ports));
+	ns_listPorts(handle, NS_GID_FF, NS_FC4_TYPE_FCP, feature, domain,
+		     &ports);
+
+	port = ports.data;
+	for (i = 0; i < ports.used; i++) {
+		key.PortFcId = port[i].PortFcId;
+		entry = bsearch(&key, entries->data, entries->used,
+				sizeof(key), ns_cmpEntry);
+		if (entry)
+			entry->FC4Features[NS_FC4_FEAT_BYTE(NS_FC4_TYPE_FCP)] |=
+				feature << NS_FC4_FEAT_SHIFT(NS_FC4_TYPE_FCP);
+	}
+
+	block_free(&ports);
+}
+
+/**
+ * @brief Query the FCP ports of the fabric or a domain with bulk requests.
+ * @param handle to an opened adapter
+ * @param domain domain ID scope, 0 for the whole fabric
+ * @param *entries returns ZFCP_NSPORTDETAILS sorted by PortFcId
+ * @return see ns_queryFt()
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * Port names come from GPN_FT, node names from GNN_FT and the FCP features
+ * from GID_FF. Port type and symbolic name are left empty.
+ */
+static HBA_STATUS ns_fetch(HBA_HANDLE handle, unsigned int domain,
+			   struct block *entries)
+{
+	ZFCP_NSPORTDETAILS key, *entry;
+	struct block ports;
+	ZFCP_NSPORT *port;
+	HBA_STATUS status;
+	size_t i;
+
+	memset(&ports, 0, sizeof(ports));
+	status = ns_getPorts(handle, NS_FC4_TYPE_FCP, domain, &ports);
+	if (status != HBA_STATUS_OK)
+		goto out;
+
+	port = ports.data;
+	for (i = 0; i < ports.used; i++) {
+		entry = block_addItem(entries, sizeof(*entry),
+				      VLIB_GROW_NSPORTS);
+		if (!entry) {
+			status = HBA_STATUS_ERROR;
+			goto out;
+		}
+		memset(entry, 0, sizeof(*entry));
+		entry->PortFcId = port[i].PortFcId;
+		entry->PortWWN = port[i].PortWWN;
+		entry->FC4Types.bits[NS_FC4_TYPE_BYTE(NS_FC4_TYPE_FCP)] |=
+			NS_FC4_TYPE_BIT(NS_FC4_TYPE_FCP);
+	}
+	qsort(entries->data, entries->used, sizeof(*entry), ns_cmpEntry);
+
+	/* node names are optional, the port list is complete without */
+	ports.used = 0;
+	ns_listPorts(handle, NS_GNN_FT, NS_FC4_TYPE_FCP, 0, domain, &ports);
+	port = ports.data;
+	for (i = 0; i < ports.used; i++) {
+		key.PortFcId = port[i].PortFcId;
+		entry = bsearch(&key, entries->data, entries->used,
+				sizeof(key), ns_cmpEntry);
+		if (entry)
+			entry->NodeWWN = port[i].PortWWN;
+	}
+
+	ns_addFeature(handle, domain, NS_FCP_TARGET, entries);
+	ns_addFeature(handle, domain, NS_FCP_INITIATOR, entries);
+
+out:
+	block_free(&ports);
+	return status;
+}
+
+/**
+ * @brief Replace the ports of a RSCN page in the mirror.
+ * @param *mirror the mirror
+ * @param page the RSCN page
+ * @param *fetched ports of the domain of the page
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+static void ns_applyPage(struct vlib_ns_mirror *mirror, HBA_UINT32 page,
+			 struct block *fetched)
+{
+	ZFCP_NSPORTDETAILS *entry, *new;
+	HBA_UINT32 mask, addr;
+	size_t i, j;
+
+	mask = ns_pageMask(page);
+	addr = page & mask;
+
+	entry = mirror->ports.data;
+	for (i = 0, j = 0; i < mirror->ports.used; i++)
+		if ((entry[i].PortFcId & mask) != addr)
+			entry[j++] = entry[i];
+	mirror->ports.used = j;
+
+	new = fetched->data;
+	for (i = 0; i < fetched->used; i++) {
+		if ((new[i].PortFcId & mask) != addr)
+			continue;
+		entry = block_addItem(&mirror->ports, sizeof(*entry),
+				      VLIB_GROW_NSPORTS);
+		if (!entry) {
+			mirror->isValid = 0;
+			return;
+		}
+		*entry = new[i];
+	}
+
+	qsort(mirror->ports.data, mirror->ports.used, sizeof(*entry),
+	      ns_cmpEntry);
+}
+
+/**
+ * @brief Bring the name server mirror of an adapter up to date.
+ * @param handle to an opened adapter
+ * @return
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_TRY_AGAIN if the mirror was invalidated meanwhile
+ *	- HBA_STATUS_ERROR if the name server could not be queried
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	vlib_data.ns_mutex must be held, lock/unlock of vlib_data.mutex
+ *
+ * An invalid mirror is seeded with the whole fabric. Otherwise each domain
+ * with noted RSCN pages is queried once, and only the ports of the pages
+ * are replaced. vlib_data.mutex is not held while the name server is
+ * queried; RSCN events noted meanwhile are handled by the next update.
+ */
+static HBA_STATUS ns_updateMirror(HBA_HANDLE handle)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_ns_mirror *mirror;
+	struct block pages, fetched;
+	unsigned int generation, domain = 0;
+	unsigned short host;
+	HBA_UINT32 *page;
+	HBA_STATUS status;
+	size_t i;
+	int seed;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHandle(handle, &status);
+	if (!adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+	host = adapter->ident.host;
+	mirror = &adapter->nsMirror;
+	if (!vlib_data.nsMirror)
+		ns_invalidateMirror(adapter);
+	seed = !mirror->isValid;
+	generation = mirror->generation;
+	pages = mirror->pages;
+	memset(&mirror->pages, 0, sizeof(mirror->pages));
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	memset(&fetched, 0, sizeof(fetched));
+	if (seed) {
+		status = ns_fetch(handle, 0, &fetched);
+		if (status != HBA_STATUS_OK)
+			goto out;
+
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		adapter = getAdapterByHostNo(host);
+		if (adapter && adapter->nsMirror.generation == generation) {
+			mirror = &adapter->nsMirror;
+			block_free(&mirror->ports);
+			mirror->ports = fetched;
+			mirror->isValid = 1;
+			memset(&fetched, 0, sizeof(fetched));
+		} else
+			status = HBA_STATUS_ERROR_TRY_AGAIN;
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		goto out;
+	}
+
+	qsort(pages.data, pages.used, sizeof(*page), ns_cmpPage);
+	page = pages.data;
+	for (i = 0; i < pages.used; i++) {
+		if (!i || ((page[i] >> 16) & 0xff) != domain) {
+			domain = (page[i] >> 16) & 0xff;
+			fetched.used = 0;
+			status = ns_fetch(handle, domain, &fetched);
+			if (status != HBA_STATUS_OK)
+				break;
+		}
+
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		adapter = getAdapterByHostNo(host);
+		if (adapter && adapter->nsMirror.generation == generation)
+			ns_applyPage(&adapter->nsMirror, page[i], &fetched);
+		else
+			status = HBA_STATUS_ERROR_TRY_AGAIN;
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		if (status != HBA_STATUS_OK)
+			break;
+	}
+
+	if (status != HBA_STATUS_OK) {
+		/* the pages were taken out of the mirror, seed again next
+		 * time unless it was invalidated meanwhile anyway */
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		adapter = getAdapterByHostNo(host);
+		if (adapter && adapter->nsMirror.generation == generation)
+			ns_invalidateMirror(adapter);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	}
+
+out:
+	block_free(&fetched);
+	block_free(&pages);
+	return status;
+}
+
+/**
+ * @brief Note a RSCN page, so its ports are queried again.
+ * @param *adapter which received the RSCN
+ * @param page the RSCN page as reported by the FC transport
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * A fabric page, or too many pages, invalidate the mirror instead.
+ */
+void ns_notePage(struct vlib_adapter *adapter, HBA_UINT32 page)
+{
+	struct vlib_ns_mirror *mirror = &adapter->nsMirror;
+	HBA_UINT32 *p;
+
+	if (NS_RSCN_FORMAT(page) == NS_RSCN_FABRIC ||
+	    mirror->pages.used >= VLIB_NS_MAX_PAGES) {
+		ns_invalidateMirror(adapter);
+		return;
+	}
+
+	p = block_addItem(&mirror->pages, sizeof(*p), VLIB_GROW_NSPAGES);
+	if (!p) {
+		ns_invalidateMirror(adapter);
+		return;
+	}
+	*p = page;
+}
+
+/**
+ * @brief Invalidate the name server mirror of an adapter.
+ * @param *adapter the adapter
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The mirror is seeded again on the next lookup. Updates running meanwhile
+ * are discarded.
+ */
+void ns_invalidateMirror(struct vlib_adapter *adapter)
+{
+	adapter->nsMirror.isValid = 0;
+	adapter->nsMirror.generation++;
+	adapter->nsMirror.pages.used = 0;
+}
+
+/**
+ * @brief Free the name server mirror of an adapter.
+ * @param *adapter the adapter
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+void ns_freeMirror(struct vlib_adapter *adapter)
+{
+	ns_invalidateMirror(adapter);
+	block_free(&adapter->nsMirror.ports);
+	block_free(&adapter->nsMirror.pages);
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Get the FCP ports registered at the name server from the mirror.
+ * @param handle to an opened adapter
+ * @param *pMirror returns the ports, NumberOfEntries is the number of
+ *	entries pMirror has space for
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pMirror is NULL
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pMirror,
+ *	NumberOfEntries is set to the required number of entries
+ *	- HBA_STATUS_ERROR_TRY_AGAIN if a link down or RSCN event invalidated
+ *	the mirror while it was updated
+ *	- HBA_STATUS_ERROR if the name server could not be queried
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.ns_mutex and vlib_data.mutex
+ *
+ * The first call seeds the mirror of the adapter with a few bulk requests.
+ * Later calls only query the pages reported by RSCN events since, and cause
+ * no fabric traffic at all if there were none. The entries are sorted by
+ * PortFcId and contain port and node name, the FCP type and the FCP
+ * features; PortType and PortSymbolicName are empty.
+ */
+HBA_STATUS ZFCP_GetNameServerMirror(HBA_HANDLE handle, ZFCP_NSMIRROR *pMirror)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_ns_mirror *mirror;
+	HBA_STATUS status;
+
+	if (!pMirror)
+		return HBA_STATUS_ERROR_ARG;
+
+	VLIB_MUTEX_LOCK(&vlib_data.ns_mutex);
+	status = ns_updateMirror(handle);
+	if (status != HBA_STATUS_OK) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.ns_mutex);
+		return status;
+	}
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHandle(handle, &status);
+	if (adapter) {
+		mirror = &adapter->nsMirror;
+		memcpy(pMirror->entry, mirror->ports.data,
+		       min(mirror->ports.used, pMirror->NumberOfEntries) *
+		       sizeof(ZFCP_NSPORTDETAILS));
+		if (mirror->ports.used > pMirror->NumberOfEntries)
+			status = HBA_STATUS_ERROR_MORE_DATA;
+		pMirror->NumberOfEntries = mirror->ports.used;
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	VLIB_MUTEX_UNLOCK(&vlib_data.ns_mutex);
+
+	return status;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Look up a FCP port registered at the name server in the mirror.
+ * @param handle to an opened adapter
+ * @param PortWWN of the port
+ * @param *pEntry returns the port
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pEntry is NULL
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_ILLEGAL_WWN if no FCP port has that WWPN
+ *	- HBA_STATUS_ERROR_TRY_AGAIN see ZFCP_GetNameServerMirror()
+ *	- HBA_STATUS_ERROR if the name server could not be queried
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.ns_mutex and vlib_data.mutex
+ *
+ * See ZFCP_GetNameServerMirror().
+ */
+HBA_STATUS ZFCP_LookupNameServerPort(HBA_HANDLE handle, HBA_WWN PortWWN,
+				     ZFCP_NSPORTDETAILS *pEntry)
+{
+	struct vlib_adapter *adapter;
+	ZFCP_NSPORTDETAILS *entry;
+	HBA_STATUS status;
+	size_t i;
+
+	if (!pEntry)
+		return HBA_STATUS_ERROR_ARG;
+
+	VLIB_MUTEX_LOCK(&vlib_data.ns_mutex);
+	status = ns_updateMirror(handle);
+	if (status != HBA_STATUS_OK) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.ns_mutex);
+		return status;
+	}
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHandle(handle, &status);
+	if (adapter) {
+		status = HBA_STATUS_ERROR_ILLEGAL_WWN;
+		entry = adapter->nsMirror.ports.data;
+		for (i = 0; i < adapter->nsMirror.ports.used; i++, entry++)
+			if (!memcmp(&entry->PortWWN, &PortWWN,
+				    sizeof(PortWWN))) {
+				*pEntry = *entry;
+				status = HBA_STATUS_OK;
+				break;
+			}
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	VLIB_MUTEX_UNLOCK(&vlib_data.ns_mutex);
+
+	return status;
+}
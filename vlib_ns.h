@@ -0,0 +1,23 @@
+/*
+ * Copyright IBM Corp. 2010
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.ibm.com/developerworks/library/os-cpl.html
+ *
+ * File:		vlib_ns.h
+ *
+ * Description:
+ * Function declarations for the name server queries and mirror
+ *
+ */
+
+#ifndef _VLIB_NS_H_
+#define _VLIB_NS_H_
+
+HBA_UINT32 ns_pageMask(HBA_UINT32);
+void ns_notePage(struct vlib_adapter *, HBA_UINT32);
+void ns_invalidateMirror(struct vlib_adapter *);
+void ns_freeMirror(struct vlib_adapter *);
+
+#endif /*_VLIB_NS_H_*/
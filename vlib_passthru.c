@@ -0,0 +1,1414 @@
+/*
+ * Copyright IBM Corp. 2010
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.ibm.com/developerworks/library/os-cpl.html
+ *
+ * File:		vlib_passthru.c
+ *
+ * Description:
+ * CT and ELS pass-thru, synchronous and asynchronous.
+ *
+ */
+
+/**
+ * @file vlib_passthru.c
+ * @brief CT and ELS pass-thru, synchronous and asynchronous.
+ *
+ * Requests are sent through the bsg device of the adapter. vlib_data.mutex
+ * is only held to look up the adapter and its bsg device, never while a
+ * request is outstanding. Identical CT queries in flight at the same time
+ * are sent only once.
+ *
+ * A pass-thru queue sends requests asynchronously with a pool of worker
+ * threads, one per request in flight. Completions are reported by a
+ * callback or collected with ZFCP_GetPassThruCompletion() once the
+ * eventfd of the queue becomes readable.
+ */
+
+#include "vlib.h"
+
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <scsi/fc/fc_els.h>
+
+/** @brief Size of the CT preamble */
+#define PT_CT_PREAMBLE_SIZE	16
+/** @brief Offset of the command code in the CT preamble */
+#define PT_CT_CMD_OFFSET	8
+/** @brief Offset of the maximum/residual size in the CT preamble */
+#define PT_CT_SIZE_OFFSET	10
+/** @brief Offset of the reason code in the CT preamble */
+#define PT_CT_REASON_OFFSET	13
+/** @brief Offset of the reason code explanation in the CT preamble */
+#define PT_CT_EXPL_OFFSET	14
+
+/* CT response codes, reason codes and explanations as defined in FC-GS */
+#define CT_REJECT			0x8001
+#define CT_ACCEPT			0x8002
+#define CT_RC_LOGICAL_BUSY		0x05
+#define CT_RC_UNABLE_TO_PERFORM		0x09
+#define CT_RCE_PROCESSING_REQUEST	0xf4
+
+/** @brief Kind of an asynchronous pass-thru request */
+enum pt_type {
+	PT_CT,				/**< @brief CT request */
+	PT_RNID,			/**< @brief RNID ELS */
+	PT_RLS				/**< @brief RLS ELS */
+};
+
+/** @brief Asynchronous pass-thru request */
+struct pt_request {
+	struct pt_request *next;	/**< @brief next request in the list */
+	enum pt_type type;		/**< @brief kind of the request */
+	void *req;			/**< @brief CT request */
+	HBA_UINT32 reqSize;		/**< @brief size of the CT request */
+	HBA_WWN wwn;			/**< @brief ELS destination port */
+	HBA_UINT32 fcid;		/**< @brief ELS destination, PortFcId
+					   for RNID, D_ID for RLS, 0 if
+					   unknown */
+	void *rsp;			/**< @brief response buffer */
+	HBA_UINT32 rspSize;		/**< @brief size of the response
+					   buffer */
+	unsigned int timeout;		/**< @brief timeout in milliseconds */
+	ZFCP_PASSTHRUCALLBACK callback;	/**< @brief completion callback,
+					   NULL to queue the completion */
+	void *context;			/**< @brief passed on completion */
+	HBA_STATUS status;		/**< @brief result of the request */
+};
+
+/** @brief Queue of asynchronous pass-thru requests to an adapter */
+struct ZFCP_PassThruQueue {
+	HBA_HANDLE handle;		/**< @brief adapter */
+	pthread_mutex_t lock;		/**< @brief protects this structure */
+	pthread_cond_t cond;		/**< @brief signalled on submission */
+	struct pt_request *first;	/**< @brief first submitted request */
+	struct pt_request *last;	/**< @brief last submitted request */
+	struct pt_request *done;	/**< @brief first completed request */
+	struct pt_request *doneLast;	/**< @brief last completed request */
+	int fd;				/**< @brief eventfd counting completed
+					   requests */
+	unsigned int stop:1;		/**< @brief workers are to stop */
+	unsigned int nworkers;		/**< @brief number of workers */
+	pthread_t workers[PT_MAX_DEPTH]; /**< @brief worker threads */
+};
+
+/**
+ * @brief Check if a CT request is a query.
+ * @param *req the CT request
+ * @param reqSize size of the request
+ * @return
+ *	- 0 if the request might change state in the fabric
+ *	- 1 for queries (command codes 0x0100 to 0x01ff)
+ */
+static int pt_isQuery(const void *req, HBA_UINT32 reqSize)
+{
+	const unsigned char *ct = req;
+
+	return reqSize >= PT_CT_PREAMBLE_SIZE && ct[PT_CT_CMD_OFFSET] == 0x01;
+}
+
+/**
+ * @brief Look up an identical CT query in flight.
+ * @param host SCSI host of the adapter
+ * @param *req the CT request
+ * @param reqSize size of the request
+ * @param rspSize size of the response buffer
+ * @return
+ *	- NULL if there is none
+ *	- the query in flight
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+static struct vlib_ct_flight *pt_findFlight(unsigned short host,
+					    const void *req,
+					    HBA_UINT32 reqSize,
+					    HBA_UINT32 rspSize)
+{
+	struct vlib_ct_flight *flight;
+
+	for (flight = vlib_data.ct_flights; flight; flight = flight->next) {
+		if (flight->host == host && !flight->done &&
+		    flight->reqSize == reqSize && flight->rspSize == rspSize &&
+		    memcmp(flight->req, req, reqSize) == 0)
+			return flight;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Wait for the response of an identical CT query in flight.
+ * @param *flight the query in flight
+ * @param *rsp buffer for the response, of flight->rspSize bytes
+ * @param *rspLen returns the length of the response
+ * @return result of the query
+ * @par Locks:
+ *	vlib_data.mutex must be held, it is released while waiting
+ */
+static HBA_STATUS pt_joinFlight(struct vlib_ct_flight *flight, void *rsp,
+				HBA_UINT32 *rspLen)
+{
+	HBA_STATUS status;
+
+	flight->waiters++;
+	while (!flight->done)
+		pthread_cond_wait(&flight->cond, &vlib_data.mutex);
+
+	status = flight->status;
+	if (status == HBA_STATUS_OK)
+		memcpy(rsp, flight->rsp, flight->rspSize);
+	*rspLen = flight->rspLen;
+
+	if (--flight->waiters == 0)
+		pthread_cond_broadcast(&flight->cond);
+
+	return status;
+}
+
+/**
+ * @brief Hand the response of a CT query to all identical queries.
+ * @param *flight the query in flight
+ * @param status result of the query
+ * @param rspLen length of the response
+ * @par Locks:
+ *	vlib_data.mutex must be held, it is released while waiting
+ *
+ * The response buffer of the query sent is used by the waiters, so this
+ * returns only after all of them copied the response.
+ */
+static void pt_landFlight(struct vlib_ct_flight *flight, HBA_STATUS status,
+			  HBA_UINT32 rspLen)
+{
+	struct vlib_ct_flight **prev;
+
+	flight->status = status;
+	flight->rspLen = rspLen;
+	flight->done = 1;
+	pthread_cond_broadcast(&flight->cond);
+	while (flight->waiters)
+		pthread_cond_wait(&flight->cond, &vlib_data.mutex);
+
+	for (prev = &vlib_data.ct_flights; *prev; prev = &(*prev)->next) {
+		if (*prev == flight) {
+			*prev = flight->next;
+			break;
+		}
+	}
+	pthread_cond_destroy(&flight->cond);
+}
+
+/**
+ * @brief Take a token for a CT request from the token bucket of an adapter.
+ * @param *gov the governor of the adapter
+ * @return time in nanoseconds to wait before the request is sent
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The bucket holds up to VLIB_CT_BURST tokens and is refilled at the current
+ * rate. If it is empty, the token is taken in advance and the caller waits
+ * until it would have been refilled. Without a busy reject and without
+ * vlib_data.ctRate, no token is needed. The requests sent per second are
+ * counted to find the rate to start pacing at.
+ */
+static long long pt_takeToken(struct vlib_ct_governor *gov)
+{
+	struct timespec now;
+	double elapsed, rate;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec != gov->second.tv_sec) {
+		gov->lastSent = now.tv_sec == gov->second.tv_sec + 1 ?
+				gov->sent : 0;
+		gov->sent = 0;
+		gov->second = now;
+	}
+	gov->sent++;
+
+	rate = gov->rate ? gov->rate : vlib_data.ctRate;
+	if (rate == 0) {
+		gov->isPaced = 0;
+		return 0;
+	}
+
+	if (!gov->isPaced) {
+		gov->isPaced = 1;
+		gov->tokens = VLIB_CT_BURST;
+	} else {
+		elapsed = (now.tv_sec - gov->last.tv_sec) +
+			  (now.tv_nsec - gov->last.tv_nsec) / 1e9;
+		gov->tokens += elapsed * rate;
+		if (gov->tokens > VLIB_CT_BURST)
+			gov->tokens = VLIB_CT_BURST;
+	}
+	gov->last = now;
+
+	gov->tokens -= 1;
+	if (gov->tokens >= 0)
+		return 0;
+
+	return -gov->tokens / rate * 1e9;
+}
+
+/**
+ * @brief Account the result of a CT request and adapt the rate.
+ * @param *gov the governor of the adapter
+ * @param *rsp the response
+ * @param rspLen length of the response
+ * @param status result of sending the request
+ * @return
+ *	- 0 if the request is done
+ *	- 1 if the management server was busy and the request should be
+ *	retried
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The first busy reject starts pacing at half the rate requests were sent
+ * at, each further one halves the rate again. Each accept raises it by one
+ * request per second. Pacing ends once the rate is twice the one of the last
+ * busy reject or reaches vlib_data.ctRate. Busy requests are always retried.
+ */
+static int pt_account(struct vlib_ct_governor *gov, const void *rsp,
+		      HBA_UINT32 rspLen, HBA_STATUS status)
+{
+	const unsigned char *ct = rsp;
+	unsigned int code;
+
+	gov->stats.Requests++;
+	if (status != HBA_STATUS_OK) {
+		gov->stats.Errors++;
+		return 0;
+	}
+	if (rspLen < PT_CT_PREAMBLE_SIZE)
+		return 0;
+
+	code = (ct[PT_CT_CMD_OFFSET] << 8) | ct[PT_CT_CMD_OFFSET + 1];
+	if (code == CT_ACCEPT) {
+		gov->stats.Accepts++;
+		if (gov->rate) {
+			gov->rate++;
+			if (gov->rate >= 2 * gov->busyRate ||
+			    (vlib_data.ctRate && gov->rate >= vlib_data.ctRate))
+				gov->rate = 0;
+		}
+		return 0;
+	}
+	if (code != CT_REJECT)
+		return 0;
+
+	gov->stats.Rejects++;
+	if (ct[PT_CT_REASON_OFFSET] != CT_RC_LOGICAL_BUSY &&
+	    (ct[PT_CT_REASON_OFFSET] != CT_RC_UNABLE_TO_PERFORM ||
+	     ct[PT_CT_EXPL_OFFSET] != CT_RCE_PROCESSING_REQUEST))
+		return 0;
+
+	gov->stats.BusyRejects++;
+	if (gov->rate)
+		gov->busyRate = gov->rate;
+	else if (vlib_data.ctRate)
+		gov->busyRate = vlib_data.ctRate;
+	else
+		gov->busyRate = max(gov->sent, gov->lastSent);
+	gov->rate = gov->busyRate > 2 ? gov->busyRate / 2 : 1;
+
+	return 1;
+}
+
+/**
+ * @brief Compute the backoff before a CT request is retried.
+ * @param attempt number of retries done so far
+ * @return time in nanoseconds
+ *
+ * The backoff doubles with each retry from VLIB_CT_BACKOFF_MIN up to
+ * VLIB_CT_BACKOFF_MAX milliseconds. Half of it is random, so concurrent
+ * requests are not retried at the same time.
+ */
+static long long pt_backoff(unsigned int attempt)
+{
+	long long ms;
+
+	ms = min((long long) VLIB_CT_BACKOFF_MIN << attempt,
+		 VLIB_CT_BACKOFF_MAX);
+	ms = ms / 2 + random() % (ms / 2 + 1);
+
+	return ms * 1000000;
+}
+
+/**
+ * @brief Sleep for some time.
+ * @param nsec time in nanoseconds
+ */
+static void pt_sleep(long long nsec)
+{
+	struct timespec t;
+
+	if (nsec <= 0)
+		return;
+
+	t.tv_sec = nsec / 1000000000;
+	t.tv_nsec = nsec % 1000000000;
+	while (nanosleep(&t, &t) < 0 && errno == EINTR)
+		;
+}
+
+/**
+ * @brief Send a CT request to the fabric.
+ * @param handle to an opened adapter
+ * @param *req the CT request
+ * @param reqSize size of the request
+ * @param *rsp buffer for the response
+ * @param rspSize size of the response buffer
+ * @param *rspLen returns the length of the response, might be NULL
+ * @param timeout in milliseconds
+ * @return
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR if the request could not be sent
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * If an identical query is already in flight through the same adapter, its
+ * response is returned instead of sending the query again (see
+ * vlib_data.ctCoalesce). Requests are paced by the governor of the adapter
+ * and retried up to VLIB_CT_RETRIES times if the management server is busy.
+ */
+HBA_STATUS pt_sendCT(HBA_HANDLE handle, void *req, HBA_UINT32 reqSize,
+		     void *rsp, HBA_UINT32 rspSize, HBA_UINT32 *rspLen,
+		     unsigned int timeout)
+{
+	HBA_STATUS status;
+	HBA_UINT32 len = 0;
+	struct vlib_adapter *adapter;
+	struct vlib_ct_flight flight, *other;
+	unsigned short host;
+	unsigned int attempt;
+	long long delay;
+	int coalesce;
+	int fd;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+	host = adapter->ident.host;
+
+	coalesce = vlib_data.ctCoalesce && pt_isQuery(req, reqSize);
+	if (coalesce) {
+		other = pt_findFlight(host, req, reqSize, rspSize);
+		if (other) {
+			adapter->ctGov.stats.Coalesced++;
+			status = pt_joinFlight(other, rsp, &len);
+			VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+			if (rspLen)
+				*rspLen = len;
+			return status;
+		}
+
+		memset(&flight, 0, sizeof(flight));
+		flight.host = host;
+		flight.req = req;
+		flight.reqSize = reqSize;
+		flight.rsp = rsp;
+		flight.rspSize = rspSize;
+		pthread_cond_init(&flight.cond, NULL);
+		flight.next = vlib_data.ct_flights;
+		vlib_data.ct_flights = &flight;
+	}
+
+	for (attempt = 0; ; attempt++) {
+		delay = pt_takeToken(&adapter->ctGov);
+		fd = sg_io_getBsgFd(adapter);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+		pt_sleep(delay);
+		status = sg_io_performCTPassThru(fd, req, reqSize, rsp,
+						 rspSize, &len, timeout);
+
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		adapter = getAdapterByHostNo(host);
+		sg_io_putBsgFd(adapter, fd, status);
+		if (!adapter ||
+		    !pt_account(&adapter->ctGov, rsp, len, status) ||
+		    attempt == VLIB_CT_RETRIES)
+			break;
+		adapter->ctGov.stats.Retries++;
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+		pt_sleep(pt_backoff(attempt));
+
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		adapter = getAdapterByHostNo(host);
+		if (!adapter)
+			break;
+	}
+	if (coalesce)
+		pt_landFlight(&flight, status, len);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	if (rspLen)
+		*rspLen = len;
+
+	return status;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Get statistics of the CT requests sent through an adapter.
+ * @param handle to an opened adapter
+ * @param *pStatistics returns the statistics
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pStatistics is NULL
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+HBA_STATUS ZFCP_GetCTStatistics(HBA_HANDLE handle,
+				ZFCP_CTSTATISTICS *pStatistics)
+{
+	struct vlib_adapter *adapter;
+	HBA_STATUS status;
+
+	if (!pStatistics)
+		return HBA_STATUS_ERROR_ARG;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	adapter = getAdapterByHandle(handle, &status);
+	if (adapter) {
+		*pStatistics = adapter->ctGov.stats;
+		pStatistics->CurrentRate = adapter->ctGov.rate ?
+					   adapter->ctGov.rate :
+					   vlib_data.ctRate;
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return status;
+}
+
+/**
+ * @brief Get the maximum/residual size field of a CT preamble.
+ * @param *ct the CT request or response
+ * @return size in words
+ */
+static unsigned int pt_getCTSize(const void *ct)
+{
+	const unsigned char *p = ct;
+
+	return (p[PT_CT_SIZE_OFFSET] << 8) | p[PT_CT_SIZE_OFFSET + 1];
+}
+
+/**
+ * @brief Set the maximum size field of a CT preamble.
+ * @param *ct the CT request
+ * @param words maximum size of the response in words
+ */
+static void pt_setCTSize(void *ct, unsigned int words)
+{
+	unsigned char *p = ct;
+
+	p[PT_CT_SIZE_OFFSET] = words >> 8;
+	p[PT_CT_SIZE_OFFSET + 1] = words;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Send a CT request and return a response buffer of the right size.
+ * @param handle to an opened adapter
+ * @param *pReqBuffer pointer to CT frame
+ * @param ReqBufferSize size of the request buffer
+ * @param **ppRspBuffer returns the response, to be released with
+ *	ZFCP_FreePassThruBuffer()
+ * @param *pRspBufferSize returns the length of the response
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if an argument is invalid
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR if out of memory or the request could not be sent
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The first response buffer is sized by the maximum size of the request. If
+ * the request does not limit the size, the buffer is one page and the
+ * maximum size of the request is set to it, so the server reports a
+ * residual. If an accept reports a residual size, the response was
+ * truncated: the request is sent once more with its maximum size raised by
+ * the residual and a buffer that fits. The request buffer of the caller is
+ * not modified.
+ */
+HBA_STATUS ZFCP_SendCTPassThruAlloc(HBA_HANDLE handle, void *pReqBuffer,
+				    HBA_UINT32 ReqBufferSize,
+				    void **ppRspBuffer,
+				    HBA_UINT32 *pRspBufferSize)
+{
+	HBA_STATUS status;
+	HBA_UINT32 size, len;
+	unsigned int words, code;
+	unsigned char *req, *rsp = NULL;
+	int resend = 1;
+
+	if (!pReqBuffer || ReqBufferSize < PT_CT_PREAMBLE_SIZE ||
+	    !ppRspBuffer || !pRspBufferSize)
+		return HBA_STATUS_ERROR_ARG;
+
+	words = pt_getCTSize(pReqBuffer);
+	if (!words)
+		words = (VLIB_PT_ALIGN - PT_CT_PREAMBLE_SIZE) / 4;
+	size = PT_CT_PREAMBLE_SIZE + words * 4;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	req = sg_io_allocBuffer(ReqBufferSize);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	if (!req)
+		return HBA_STATUS_ERROR;
+	memcpy(req, pReqBuffer, ReqBufferSize);
+	/* without a maximum size, truncation would not be reported */
+	pt_setCTSize(req, words);
+
+	for (;;) {
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		rsp = sg_io_allocBuffer(size);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		if (!rsp) {
+			status = HBA_STATUS_ERROR;
+			break;
+		}
+
+		status = pt_sendCT(handle, req, ReqBufferSize, rsp, size, &len,
+				   CT_PASSTHRU_TIMEOUT);
+		if (status != HBA_STATUS_OK || !resend ||
+		    len < PT_CT_PREAMBLE_SIZE)
+			break;
+		code = (rsp[PT_CT_CMD_OFFSET] << 8) | rsp[PT_CT_CMD_OFFSET + 1];
+		if (code != CT_ACCEPT || !pt_getCTSize(rsp))
+			break;
+
+		/* truncated, resend once with room for the residual */
+		words = (size - PT_CT_PREAMBLE_SIZE) / 4 + pt_getCTSize(rsp);
+		if (words > 0xffff)
+			words = 0xffff;
+		size = PT_CT_PREAMBLE_SIZE + words * 4;
+		pt_setCTSize(req, words);
+		resend = 0;
+
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		sg_io_freeBuffer(rsp);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	}
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	sg_io_freeBuffer(req);
+	if (status != HBA_STATUS_OK) {
+		sg_io_freeBuffer(rsp);
+		rsp = NULL;
+		len = 0;
+	}
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	*ppRspBuffer = rsp;
+	*pRspBufferSize = len;
+
+	return status;
+}
+
+/**
+ * @brief Get the bsg device of an adapter and the D_ID of a port for an ELS.
+ * @param handle to an opened adapter
+ * @param wwn of the port, only used if *d_id is 0
+ * @param *d_id D_ID of the port, 0 to resolve it with resolveDid()
+ * @param *host returns the SCSI host of the adapter
+ * @param *fd returns the file descriptor of the bsg device, to be released
+ *	with pt_putELSFd()
+ * @return
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR if the caller is not root
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+static HBA_STATUS pt_getELSFd(HBA_HANDLE handle, wwn_t wwn, fc_id_t *d_id,
+			      unsigned short *host, int *fd)
+{
+	HBA_STATUS status;
+	struct vlib_adapter *adapter;
+
+	/* you need to be root to access /dev/* */
+	if (getuid())
+		return HBA_STATUS_ERROR;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter) {
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		return status;
+	}
+
+	if (!*d_id)
+		*d_id = resolveDid(adapter, wwn);
+
+	*fd = sg_io_getBsgFd(adapter);
+	*host = adapter->ident.host;
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return HBA_STATUS_OK;
+}
+
+/**
+ * @brief Release the bsg device used for an ELS.
+ * @param host SCSI host of the adapter
+ * @param fd file descriptor returned by pt_getELSFd()
+ * @param status result of the ELS
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+static void pt_putELSFd(unsigned short host, int fd, HBA_STATUS status)
+{
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	sg_io_putBsgFd(getAdapterByHostNo(host), fd, status);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+}
+
+/**
+ * @brief Send a RNID ELS to a port.
+ * @param handle to an opened adapter
+ * @param wwn of the port
+ * @param destFCID PortFcId of the port, 0 if unknown
+ * @param *pRspBuffer pointer to return response data
+ * @param *pRspBufferSize pointer to size of response buffer
+ * @param timeout in milliseconds
+ * @return see HBA_SendRNID()
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * A destFCID other than 0 is used as D_ID, otherwise the D_ID of the port is
+ * resolved with resolveDid().
+ */
+HBA_STATUS pt_sendRNID(HBA_HANDLE handle, HBA_WWN wwn, HBA_UINT32 destFCID,
+		       void *pRspBuffer, HBA_UINT32 *pRspBufferSize,
+		       unsigned int timeout)
+{
+	HBA_STATUS status;
+	wwn_t portwwn;
+	fc_id_t d_id;
+	unsigned short host;
+	int fd;
+
+	if (!pRspBuffer || *pRspBufferSize < 0)
+		return HBA_STATUS_ERROR_ARG;
+
+	vlib_HBA_WWN_to_wwn(&wwn, &portwwn);
+	d_id = destFCID ? vlib_hbaFCID_to_FCID(destFCID) : 0;
+	status = pt_getELSFd(handle, portwwn, &d_id, &host, &fd);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	status = sg_io_sendRNID(fd, d_id, pRspBuffer, *pRspBufferSize,
+				timeout);
+	pt_putELSFd(host, fd, status);
+
+	if (status == HBA_STATUS_ERROR_ELS_REJECT)
+		status = HBA_STATUS_OK;
+
+	return status;
+}
+
+/**
+ * @brief Send a RLS ELS to a port.
+ * @param handle to an opened adapter
+ * @param wwn of the port
+ * @param d_id D_ID of the port, 0 if unknown
+ * @param *pRspBuffer pointer to return response data
+ * @param *pRspBufferSize pointer to size of response buffer, returns the
+ *	length of the response
+ * @param timeout in milliseconds
+ * @return see HBA_SendRLS()
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+HBA_STATUS pt_sendRLS(HBA_HANDLE handle, HBA_WWN wwn, fc_id_t d_id,
+		      void *pRspBuffer, HBA_UINT32 *pRspBufferSize,
+		      unsigned int timeout)
+{
+	HBA_STATUS status;
+	wwn_t portwwn;
+	unsigned short host;
+	int fd;
+
+	if (!pRspBuffer || !pRspBufferSize)
+		return HBA_STATUS_ERROR_ARG;
+
+	vlib_HBA_WWN_to_wwn(&wwn, &portwwn);
+	status = pt_getELSFd(handle, portwwn, &d_id, &host, &fd);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	status = sg_io_sendRLS(fd, d_id, pRspBuffer, pRspBufferSize, timeout);
+	pt_putELSFd(host, fd, status);
+
+	return status;
+}
+
+/**
+ * @brief Send a RPS ELS to a port or domain controller.
+ * @param handle to an opened adapter
+ * @param agentWwn WWPN of the port to send RPS to, 0 for the domain
+ *	controller of agentDomain
+ * @param agentDomain domain of the domain controller
+ * @param objectWwn WWPN of the port in question, 0 to select it by
+ *	objectPort
+ * @param objectPort physical port number of the port in question
+ * @param *pRspBuffer pointer to return response data
+ * @param *pRspBufferSize pointer to size of response buffer, returns the
+ *	length of the response
+ * @param timeout in milliseconds
+ * @return see HBA_SendRPS()
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+HBA_STATUS pt_sendRPS(HBA_HANDLE handle, HBA_WWN agentWwn,
+		      HBA_UINT32 agentDomain, HBA_WWN objectWwn,
+		      HBA_UINT32 objectPort, void *pRspBuffer,
+		      HBA_UINT32 *pRspBufferSize, unsigned int timeout)
+{
+	HBA_STATUS status;
+	wwn_t agent, object;
+	fc_id_t d_id = 0;
+	unsigned short host;
+	int fd;
+
+	if (!pRspBuffer || !pRspBufferSize)
+		return HBA_STATUS_ERROR_ARG;
+
+	vlib_HBA_WWN_to_wwn(&agentWwn, &agent);
+	vlib_HBA_WWN_to_wwn(&objectWwn, &object);
+	if (!agent) {
+		/* no target port, so we pick the domain controller */
+		if (agentDomain == 0 || agentDomain > 0xef)
+			return HBA_STATUS_ERROR_ARG;
+		d_id = 0xfffc00 | agentDomain;
+	}
+
+	status = pt_getELSFd(handle, agent, &d_id, &host, &fd);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	status = sg_io_sendRPS(fd, d_id, object, objectPort, pRspBuffer,
+			       pRspBufferSize, timeout);
+	pt_putELSFd(host, fd, status);
+
+	return status;
+}
+
+/**
+ * @brief Get the next submitted request of a queue.
+ * @param *queue the queue
+ * @return
+ *	- NULL if the queue is stopped and all requests were started
+ *	- the request
+ * @par Locks:
+ *	lock/unlock of queue->lock
+ */
+static struct pt_request *pt_getRequest(struct ZFCP_PassThruQueue *queue)
+{
+	struct pt_request *req;
+
+	pthread_mutex_lock(&queue->lock);
+	while (!queue->first && !queue->stop)
+		pthread_cond_wait(&queue->cond, &queue->lock);
+
+	req = queue->first;
+	if (req) {
+		queue->first = req->next;
+		if (!queue->first)
+			queue->last = NULL;
+		req->next = NULL;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return req;
+}
+
+/**
+ * @brief Report the completion of a request.
+ * @param *queue the queue
+ * @param *req the completed request
+ * @par Locks:
+ *	lock/unlock of queue->lock
+ *
+ * The request is passed to its callback and freed, or else queued for
+ * ZFCP_GetPassThruCompletion(). The eventfd is updated under queue->lock,
+ * so its counter always matches the number of queued completions.
+ */
+static void pt_complete(struct ZFCP_PassThruQueue *queue,
+			struct pt_request *req)
+{
+	uint64_t one = 1;
+
+	if (req->callback) {
+		req->callback(req->context, req->status);
+		free(req);
+		return;
+	}
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->doneLast)
+		queue->doneLast->next = req;
+	else
+		queue->done = req;
+	queue->doneLast = req;
+	if (write(queue->fd, &one, sizeof(one)) < 0)
+		VLIB_PERROR(errno, "ERROR");
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Main function of the pass-thru worker threads.
+ * @param *arg the queue
+ */
+static void *pt_worker(void *arg)
+{
+	struct ZFCP_PassThruQueue *queue = arg;
+	struct pt_request *req;
+
+	while (req = pt_getRequest(queue)) {
+		switch (req->type) {
+		case PT_CT:
+			req->status = pt_sendCT(queue->handle, req->req,
+						req->reqSize, req->rsp,
+						req->rspSize, NULL,
+						req->timeout);
+			break;
+		case PT_RNID:
+			req->status = pt_sendRNID(queue->handle, req->wwn,
+						  req->fcid, req->rsp,
+						  &req->rspSize, req->timeout);
+			break;
+		case PT_RLS:
+			req->status = pt_sendRLS(queue->handle, req->wwn,
+						 req->fcid, req->rsp,
+						 &req->rspSize, req->timeout);
+			break;
+		}
+		pt_complete(queue, req);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Stop the workers of a queue and free it.
+ * @param *queue the queue
+ * @par Locks:
+ *	lock/unlock of queue->lock
+ *
+ * Requests submitted before are sent and completed first.
+ */
+static void pt_freeQueue(struct ZFCP_PassThruQueue *queue)
+{
+	struct pt_request *req;
+	unsigned int i;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->stop = 1;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+
+	for (i = 0; i < queue->nworkers; i++)
+		pthread_join(queue->workers[i], NULL);
+
+	while (req = queue->done) {
+		queue->done = req->next;
+		free(req);
+	}
+
+	close(queue->fd);
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue);
+}
+
+/**
+ * @brief Queue a request for the workers.
+ * @param *queue the queue
+ * @param *req the request
+ * @return
+ *	- HBA_STATUS_ERROR if the queue is being closed
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of queue->lock
+ */
+static HBA_STATUS pt_submit(struct ZFCP_PassThruQueue *queue,
+			    struct pt_request *req)
+{
+	pthread_mutex_lock(&queue->lock);
+	if (queue->stop) {
+		pthread_mutex_unlock(&queue->lock);
+		free(req);
+		return HBA_STATUS_ERROR;
+	}
+	if (queue->last)
+		queue->last->next = req;
+	else
+		queue->first = req;
+	queue->last = req;
+	pthread_cond_signal(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+
+	return HBA_STATUS_OK;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Open a queue for asynchronous CT and ELS pass-thru.
+ * @param handle to an opened adapter
+ * @param Depth maximal number of requests in flight, 0 for the default
+ * @param *pQueue returns the queue
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pQueue is NULL or Depth is too large
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR if out of memory or no threads could be created
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The queue starts one worker thread per request in flight. Up to
+ * PT_MAX_DEPTH requests can be in flight, PT_DEFAULT_DEPTH by default.
+ * The queue must be closed with ZFCP_ClosePassThruQueue().
+ */
+HBA_STATUS ZFCP_OpenPassThruQueue(HBA_HANDLE handle, HBA_UINT32 Depth,
+				  ZFCP_PASSTHRUQUEUE *pQueue)
+{
+	struct ZFCP_PassThruQueue *queue;
+	HBA_STATUS status;
+	unsigned int i;
+
+	if (!pQueue || Depth > PT_MAX_DEPTH)
+		return HBA_STATUS_ERROR_ARG;
+	if (Depth == 0)
+		Depth = PT_DEFAULT_DEPTH;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	getAdapterByHandle(handle, &status);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	queue = calloc(1, sizeof(*queue));
+	if (!queue) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	queue->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
+	if (queue->fd < 0) {
+		VLIB_PERROR(errno, "ERROR");
+		free(queue);
+		return HBA_STATUS_ERROR;
+	}
+	queue->handle = handle;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+
+	for (i = 0; i < Depth; i++) {
+		if (pthread_create(&queue->workers[i], NULL, pt_worker, queue))
+			break;
+		queue->nworkers++;
+	}
+	if (queue->nworkers == 0) {
+		pt_freeQueue(queue);
+		return HBA_STATUS_ERROR;
+	}
+
+	*pQueue = queue;
+
+	return HBA_STATUS_OK;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Submit a CT request to a pass-thru queue.
+ * @param queue opened with ZFCP_OpenPassThruQueue()
+ * @param *pReqBuffer pointer to CT frame
+ * @param ReqBufferSize size of the request buffer
+ * @param *pRspBuffer pointer to return response data
+ * @param RspBufferSize size of the response buffer
+ * @param Timeout in milliseconds, 0 for the default
+ * @param Callback called on completion, NULL to queue the completion for
+ *	ZFCP_GetPassThruCompletion()
+ * @param *Context passed on completion
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if a buffer is NULL
+ *	- HBA_STATUS_ERROR if out of memory or the queue is being closed
+ *	- HBA_STATUS_OK if the request was submitted
+ *
+ * The buffers must stay valid until the request completed. The completion
+ * status is the one of HBA_SendCTPassThru(). Callbacks are called from the
+ * worker threads.
+ */
+HBA_STATUS ZFCP_SubmitCTPassThru(ZFCP_PASSTHRUQUEUE queue, void *pReqBuffer,
+				 HBA_UINT32 ReqBufferSize, void *pRspBuffer,
+				 HBA_UINT32 RspBufferSize, HBA_UINT32 Timeout,
+				 ZFCP_PASSTHRUCALLBACK Callback,
+				 void *Context)
+{
+	struct pt_request *req;
+
+	if (!queue || !pReqBuffer || !pRspBuffer)
+		return HBA_STATUS_ERROR_ARG;
+
+	req = calloc(1, sizeof(*req));
+	if (!req) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	req->type = PT_CT;
+	req->req = pReqBuffer;
+	req->reqSize = ReqBufferSize;
+	req->rsp = pRspBuffer;
+	req->rspSize = RspBufferSize;
+	req->timeout = Timeout ? Timeout : CT_PASSTHRU_TIMEOUT;
+	req->callback = Callback;
+	req->context = Context;
+
+	return pt_submit(queue, req);
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Submit a RNID ELS to a pass-thru queue.
+ * @param queue opened with ZFCP_OpenPassThruQueue()
+ * @param destWWN of port to which to send RNID ELS
+ * @param destFCID PortFcId of that port, 0 if unknown
+ * @param *pRspBuffer pointer to return response data
+ * @param RspBufferSize size of the response buffer
+ * @param Timeout in milliseconds, 0 for the default
+ * @param Callback called on completion, NULL to queue the completion for
+ *	ZFCP_GetPassThruCompletion()
+ * @param *Context passed on completion
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pRspBuffer is NULL
+ *	- HBA_STATUS_ERROR if out of memory or the queue is being closed
+ *	- HBA_STATUS_OK if the request was submitted
+ *
+ * The completion status is the one of HBA_SendRNIDV2().
+ */
+HBA_STATUS ZFCP_SubmitRNID(ZFCP_PASSTHRUQUEUE queue, HBA_WWN destWWN,
+			   HBA_UINT32 destFCID, void *pRspBuffer,
+			   HBA_UINT32 RspBufferSize, HBA_UINT32 Timeout,
+			   ZFCP_PASSTHRUCALLBACK Callback, void *Context)
+{
+	struct pt_request *req;
+
+	if (!queue || !pRspBuffer)
+		return HBA_STATUS_ERROR_ARG;
+
+	req = calloc(1, sizeof(*req));
+	if (!req) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	req->type = PT_RNID;
+	req->wwn = destWWN;
+	req->fcid = destFCID;
+	req->rsp = pRspBuffer;
+	req->rspSize = RspBufferSize;
+	req->timeout = Timeout ? Timeout : ELS_RNID_TIMEOUT;
+	req->callback = Callback;
+	req->context = Context;
+
+	return pt_submit(queue, req);
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Get the file descriptor signalling completions of a queue.
+ * @param queue opened with ZFCP_OpenPassThruQueue()
+ * @return
+ *	- -1 if queue is NULL
+ *	- file descriptor, readable while completions are queued
+ *
+ * The descriptor can be used with poll() or select(). It must not be read
+ * or closed by the application.
+ */
+int ZFCP_GetPassThruQueueFd(ZFCP_PASSTHRUQUEUE queue)
+{
+	if (!queue)
+		return -1;
+
+	return queue->fd;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Collect a completed request of a queue.
+ * @param queue opened with ZFCP_OpenPassThruQueue()
+ * @param **pContext returns the context passed on submission
+ * @param *pStatus returns the completion status of the request
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if an argument is NULL
+ *	- HBA_STATUS_ERROR_TRY_AGAIN if no completion is queued
+ *	- HBA_STATUS_OK on success
+ * @par Locks:
+ *	lock/unlock of queue->lock
+ *
+ * Only requests submitted without callback are queued for this function.
+ */
+HBA_STATUS ZFCP_GetPassThruCompletion(ZFCP_PASSTHRUQUEUE queue,
+				      void **pContext, HBA_STATUS *pStatus)
+{
+	struct pt_request *req;
+	uint64_t val;
+
+	if (!queue || !pContext || !pStatus)
+		return HBA_STATUS_ERROR_ARG;
+
+	pthread_mutex_lock(&queue->lock);
+	req = queue->done;
+	if (!req) {
+		pthread_mutex_unlock(&queue->lock);
+		return HBA_STATUS_ERROR_TRY_AGAIN;
+	}
+	queue->done = req->next;
+	if (!queue->done)
+		queue->doneLast = NULL;
+	if (read(queue->fd, &val, sizeof(val)) < 0)
+		VLIB_PERROR(errno, "ERROR");
+	pthread_mutex_unlock(&queue->lock);
+
+	*pContext = req->context;
+	*pStatus = req->status;
+	free(req);
+
+	return HBA_STATUS_OK;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Close a pass-thru queue.
+ * @param queue opened with ZFCP_OpenPassThruQueue()
+ *
+ * Waits until all submitted requests completed. Completions not collected
+ * are dropped.
+ */
+void ZFCP_ClosePassThruQueue(ZFCP_PASSTHRUQUEUE queue)
+{
+	if (queue)
+		pt_freeQueue(queue);
+}
+
+/** @brief RLS sent to a port by ZFCP_GetLinkErrorStatus() */
+struct pt_rls {
+	HBA_STATUS status;		/**< @brief result of the RLS */
+	struct fc_els_rls_resp rsp;	/**< @brief response */
+};
+
+/**
+ * @brief Completion callback of a RLS sent by ZFCP_GetLinkErrorStatus().
+ * @param *context the struct pt_rls of the port
+ * @param status result of the RLS
+ */
+static void pt_rlsDone(void *context, HBA_STATUS status)
+{
+	struct pt_rls *rls = context;
+
+	rls->status = status;
+}
+
+/**
+ * @brief Queue a RLS to a port.
+ * @param queue the pass-thru queue
+ * @param wwn of the port
+ * @param d_id D_ID of the port
+ * @param *rls returns the response and the result
+ * @return see pt_submit()
+ */
+static HBA_STATUS pt_submitRLS(ZFCP_PASSTHRUQUEUE queue, HBA_WWN wwn,
+			       fc_id_t d_id, struct pt_rls *rls)
+{
+	struct pt_request *req;
+
+	req = calloc(1, sizeof(*req));
+	if (!req) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	req->type = PT_RLS;
+	req->wwn = wwn;
+	req->fcid = d_id;
+	req->rsp = &rls->rsp;
+	req->rspSize = sizeof(rls->rsp);
+	req->timeout = ELS_RLS_TIMEOUT;
+	req->callback = pt_rlsDone;
+	req->context = rls;
+
+	return pt_submit(queue, req);
+}
+
+/**
+ * @brief Fill in the link error counters of a port from a RLS response.
+ * @param *entry the port
+ * @param *rls the completed RLS
+ */
+static void pt_parseRLS(ZFCP_LINKERRORSTATUS *entry,
+			const struct pt_rls *rls)
+{
+	const struct fc_els_lesb *lesb = &rls->rsp.rls_lesb;
+
+	entry->Status = rls->status;
+	if (rls->status != HBA_STATUS_OK)
+		return;
+
+	entry->LinkFailureCount = ntohl(lesb->lesb_link_fail);
+	entry->LossOfSyncCount = ntohl(lesb->lesb_sync_loss);
+	entry->LossOfSignalCount = ntohl(lesb->lesb_sig_loss);
+	entry->PrimitiveSeqProtocolErrCount = ntohl(lesb->lesb_prim_err);
+	entry->InvalidTxWordCount = ntohl(lesb->lesb_inv_word);
+	entry->InvalidCRCCount = ntohl(lesb->lesb_inv_crc);
+}
+
+/**
+ * @brief List the remote ports of an adapter for a RLS sweep.
+ * @param handle to an opened adapter
+ * @param *pTable returns the ports, or the number of ports if there is not
+ *	enough space
+ * @return see ZFCP_GetLinkErrorStatus()
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ */
+static HBA_STATUS pt_listRLSPorts(HBA_HANDLE handle,
+				  ZFCP_LINKERRORTABLE *pTable)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	ZFCP_LINKERRORSTATUS *entry;
+	HBA_STATUS status;
+	HBA_UINT32 count = 0;
+	unsigned int i;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+
+	status = revalidateRepository();
+	if (HBA_STATUS_OK != status)
+		goto out;
+
+	adapter = getAdapterByHandle(handle, &status);
+	if (NULL == adapter)
+		goto out;
+
+	if (revalidatePorts(adapter) < 0) {
+		status = HBA_STATUS_ERROR;
+		goto out;
+	}
+
+	/* port->did is stale after a new login with another D_ID */
+	port = getPortByIndex(adapter, 0);
+	for (i = 0; port && i < adapter->ports.used; ++i, ++port) {
+		if (port->isInvalid || !sysfs_getPortDid(port))
+			continue;
+		if (count < pTable->NumberOfEntries) {
+			entry = &pTable->entry[count];
+			memset(entry, 0, sizeof(*entry));
+			vlib_wwn_to_HBA_WWN(port->wwpn, &entry->PortWWN);
+			entry->PortFcId = port->did;
+			entry->Status = HBA_STATUS_ERROR;
+		}
+		count++;
+	}
+
+	if (count > pTable->NumberOfEntries)
+		status = HBA_STATUS_ERROR_MORE_DATA;
+	pTable->NumberOfEntries = count;
+
+out:
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+
+	return status;
+}
+
+/** @ingroup ZfcpExtensions
+ * @brief Get the link error status of all remote ports of an adapter.
+ * @param handle to an opened adapter
+ * @param Depth maximal number of RLS in flight, 0 for the default
+ * @param *pTable returns the link error status of each port
+ * @return
+ *	- HBA_STATUS_ERROR_ARG if pTable is NULL or Depth is too large
+ *	- HBA_STATUS_ERROR_INVALID_HANDLE if handle is invalid
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if adapter is unavailable
+ *	- HBA_STATUS_ERROR_MORE_DATA if there is not enough space in pTable,
+ *	NumberOfEntries is set to the required number of entries
+ *	- HBA_STATUS_ERROR if out of memory or the caller is not root
+ *	- HBA_STATUS_OK on success, the result for each port is in its Status
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * A RLS is sent to each remote port of the adapter known to zfcp. The
+ * requests are sent concurrently through a pass-thru queue with up to Depth
+ * of them in flight, see ZFCP_OpenPassThruQueue(). Status of an entry is
+ * HBA_STATUS_ERROR_ELS_REJECT if the port rejected RLS; its counters are
+ * left zero.
+ */
+HBA_STATUS ZFCP_GetLinkErrorStatus(HBA_HANDLE handle, HBA_UINT32 Depth,
+				   ZFCP_LINKERRORTABLE *pTable)
+{
+	ZFCP_PASSTHRUQUEUE queue;
+	ZFCP_LINKERRORSTATUS *entry;
+	struct pt_rls *rls;
+	HBA_STATUS status;
+	HBA_UINT32 i;
+
+	if (!pTable || Depth > PT_MAX_DEPTH)
+		return HBA_STATUS_ERROR_ARG;
+
+	/* RLS is sent through the bsg device, which requires root */
+	if (getuid())
+		return HBA_STATUS_ERROR;
+
+	status = pt_listRLSPorts(handle, pTable);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	rls = calloc(pTable->NumberOfEntries ? pTable->NumberOfEntries : 1,
+		     sizeof(*rls));
+	if (!rls) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	status = ZFCP_OpenPassThruQueue(handle, Depth, &queue);
+	if (status != HBA_STATUS_OK) {
+		free(rls);
+		return status;
+	}
+
+	for (i = 0; i < pTable->NumberOfEntries; i++) {
+		entry = &pTable->entry[i];
+		rls[i].status = HBA_STATUS_ERROR;
+		pt_submitRLS(queue, entry->PortWWN, entry->PortFcId, &rls[i]);
+	}
+
+	/* waits for all requests */
+	ZFCP_ClosePassThruQueue(queue);
+
+	for (i = 0; i < pTable->NumberOfEntries; i++)
+		pt_parseRLS(&pTable->entry[i], &rls[i]);
+
+	free(rls);
+
+	return HBA_STATUS_OK;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright IBM Corp. 2010
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.ibm.com/developerworks/library/os-cpl.html
+ *
+ * File:		vlib_passthru.h
+ *
+ * Description:
+ * Function declarations for CT and ELS pass-thru
+ *
+ */
+
+#ifndef _VLIB_PASSTHRU_H_
+#define _VLIB_PASSTHRU_H_
+
+/** @brief Default number of requests in flight per pass-thru queue */
+#define PT_DEFAULT_DEPTH	8
+/** @brief Maximal number of requests in flight per pass-thru queue */
+#define PT_MAX_DEPTH		64
+
+HBA_STATUS pt_sendCT(HBA_HANDLE, void *, HBA_UINT32, void *, HBA_UINT32,
+		     HBA_UINT32 *, unsigned int);
+HBA_STATUS pt_sendRNID(HBA_HANDLE, HBA_WWN, HBA_UINT32, void *, HBA_UINT32 *,
+		       unsigned int);
+HBA_STATUS pt_sendRLS(HBA_HANDLE, HBA_WWN, fc_id_t, void *, HBA_UINT32 *,
+		      unsigned int);
+HBA_STATUS pt_sendRPS(HBA_HANDLE, HBA_WWN, HBA_UINT32, HBA_WWN, HBA_UINT32,
+		      void *, HBA_UINT32 *, unsigned int);
+
+#endif /*_VLIB_PASSTHRU_H_*/
@@ -54,3 +54,43 @@ int sfhelper_getProperty(char *dir, char *name, char *result)
 		result[strlen(result) - 1] = '\0';
 	return 0;
 }
+
+int sfhelper_openDirAt(int dirfd, char *name)
+{
+	return openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+int sfhelper_getPropertyAt(int dirfd, char *name, char *result)
+{
+	ssize_t len;
+	int fd;
+
+	fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	len = read(fd, result, ATTR_MAX - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+	result[len] = '\0';
+	if (len && result[len - 1] == '\n')
+		result[len - 1] = '\0';
+	return 0;
+}
+
+int sfhelper_setProperty(char *dir, char *name, char *value)
+{
+	char path[PATH_MAX];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, PATH_MAX, "%s/%s", dir, name);
+
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	len = write(fd, value, strlen(value));
+	if (close(fd) < 0 || len != (ssize_t)strlen(value))
+		return -1;
+	return 0;
+}
@@ -24,5 +24,8 @@ sfhelper_dir *sfhelper_opendir(char *);
 void sfhelper_closedir(sfhelper_dir *);
 char *sfhelper_getNextDirEnt(sfhelper_dir *);
 int sfhelper_getProperty(char *, char *, char *);
+int sfhelper_openDirAt(int, char *);
+int sfhelper_getPropertyAt(int, char *, char *);
+int sfhelper_setProperty(char *, char *, char *);
 
 #endif /*VLIB_SFHELPER_H_*/
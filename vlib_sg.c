@@ -10,156 +10,913 @@
  * File:		vlib_sg.c
  *
  * Description:
- * All calls that use sg_utils library.
+ * SCSI commands sent to units, the sg fd cache and the INQUIRY cache.
  *
  */
  
  /**
  * @file vlib_sg.c
- * @brief All calls that use sg_utils library.
+ * @brief SCSI commands sent to units, the sg fd cache and the INQUIRY cache.
  */
 
 #include "vlib.h"
 
+#include <sys/sysmacros.h>
+
 #define INTERVAL	10000000
-#define RETRIES		1500
+#define RETRIES		100
 
-HBA_STATUS sgutils_SendScsiInquiry(char* sg_dev, HBA_UINT8 EVPD, 
-				HBA_UINT32 PageCode, void *pRspBuffer,
-				HBA_UINT32 *RspBufferSize)
+/**
+ * @brief Look up the cache slot holding the sg device of a unit.
+ * @param *unit the unit
+ * @return
+ *	- NULL if no file descriptor is cached for the unit
+ *	- pointer to the cache slot
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * A slot is only valid for the unit if it still refers to the same SCSI
+ * device and sg device name, since the slot might have been evicted and
+ * reused for another unit in the meantime.
+ */
+static struct vlib_sg_fd *getCachedFd(struct vlib_unit *unit)
 {
-	char dev_path[32];
-	int sg_fd, res;
+	struct vlib_sg_fd_cache *cache = &vlib_data.sg_fd_cache;
+	struct vlib_sg_fd *slot;
+
+	if (!cache->slots || unit->sg_fd_slot == 0 ||
+	    unit->sg_fd_slot > cache->size)
+		return NULL;
 
-	if(sg_dev == NULL)
-		return HBA_STATUS_ERROR;
+	slot = &cache->slots[unit->sg_fd_slot - 1];
+	if (slot->fd < 0 || slot->host != unit->host ||
+	    slot->channel != unit->channel || slot->target != unit->target ||
+	    slot->lun != unit->lun || strcmp(slot->sg_dev, unit->sg_dev) != 0)
+		return NULL;
 
-	strcpy(dev_path, "/dev/");
-	strcat(dev_path, sg_dev);
+	return slot;
+}
 
-	sg_fd = sg_cmds_open_device(dev_path, 0, 0);
-	if (sg_fd < 0)
-		return HBA_STATUS_ERROR;
-	memset(pRspBuffer, 0x0, *RspBufferSize);
-	res = sg_ll_inquiry(sg_fd, 0, EVPD, PageCode, pRspBuffer,
-							*RspBufferSize, 0, 0);
-	if(res < 0) {
-		sg_cmds_close_device(sg_fd);
-		return HBA_STATUS_ERROR;
+/**
+ * @brief Get a free cache slot, evicting the least recently used one if the
+ *	cache is full.
+ * @return
+ *	- NULL if the cache could not be allocated
+ *	- pointer to an unused cache slot
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+static struct vlib_sg_fd *getFreeFdSlot(void)
+{
+	struct vlib_sg_fd_cache *cache = &vlib_data.sg_fd_cache;
+	struct vlib_sg_fd *slot, *lru = NULL;
+	unsigned int i;
+
+	if (!cache->slots) {
+		cache->slots = calloc(cache->size, sizeof(struct vlib_sg_fd));
+		if (!cache->slots) {
+			VLIB_PERROR(ENOMEM, "ERROR");
+			return NULL;
+		}
+		for (i = 0; i < cache->size; i++)
+			cache->slots[i].fd = -1;
 	}
 
-	res = sg_cmds_close_device(sg_fd);
-	if(res < 0)
-		return HBA_STATUS_ERROR;
+	for (i = 0, slot = cache->slots; i < cache->size; i++, slot++) {
+		if (slot->fd < 0)
+			return slot;
+		if (!lru || slot->lastUse < lru->lastUse)
+			lru = slot;
+	}
 
-	return HBA_STATUS_OK;
+	close(lru->fd);
+	lru->fd = -1;
+
+	return lru;
 }
 
-HBA_STATUS sgutils_SendReportLUNs(char* sg_dev, char *pRspBuffer,
-				HBA_UINT32 *RspBufferSize)
+/**
+ * @brief Get a file descriptor for the sg device of a unit.
+ * @param *unit the unit
+ * @return
+ *	- -1 on error
+ *	- file descriptor on success, to be closed by the caller
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The sg device is opened only once and kept open in the sg fd cache. The
+ * caller gets a duplicate of the cached descriptor, so it can use it without
+ * holding vlib_data.mutex even if the cache entry is evicted meanwhile.
+ * If the cache is disabled (size 0), the device is opened directly.
+ */
+int sgutils_getUnitFd(struct vlib_unit *unit)
 {
-	int sg_fd, res, count = 0;
+	struct vlib_sg_fd_cache *cache = &vlib_data.sg_fd_cache;
+	struct vlib_sg_fd *slot;
 	char dev_path[32];
-	struct timespec t;
-	int size;
-	HBA_STATUS status;
+	int sg_fd;
+
+	if (unit->sg_dev[0] == '\0')
+		return -1;
+
+	slot = getCachedFd(unit);
+	if (slot) {
+		slot->lastUse = ++cache->clock;
+		return dup(slot->fd);
+	}
+
+	/* prefer the bsg device, commands can use the version 4 interface */
+	snprintf(dev_path, sizeof(dev_path), "/dev/bsg/%u:%u:%u:%u",
+		 unit->host, unit->channel, unit->target, unit->lun);
+	sg_fd = open(dev_path, O_RDWR | O_CLOEXEC);
+	if (sg_fd < 0) {
+		snprintf(dev_path, sizeof(dev_path), "/dev/%s", unit->sg_dev);
+		sg_fd = open(dev_path, O_RDWR | O_CLOEXEC);
+	}
+	if (sg_fd < 0 || cache->size == 0)
+		return sg_fd;
 
-	status = HBA_STATUS_OK;
+	slot = getFreeFdSlot();
+	if (!slot)
+		return sg_fd;
 
-	strcpy(dev_path, "/dev/");
-	if(sg_dev == NULL)
-		return HBA_STATUS_ERROR;
+	slot->fd = sg_fd;
+	slot->host = unit->host;
+	slot->channel = unit->channel;
+	slot->target = unit->target;
+	slot->lun = unit->lun;
+	strcpy(slot->sg_dev, unit->sg_dev);
+	slot->lastUse = ++cache->clock;
+	unit->sg_fd_slot = slot - cache->slots + 1;
 
-	strcat(dev_path, sg_dev);
+	return dup(sg_fd);
+}
+
+/**
+ * @brief Get a file descriptor for the sg device of a freshly attached unit.
+ * @param *unit copy of the unit
+ * @return
+ *	- -1 on error
+ *	- file descriptor on success, to be closed by the caller
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex
+ *
+ * The caller already waited for the kernel to create the sg device (see
+ * sysfs_waitForSgDev()), but the device node might be created by udev a
+ * bit later, so opening it is retried for a short time. The mutex is not
+ * held while waiting.
+ */
+int sgutils_waitForUnitFd(struct vlib_unit *unit)
+{
+	struct timespec t;
+	int sg_fd, count = 0;
 
 	t.tv_nsec = INTERVAL;
 	t.tv_sec = 0;
-	sg_fd = sg_cmds_open_device(dev_path, 0, 0);
-	while (sg_fd < 0 && count < RETRIES) {
+	while (1) {
+		VLIB_MUTEX_LOCK(&vlib_data.mutex);
+		sg_fd = sgutils_getUnitFd(unit);
+		VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+		if (sg_fd >= 0 || count++ >= RETRIES)
+			break;
 		nanosleep(&t, NULL);
-		sg_fd = sg_cmds_open_device(dev_path, 0, 0);
-		count++;
 	}
-	if (sg_fd < 0)
-		return HBA_STATUS_ERROR;
 
-	memset(pRspBuffer, 0x0, *RspBufferSize);
-	res = sg_ll_report_luns(sg_fd, 0, pRspBuffer, *RspBufferSize, 0, 0);
-	if(res < 0) {
-		sg_cmds_close_device(sg_fd);
-		return HBA_STATUS_ERROR;
+	return sg_fd;
+}
+
+/**
+ * @brief Release a file descriptor obtained with sgutils_getUnitFd().
+ * @param sg_fd the file descriptor
+ * @param *unit copy of the unit the descriptor belongs to
+ * @param status result of the SCSI command sent using the descriptor
+ * @par Locks:
+ *	lock/unlock of vlib_data.mutex if the command failed
+ *
+ * If the command failed, the cached descriptor is dropped as well, so the
+ * next command reopens the sg device.
+ */
+void sgutils_putUnitFd(int sg_fd, struct vlib_unit *unit, HBA_STATUS status)
+{
+	if (sg_fd >= 0)
+		close(sg_fd);
+
+	if (status != HBA_STATUS_ERROR)
+		return;
+
+	VLIB_MUTEX_LOCK(&vlib_data.mutex);
+	sgutils_invalidateUnits(unit->host, unit->channel, unit->target,
+				unit->lun);
+	VLIB_MUTEX_UNLOCK(&vlib_data.mutex);
+}
+
+/**
+ * @brief Drop cached INQUIRY responses.
+ * @param host SCSI host of the units, -1 matches all
+ * @param channel SCSI channel of the units, -1 matches all
+ * @param target SCSI id of the units, -1 matches all
+ * @param lun SCSI LUN of the units, -1 matches all
+ * @par Locks:
+ *	vlib_data.inquiry_cache.mutex must be held
+ */
+static void invalidateInquiries(int host, int channel, int target, int lun)
+{
+	struct vlib_inquiry_cache *cache = &vlib_data.inquiry_cache;
+	struct vlib_inquiry *slot;
+	struct vlib_scsi_addr *addr = NULL;
+	unsigned int i;
+
+	cache->generation++;
+
+	/* note the units for sgutils_updateLuids() */
+	if (host >= 0 && !cache->allChanged &&
+	    cache->changed.used < VLIB_MAX_CHANGED)
+		addr = block_addItem(&cache->changed, sizeof(*addr),
+				     VLIB_MAX_CHANGED);
+	if (addr) {
+		addr->host = host;
+		addr->channel = channel;
+		addr->target = target;
+		addr->lun = lun;
+	} else {
+		cache->allChanged = 1;
 	}
+	if (!cache->slots)
+		return;
 
-	size = ((pRspBuffer[0] << 24) | (pRspBuffer[1] << 16) |
-					(pRspBuffer[2] << 8) | pRspBuffer[3]);
+	for (i = 0, slot = cache->slots; i < VLIB_INQUIRY_CACHE_SIZE;
+	     i++, slot++) {
+		if (!slot->data)
+			continue;
+		if ((host >= 0 && slot->host != host) ||
+		    (channel >= 0 && slot->channel != channel) ||
+		    (target >= 0 && slot->target != target) ||
+		    (lun >= 0 && slot->lun != lun))
+			continue;
+		free(slot->data);
+		slot->data = NULL;
+	}
+}
 
-	/* size is size of payload, total response size is 8 bytes larger
-	 * because of the header */
-	if (*RspBufferSize < (size + 8))
-		status = HBA_STATUS_ERROR_MORE_DATA;
-	else
-		*RspBufferSize = size + 8;
+/**
+ * @brief Close cached sg file descriptors and drop cached INQUIRY responses.
+ * @param host SCSI host of the units
+ * @param channel SCSI channel of the units, -1 matches all
+ * @param target SCSI id of the units, -1 matches all
+ * @param lun SCSI LUN of the units, -1 matches all
+ * @par Locks:
+ *	vlib_data.mutex must be held,
+ *	lock/unlock of vlib_data.inquiry_cache.mutex
+ *
+ * This is called if units, remote ports or adapters go away or if a command
+ * failed on a cached descriptor.
+ */
+void sgutils_invalidateUnits(unsigned int host, int channel, int target,
+			     int lun)
+{
+	struct vlib_sg_fd_cache *cache = &vlib_data.sg_fd_cache;
+	struct vlib_sg_fd *slot;
+	unsigned int i;
 
-	res = sg_cmds_close_device(sg_fd);
-	if(res < 0)
-		return HBA_STATUS_ERROR;
+	VLIB_MUTEX_LOCK(&vlib_data.inquiry_cache.mutex);
+	invalidateInquiries(host, channel, target, lun);
+	VLIB_MUTEX_UNLOCK(&vlib_data.inquiry_cache.mutex);
 
-	return status;
+	if (!cache->slots)
+		return;
+
+	for (i = 0, slot = cache->slots; i < cache->size; i++, slot++) {
+		if (slot->fd < 0 || slot->host != host)
+			continue;
+		if ((channel >= 0 && slot->channel != channel) ||
+		    (target >= 0 && slot->target != target) ||
+		    (lun >= 0 && slot->lun != lun))
+			continue;
+		close(slot->fd);
+		slot->fd = -1;
+	}
 }
 
-HBA_STATUS sgutils_SendReadCap(char* sg_dev, char *pRspBuffer,
-				HBA_UINT32 *RspBufferSize)
+/**
+ * @brief Close all cached sg file descriptors and free the cache.
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+void sgutils_freeFdCache(void)
 {
-	char dev_path[32];
-	int sg_fd, res, blocks;
-	HBA_STATUS status;
+	struct vlib_sg_fd_cache *cache = &vlib_data.sg_fd_cache;
+	unsigned int i;
+
+	if (!cache->slots)
+		return;
 
-	status = HBA_STATUS_OK;
+	for (i = 0; i < cache->size; i++)
+		if (cache->slots[i].fd >= 0)
+			close(cache->slots[i].fd);
+
+	free(cache->slots);
+	cache->slots = NULL;
+}
+
+/**
+ * @brief Read pending uevents and drop the INQUIRY responses of units they
+ *	refer to.
+ * @par Locks:
+ *	vlib_data.inquiry_cache.mutex must be held
+ *
+ * Events of SCSI devices drop the responses of the device, events of SCSI
+ * targets and remote ports drop the responses of all their units. If
+ * uevents were lost, all responses are dropped. The LUIDs of the units are
+ * dropped by the next sgutils_updateLuids().
+ */
+static void readInquiryUevents(void)
+{
+	struct vlib_inquiry_cache *cache = &vlib_data.inquiry_cache;
+	unsigned int host, channel, target, lun;
+	char buf[4096], *name;
+	ssize_t len;
+	int n;
 
-	if(sg_dev == NULL)
-		return HBA_STATUS_ERROR;
-	
-	strcpy(dev_path, "/dev/");
-	strcat(dev_path, sg_dev);
+	if (cache->uevent_fd < 0)
+		return;
 
-	sg_fd = sg_cmds_open_device(dev_path, 0, 0);
-	if (sg_fd < 0)
-		return HBA_STATUS_ERROR;
+	while (1) {
+		len = recv(cache->uevent_fd, buf, sizeof(buf) - 1, 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS)
+				invalidateInquiries(-1, -1, -1, -1);
+			return;
+		}
+		buf[len] = '\0';
 
-	memset(pRspBuffer, 0x0, *RspBufferSize);
-	res = sg_ll_readcap_10(sg_fd, 0, 0, pRspBuffer, READCAP10LEN, 0, 0);
-	if(res < 0) {
-		sg_cmds_close_device(sg_fd);
-		return HBA_STATUS_ERROR;
+		/* "action@devpath", followed by the environment */
+		name = strrchr(buf, '/');
+		if (!strchr(buf, '@') || !name)
+			continue;
+		name++;
+
+		n = 0;
+		if (sscanf(name, "%u:%u:%u:%u%n", &host, &channel, &target,
+			   &lun, &n) == 4 && name[n] == '\0')
+			invalidateInquiries(host, channel, target, lun);
+		else if (sscanf(name, "target%u:%u:%u%n", &host, &channel,
+				&target, &n) == 3 && name[n] == '\0')
+			invalidateInquiries(host, channel, target, -1);
+		else if (sscanf(name, "rport-%u:%u-%*u%n", &host, &channel,
+				&n) == 2 && name[n] == '\0')
+			invalidateInquiries(host, channel, -1, -1);
 	}
+}
 
-	blocks = ((pRspBuffer[0] << 24) | (pRspBuffer[1] << 16) |
-					(pRspBuffer[2] << 8) | pRspBuffer[3]);
+/**
+ * @brief Get the length of a complete INQUIRY response.
+ * @param evpd EVPD bit of the command
+ * @param *data response data
+ * @param len length of the response data
+ * @return
+ *	- 0 if the response is too short to tell
+ *	- length of the complete response
+ */
+static HBA_UINT32 inquiryLength(HBA_UINT8 evpd, const unsigned char *data,
+				HBA_UINT32 len)
+{
+	if (evpd)
+		return len < 4 ? 0 : 4 + ((data[2] << 8) | data[3]);
 
-	*RspBufferSize = READCAP10LEN;
-	if (blocks != 0xffffffff)
-		/* device smaller than 0xffffffff blocks, reply ok */
-		return HBA_STATUS_OK;
+	return len < 5 ? 0 : 5 + data[4];
+}
 
-	/* device larger than 0xffffffff, readcap16 necessary */
-	if (*RspBufferSize < READCAP16LEN) {
-		/* buffer too small to hold the smallest response */
-		status = HBA_STATUS_ERROR_MORE_DATA;
+/**
+ * @brief Copy an INQUIRY response of a unit from the INQUIRY cache.
+ * @param *unit the unit
+ * @param EVPD EVPD bit of the command
+ * @param PageCode VPD page code
+ * @param *pRspBuffer buffer for the response
+ * @param *RspBufferSize size of the buffer, returns length of the response
+ * @param *generation returns the cache generation to be passed to
+ *	sgutils_cacheInquiry()
+ * @return
+ *	- 0 if the response was copied from the cache
+ *	- -1 if the command has to be sent to the unit
+ * @par Locks:
+ *	lock/unlock of vlib_data.inquiry_cache.mutex
+ *
+ * The response is copied if it has not expired and if it fills the buffer
+ * like the unit would, i.e. it is complete or the buffer is not larger than
+ * the cached response.
+ */
+int sgutils_getCachedInquiry(struct vlib_unit *unit, HBA_UINT8 EVPD,
+			     HBA_UINT32 PageCode, void *pRspBuffer,
+			     HBA_UINT32 *RspBufferSize,
+			     unsigned long *generation)
+{
+	struct vlib_inquiry_cache *cache = &vlib_data.inquiry_cache;
+	struct vlib_inquiry *slot;
+	time_t now = time(NULL);
+	unsigned int i;
+	int ret = -1;
+
+	VLIB_MUTEX_LOCK(&cache->mutex);
+
+	readInquiryUevents();
+	*generation = cache->generation;
+
+	if (!cache->slots)
+		goto out;
+
+	for (i = 0, slot = cache->slots; i < VLIB_INQUIRY_CACHE_SIZE;
+	     i++, slot++) {
+		if (!slot->data || slot->host != unit->host ||
+		    slot->channel != unit->channel ||
+		    slot->target != unit->target || slot->lun != unit->lun ||
+		    slot->fcLun != unit->fcLun || slot->evpd != EVPD ||
+		    slot->page != PageCode)
+			continue;
+
+		if (slot->expires <= now) {
+			free(slot->data);
+			slot->data = NULL;
+			break;
+		}
+		if (!slot->complete && *RspBufferSize > slot->len)
+			break;
+
+		*RspBufferSize = min(*RspBufferSize, slot->len);
+		memcpy(pRspBuffer, slot->data, *RspBufferSize);
+		slot->lastUse = ++cache->clock;
+		ret = 0;
+		break;
+	}
+
+out:
+	VLIB_MUTEX_UNLOCK(&cache->mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Store an INQUIRY response of a unit in the INQUIRY cache.
+ * @param *unit copy of the unit
+ * @param generation cache generation returned by sgutils_getCachedInquiry()
+ *	before the command was sent
+ * @param EVPD EVPD bit of the command
+ * @param PageCode VPD page code
+ * @param *pRspBuffer response data
+ * @param RspBufferSize length of the response data
+ * @par Locks:
+ *	lock/unlock of vlib_data.inquiry_cache.mutex
+ *
+ * If the cache was invalidated while the command was in flight, the response
+ * might be stale already and is not stored. Responses are only cached if
+ * changes of units can be detected using uevents.
+ */
+void sgutils_cacheInquiry(struct vlib_unit *unit, unsigned long generation,
+			  HBA_UINT8 EVPD, HBA_UINT32 PageCode,
+			  const void *pRspBuffer, HBA_UINT32 RspBufferSize)
+{
+	struct vlib_inquiry_cache *cache = &vlib_data.inquiry_cache;
+	struct vlib_inquiry *slot, *lru = NULL;
+	HBA_UINT32 full;
+	unsigned int i;
+
+	full = inquiryLength(EVPD, pRspBuffer, RspBufferSize);
+	if (cache->ttl == 0 || full == 0 || RspBufferSize > VLIB_INQUIRY_MAXLEN)
+		return;
+
+	VLIB_MUTEX_LOCK(&cache->mutex);
+
+	readInquiryUevents();
+	if (generation != cache->generation)
 		goto out;
+
+	if (!cache->slots) {
+		if (cache->uevent_fd < 0)
+			cache->uevent_fd = sysfs_openUevents();
+		if (cache->uevent_fd < 0)
+			goto out;
+		cache->slots = calloc(VLIB_INQUIRY_CACHE_SIZE,
+				      sizeof(struct vlib_inquiry));
+		if (!cache->slots) {
+			VLIB_PERROR(ENOMEM, "ERROR");
+			goto out;
+		}
 	}
 
-	*RspBufferSize = READCAP16LEN;
+	for (i = 0, slot = cache->slots; i < VLIB_INQUIRY_CACHE_SIZE;
+	     i++, slot++) {
+		if (slot->data && slot->host == unit->host &&
+		    slot->channel == unit->channel &&
+		    slot->target == unit->target && slot->lun == unit->lun &&
+		    slot->fcLun == unit->fcLun && slot->evpd == EVPD &&
+		    slot->page == PageCode) {
+			lru = slot;
+			break;
+		}
+		/* prefer unused slots, then the least recently used one */
+		if (!lru || (lru->data &&
+			     (!slot->data || slot->lastUse < lru->lastUse)))
+			lru = slot;
+	}
 
-	res = sg_ll_readcap_16(sg_fd, 0, 0, pRspBuffer, READCAP10LEN, 0, 0);
-	if(res < 0) {
-		sg_cmds_close_device(sg_fd);
-		return HBA_STATUS_ERROR;
+	slot = lru;
+	free(slot->data);
+	slot->data = malloc(RspBufferSize);
+	if (!slot->data) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		goto out;
 	}
 
+	memcpy(slot->data, pRspBuffer, RspBufferSize);
+	slot->len = RspBufferSize;
+	slot->complete = RspBufferSize >= full;
+	slot->host = unit->host;
+	slot->channel = unit->channel;
+	slot->target = unit->target;
+	slot->lun = unit->lun;
+	slot->fcLun = unit->fcLun;
+	slot->evpd = EVPD;
+	slot->page = PageCode;
+	slot->expires = time(NULL) + cache->ttl;
+	slot->lastUse = ++cache->clock;
+
 out:
-	res = sg_cmds_close_device(sg_fd);
-	if(res < 0)
-		return HBA_STATUS_ERROR;
+	VLIB_MUTEX_UNLOCK(&cache->mutex);
+}
+
+/**
+ * @brief Test if a unit matches a SCSI address.
+ * @param *unit the unit
+ * @param *addr the address, -1 matches all
+ * @return
+ *	- 0 if the unit does not match
+ *	- 1 if the unit matches
+ */
+static int unitMatches(const struct vlib_unit *unit,
+		       const struct vlib_scsi_addr *addr)
+{
+	return unit->host == addr->host &&
+	       (addr->channel < 0 || unit->channel == addr->channel) &&
+	       (addr->target < 0 || unit->target == addr->target) &&
+	       (addr->lun < 0 || unit->lun == addr->lun);
+}
+
+/**
+ * @brief Drop the LUIDs of units that changed.
+ * @par Locks:
+ *	vlib_data.mutex must be held,
+ *	lock/unlock of vlib_data.inquiry_cache.mutex
+ *
+ * Pending uevents are read first. Only the LUIDs of units noted by
+ * invalidateInquiries() are dropped, their luidEpoch is incremented so a
+ * LUID harvested meanwhile is not stored. Without a uevent socket, changes
+ * are only noticed through failed commands and unit attentions.
+ */
+void sgutils_updateLuids(void)
+{
+	struct vlib_inquiry_cache *cache = &vlib_data.inquiry_cache;
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	struct vlib_unit *unit;
+	struct vlib_scsi_addr *addr;
+	struct block changed;
+	unsigned int a, p, u, i;
+	int all;
+
+	VLIB_MUTEX_LOCK(&cache->mutex);
+	if (cache->uevent_fd < 0)
+		cache->uevent_fd = sysfs_openUevents();
+	readInquiryUevents();
+	changed = cache->changed;
+	all = cache->allChanged;
+	memset(&cache->changed, 0, sizeof(cache->changed));
+	cache->allChanged = 0;
+	VLIB_MUTEX_UNLOCK(&cache->mutex);
+
+	if (!all && !changed.used)
+		return;
+
+	adapter = getAdapterByIndex(0);
+	for (a = 0; adapter && a < vlib_data.adapters.used; a++, adapter++) {
+		port = getPortByIndex(adapter, 0);
+		for (p = 0; port && p < adapter->ports.used; p++, port++) {
+			unit = getUnitByIndex(port, 0);
+			for (u = 0; unit && u < port->units.used;
+			     u++, unit++) {
+				addr = changed.data;
+				for (i = 0; !all && i < changed.used;
+				     i++, addr++)
+					if (unitMatches(unit, addr))
+						break;
+				if (!all && i == changed.used)
+					continue;
+				unit->luidValid = 0;
+				unit->luidEpoch++;
+			}
+		}
+	}
+
+	block_free(&changed);
+}
+
+/**
+ * @brief Get the sense key of sense data.
+ * @param *sense sense data
+ * @param senseLen length of the sense data
+ * @return
+ *	- -1 if the sense data is missing or of an unknown format
+ *	- the sense key
+ */
+int sgutils_getSenseKey(const void *sense, HBA_UINT32 senseLen)
+{
+	const unsigned char *s = sense;
+
+	if (!s || senseLen < 3)
+		return -1;
+
+	if ((s[0] & 0x7f) == 0x72 || (s[0] & 0x7f) == 0x73)
+		return s[1] & 0xf;		/* descriptor format */
+	if ((s[0] & 0x7f) == 0x70 || (s[0] & 0x7f) == 0x71)
+		return s[2] & 0xf;		/* fixed format */
+
+	return -1;
+}
+
+/**
+ * @brief Drop the cached INQUIRY responses of a unit which reported a unit
+ *	attention.
+ * @param sg_fd file descriptor the command was sent with
+ * @param *sense sense data of the command
+ * @param senseLen length of the sense data
+ * @par Locks:
+ *	lock/unlock of vlib_data.inquiry_cache.mutex if the sense data reports
+ *	a unit attention
+ *
+ * A unit attention indicates for example changed INQUIRY data, changed
+ * parameters or a reset of the unit. The unit is found by the sysfs path of
+ * the device node, so this also works if vlib_data.mutex is held.
+ */
+void sgutils_checkUnitAttention(int sg_fd, const void *sense,
+				HBA_UINT32 senseLen)
+{
+	unsigned int host, channel, target, lun;
+	char path[64], link[PATH_MAX], *name;
+	struct stat st;
+	ssize_t len;
+	int n;
+
+	if (sgutils_getSenseKey(sense, senseLen) != SCSI_UNIT_ATTENTION)
+		return;
+
+	if (fstat(sg_fd, &st) < 0 || !S_ISCHR(st.st_mode))
+		return;
+
+	snprintf(path, sizeof(path), "/sys/dev/char/%u:%u",
+		 major(st.st_rdev), minor(st.st_rdev));
+	len = readlink(path, link, sizeof(link) - 1);
+	if (len < 0)
+		return;
+	link[len] = '\0';
+
+	/* the SCSI device is the first "H:C:T:L" component of the path */
+	for (name = strtok(link, "/"); name; name = strtok(NULL, "/")) {
+		n = 0;
+		if (sscanf(name, "%u:%u:%u:%u%n", &host, &channel, &target,
+			   &lun, &n) == 4 && name[n] == '\0')
+			break;
+	}
+	if (!name)
+		return;
+
+	VLIB_MUTEX_LOCK(&vlib_data.inquiry_cache.mutex);
+	invalidateInquiries(host, channel, target, lun);
+	VLIB_MUTEX_UNLOCK(&vlib_data.inquiry_cache.mutex);
+}
+
+/**
+ * @brief Test if a CDB cannot change INQUIRY data or the identity of a unit.
+ * @param *cdb the command descriptor block
+ * @return
+ *	- 0 if the command might change the unit
+ *	- 1 if the command is known to only read
+ */
+int sgutils_isReadOnlyCdb(const unsigned char *cdb)
+{
+	switch (cdb[0]) {
+	case 0x00:				/* TEST UNIT READY */
+	case 0x03:				/* REQUEST SENSE */
+	case 0x08:				/* READ(6) */
+	case 0x12:				/* INQUIRY */
+	case 0x1a:				/* MODE SENSE(6) */
+	case 0x1c:				/* RECEIVE DIAGNOSTIC RESULTS */
+	case 0x25:				/* READ CAPACITY(10) */
+	case 0x28:				/* READ(10) */
+	case 0x2f:				/* VERIFY(10) */
+	case 0x4d:				/* LOG SENSE */
+	case 0x5a:				/* MODE SENSE(10) */
+	case 0x5e:				/* PERSISTENT RESERVE IN */
+	case 0x88:				/* READ(16) */
+	case 0x8f:				/* VERIFY(16) */
+	case 0x9e:				/* SERVICE ACTION IN(16) */
+	case 0xa0:				/* REPORT LUNS */
+	case 0xa3:				/* MAINTENANCE IN */
+	case 0xa8:				/* READ(12) */
+	case 0xaf:				/* VERIFY(12) */
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Free the INQUIRY cache and close its uevent socket.
+ * @par Locks:
+ *	lock/unlock of vlib_data.inquiry_cache.mutex
+ */
+void sgutils_freeInquiryCache(void)
+{
+	struct vlib_inquiry_cache *cache = &vlib_data.inquiry_cache;
+
+	VLIB_MUTEX_LOCK(&cache->mutex);
+
+	invalidateInquiries(-1, -1, -1, -1);
+	free(cache->slots);
+	cache->slots = NULL;
+	block_free(&cache->changed);
+	cache->allChanged = 0;
+
+	if (cache->uevent_fd >= 0)
+		close(cache->uevent_fd);
+	cache->uevent_fd = -1;
+
+	VLIB_MUTEX_UNLOCK(&cache->mutex);
+}
+
+static inline uint32_t get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief Send a SCSI command which reads data from a unit.
+ * @param sg_fd file descriptor of the unit
+ * @param *cdb the command descriptor block
+ * @param cdbLen length of the CDB
+ * @param *pRspBuffer buffer for the data
+ * @param RspBufferSize size of the buffer
+ * @param *resid to return the residual count
+ * @param *pScsiStatus to return the SCSI status, might be NULL
+ * @param *pSenseBuffer to return sense data, might be NULL
+ * @param *SenseBufferSize size of the sense buffer, returns length of the
+ *	sense data, might be NULL
+ * @return see sg_io_sendScsiCmd()
+ */
+static HBA_STATUS sgutils_sendCmd(int sg_fd, unsigned char *cdb, int cdbLen,
+				  void *pRspBuffer, HBA_UINT32 RspBufferSize,
+				  HBA_UINT32 *resid, HBA_UINT8 *pScsiStatus,
+				  void *pSenseBuffer,
+				  HBA_UINT32 *SenseBufferSize)
+{
+	unsigned char sense[SCSI_SENSE_LEN];
+	struct vlib_scsi_cmd cmd;
+	HBA_STATUS status;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.cdb = cdb;
+	cmd.cdbLen = cdbLen;
+	cmd.dir = ZFCP_SCSI_DATA_IN;
+	cmd.buf = pRspBuffer;
+	cmd.bufLen = RspBufferSize;
+	cmd.timeout = SCSI_TIMEOUT;
+	if (pSenseBuffer && SenseBufferSize) {
+		cmd.sense = pSenseBuffer;
+		cmd.senseLen = *SenseBufferSize;
+	} else {
+		cmd.sense = sense;
+		cmd.senseLen = sizeof(sense);
+	}
+
+	status = sg_io_sendScsiCmd(sg_fd, &cmd);
+	if (status == HBA_STATUS_SCSI_CHECK_CONDITION)
+		sgutils_checkUnitAttention(sg_fd, cmd.sense, cmd.senseLen);
+
+	*resid = cmd.resid;
+	if (pScsiStatus)
+		*pScsiStatus = cmd.scsiStatus;
+	if (pSenseBuffer && SenseBufferSize)
+		*SenseBufferSize = cmd.senseLen;
+
+	return status;
+}
+
+HBA_STATUS sgutils_SendScsiInquiry(int sg_fd, HBA_UINT8 EVPD,
+				HBA_UINT32 PageCode, void *pRspBuffer,
+				HBA_UINT32 *RspBufferSize,
+				HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+				HBA_UINT32 *SenseBufferSize)
+{
+	unsigned char cdb[6];
+	HBA_UINT32 len, resid;
+	HBA_STATUS status;
+
+	/* allocation length is 16 bit */
+	len = *RspBufferSize > 0xffff ? 0xffff : *RspBufferSize;
+
+	memset(cdb, 0, sizeof(cdb));
+	cdb[0] = 0x12;				/* INQUIRY */
+	cdb[1] = EVPD & 0x1;
+	cdb[2] = PageCode;
+	cdb[3] = len >> 8;
+	cdb[4] = len & 0xff;
+
+	status = sgutils_sendCmd(sg_fd, cdb, sizeof(cdb), pRspBuffer, len,
+				 &resid, pScsiStatus, pSenseBuffer,
+				 SenseBufferSize);
+	if (status == HBA_STATUS_OK)
+		*RspBufferSize = len - resid;
+
+	return status;
+}
+
+HBA_STATUS sgutils_SendReportLUNs(int sg_fd, void *pRspBuffer,
+				HBA_UINT32 *RspBufferSize,
+				HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+				HBA_UINT32 *SenseBufferSize)
+{
+	unsigned char cdb[12];
+	HBA_UINT32 size, resid;
+	HBA_STATUS status;
+
+	memset(cdb, 0, sizeof(cdb));
+	cdb[0] = 0xa0;				/* REPORT LUNS */
+	cdb[6] = *RspBufferSize >> 24;
+	cdb[7] = *RspBufferSize >> 16;
+	cdb[8] = *RspBufferSize >> 8;
+	cdb[9] = *RspBufferSize & 0xff;
+
+	status = sgutils_sendCmd(sg_fd, cdb, sizeof(cdb), pRspBuffer,
+				 *RspBufferSize, &resid, pScsiStatus,
+				 pSenseBuffer, SenseBufferSize);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	size = get_be32(pRspBuffer);
+
+	/* size is size of payload, total response size is 8 bytes larger
+	 * because of the header */
+	if (*RspBufferSize < (size + 8))
+		return HBA_STATUS_ERROR_MORE_DATA;
+
+	*RspBufferSize = size + 8;
+
+	return HBA_STATUS_OK;
+}
+
+HBA_STATUS sgutils_SendReadCap(int sg_fd, void *pRspBuffer,
+				HBA_UINT32 *RspBufferSize,
+				HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+				HBA_UINT32 *SenseBufferSize)
+{
+	unsigned char cdb[16];
+	HBA_UINT32 resid;
+	HBA_STATUS status;
+
+	if (*RspBufferSize < READCAP10LEN)
+		/* too small to hold the smallest response */
+		return HBA_STATUS_ERROR_MORE_DATA;
+
+	memset(cdb, 0, sizeof(cdb));
+	cdb[0] = 0x25;				/* READ CAPACITY(10) */
+
+	status = sgutils_sendCmd(sg_fd, cdb, 10, pRspBuffer, READCAP10LEN,
+				 &resid, pScsiStatus, pSenseBuffer,
+				 SenseBufferSize);
+	if (status != HBA_STATUS_OK)
+		return status;
+
+	if (get_be32(pRspBuffer) != 0xffffffff) {
+		/* device smaller than 0xffffffff blocks, reply ok */
+		*RspBufferSize = READCAP10LEN;
+		return HBA_STATUS_OK;
+	}
+
+	/* device larger than 0xffffffff, readcap16 necessary */
+	if (*RspBufferSize < READCAP16LEN)
+		/* buffer too small to hold the smallest response */
+		return HBA_STATUS_ERROR_MORE_DATA;
+
+	memset(cdb, 0, sizeof(cdb));
+	cdb[0] = 0x9e;				/* SERVICE ACTION IN(16) */
+	cdb[1] = 0x10;				/* READ CAPACITY(16) */
+	cdb[13] = READCAP16LEN;
+
+	status = sgutils_sendCmd(sg_fd, cdb, sizeof(cdb), pRspBuffer,
+				 READCAP16LEN, &resid, pScsiStatus,
+				 pSenseBuffer, SenseBufferSize);
+	if (status == HBA_STATUS_OK)
+		*RspBufferSize = READCAP16LEN;
 
 	return status;
 }
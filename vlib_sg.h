@@ -20,12 +20,45 @@
 #define READCAP10LEN 8
 #define READCAP16LEN 32
 
-HBA_STATUS sgutils_SendScsiInquiry(char *sg_dev, HBA_UINT8 EVPD,
+#define SCSI_SENSE_LEN	96	/* sense buffer used if caller has none */
+#define SCSI_TIMEOUT	60000	/* default timeout in ms */
+#define SCSI_MAX_CDB_LEN 252	/* longest CDB the sg v3 header can carry */
+
+#define SCSI_ILLEGAL_REQUEST	0x5	/* sense keys */
+#define SCSI_UNIT_ATTENTION	0x6
+
+int sgutils_getUnitFd(struct vlib_unit *unit);
+int sgutils_waitForUnitFd(struct vlib_unit *unit);
+void sgutils_putUnitFd(int sg_fd, struct vlib_unit *unit, HBA_STATUS status);
+void sgutils_invalidateUnits(unsigned int host, int channel, int target,
+				int lun);
+void sgutils_freeFdCache(void);
+int sgutils_getCachedInquiry(struct vlib_unit *unit, HBA_UINT8 EVPD,
+				HBA_UINT32 PageCode, void *pRspBuffer,
+				HBA_UINT32 *RspBufferSize,
+				unsigned long *generation);
+void sgutils_cacheInquiry(struct vlib_unit *unit, unsigned long generation,
+				HBA_UINT8 EVPD, HBA_UINT32 PageCode,
+				const void *pRspBuffer,
+				HBA_UINT32 RspBufferSize);
+void sgutils_updateLuids(void);
+int sgutils_getSenseKey(const void *sense, HBA_UINT32 senseLen);
+void sgutils_checkUnitAttention(int sg_fd, const void *sense,
+				HBA_UINT32 senseLen);
+int sgutils_isReadOnlyCdb(const unsigned char *cdb);
+void sgutils_freeInquiryCache(void);
+HBA_STATUS sgutils_SendScsiInquiry(int sg_fd, HBA_UINT8 EVPD,
 				HBA_UINT32 PageCode, void *pRspBuffer,
-				HBA_UINT32 *RspBufferSize);
-HBA_STATUS sgutils_SendReportLUNs(char *sg_dev, char *pRspBuffer,
-				HBA_UINT32 *RspBufferSize);
-HBA_STATUS sgutils_SendReadCap(char *sg_dev, char *pRspBuffer,
-				HBA_UINT32 *RspBufferSize);
+				HBA_UINT32 *RspBufferSize,
+				HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+				HBA_UINT32 *SenseBufferSize);
+HBA_STATUS sgutils_SendReportLUNs(int sg_fd, void *pRspBuffer,
+				HBA_UINT32 *RspBufferSize,
+				HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+				HBA_UINT32 *SenseBufferSize);
+HBA_STATUS sgutils_SendReadCap(int sg_fd, void *pRspBuffer,
+				HBA_UINT32 *RspBufferSize,
+				HBA_UINT8 *pScsiStatus, void *pSenseBuffer,
+				HBA_UINT32 *SenseBufferSize);
 
 #endif /*_VLIB_SG_H_*/
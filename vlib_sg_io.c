@@ -33,6 +33,14 @@
 #include <scsi/fc/fc_ns.h>
 #include <scsi/scsi_bsg_fc.h>
 
+/* SCSI status codes as defined in SAM */
+#define SCSI_STAT_GOOD			0x00
+#define SCSI_STAT_CHECK_CONDITION	0x02
+#define SCSI_STAT_CONDITION_MET		0x04
+
+/* driver status indicating that sense data is available */
+#define SG_DRIVER_SENSE			0x08
+
 struct gid_pn_req_frame {
 	struct fc_ct_hdr hdr;
 	struct fc_ns_gid_pn gid_pn_req;
@@ -43,40 +51,273 @@ struct gid_pn_rsp_frame {
 	struct fc_gid_pn_resp gid_pn_rsp;
 };
 
-static int sg_io_performSGIO(char *devName, struct sg_io_v4 *sg_io)
+/**
+ * @brief Get a file descriptor for the bsg device of an adapter.
+ * @param *adapter the adapter
+ * @return
+ *	- -1 on error
+ *	- file descriptor on success, to be released with sg_io_putBsgFd()
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The bsg device is opened once and shared by all requests, which can be
+ * sent without holding vlib_data.mutex. A stale descriptor is not handed out
+ * anymore; the caller gets a private one until the last user of the stale
+ * one released it.
+ */
+int sg_io_getBsgFd(struct vlib_adapter *adapter)
 {
+	struct vlib_bsg *bsg = &adapter->bsg;
+	char devName[32];
 	int fd;
-	int status;
-	int i;
 
-	fd = open(devName, O_RDWR);
-	if (fd < 0)
+	if (bsg->isOpen && !bsg->isStale) {
+		bsg->users++;
+		return bsg->fd;
+	}
+
+	snprintf(devName, sizeof(devName), "/dev/bsg/fc_host%u",
+		 adapter->ident.host);
+	fd = open(devName, O_RDWR | O_CLOEXEC);
+	if (fd < 0 || bsg->isOpen)
 		return fd;
 
-	status = ioctl(fd, SG_IO, sg_io);
+	bsg->fd = fd;
+	bsg->isOpen = 1;
+	bsg->users = 1;
+
+	return fd;
+}
+
+/**
+ * @brief Release a file descriptor obtained with sg_io_getBsgFd().
+ * @param *adapter the adapter, NULL if it is gone
+ * @param fd the file descriptor
+ * @param status result of the request sent using the descriptor
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * If the request failed, the shared descriptor is closed once its last user
+ * released it, so the next request reopens the bsg device.
+ */
+void sg_io_putBsgFd(struct vlib_adapter *adapter, int fd, HBA_STATUS status)
+{
+	struct vlib_bsg *bsg;
 
-	if (status < 0)
-		return status;
+	if (fd < 0)
+		return;
 
-	status = close(fd);
+	if (!adapter || !adapter->bsg.isOpen || adapter->bsg.fd != fd) {
+		close(fd);
+		return;
+	}
 
-	if (status < 0)
-		return status;
+	bsg = &adapter->bsg;
+	bsg->users--;
+	if (status == HBA_STATUS_ERROR)
+		bsg->isStale = 1;
+	if (bsg->isStale && bsg->users == 0)
+		sg_io_closeBsg(adapter);
+}
+
+/**
+ * @brief Close the bsg device of an adapter.
+ * @param *adapter the adapter
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * If requests still use the descriptor, it is closed when the last of them
+ * releases it.
+ */
+void sg_io_closeBsg(struct vlib_adapter *adapter)
+{
+	struct vlib_bsg *bsg = &adapter->bsg;
+
+	if (!bsg->isOpen)
+		return;
+
+	bsg->isStale = 1;
+	if (bsg->users)
+		return;
+
+	close(bsg->fd);
+	bsg->isOpen = 0;
+	bsg->isStale = 0;
+}
+
+static int sg_io_performSGIO(int fd, struct sg_io_v4 *sg_io)
+{
+	if (fd < 0)
+		return -1;
+
+	if (ioctl(fd, SG_IO, sg_io) < 0)
+		return -1;
 
 	return 0;
 }
 
-HBA_STATUS sg_io_performCTPassThru(struct vlib_adapter *adapter,
-				void* req, int reqSize, void* rsp, int rspSize)
+/**
+ * @brief Map the result of a SCSI command to an HBA_STATUS.
+ * @param *cmd the SCSI command
+ * @param host_status host (transport) status of the command
+ * @param driver_status driver status of the command
+ * @return
+ *	- HBA_STATUS_ERROR if the command did not reach the device
+ *	- HBA_STATUS_SCSI_CHECK_CONDITION on CHECK CONDITION
+ *	- HBA_STATUS_ERROR on any other SCSI status but GOOD
+ *	- HBA_STATUS_OK on GOOD status
+ */
+static HBA_STATUS sg_io_scsiStatus(struct vlib_scsi_cmd *cmd,
+				   unsigned int host_status,
+				   unsigned int driver_status)
+{
+	/* sense data is reported by the driver status as well */
+	if (host_status || (driver_status & ~SG_DRIVER_SENSE))
+		return HBA_STATUS_ERROR;
+
+	switch (cmd->scsiStatus) {
+	case SCSI_STAT_GOOD:
+	case SCSI_STAT_CONDITION_MET:
+		return HBA_STATUS_OK;
+	case SCSI_STAT_CHECK_CONDITION:
+		return HBA_STATUS_SCSI_CHECK_CONDITION;
+	default:
+		return HBA_STATUS_ERROR;
+	}
+}
+
+/**
+ * @brief Send a SCSI command using the sg version 3 interface.
+ * @param fd file descriptor of an sg device
+ * @param *cmd the SCSI command
+ * @return see sg_io_sendScsiCmd()
+ */
+static HBA_STATUS sg_io_sendScsiCmdV3(int fd, struct vlib_scsi_cmd *cmd)
+{
+	struct sg_io_hdr hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.interface_id = 'S';
+	hdr.cmdp = cmd->cdb;
+	hdr.cmd_len = cmd->cdbLen;
+	hdr.dxferp = cmd->buf;
+	hdr.dxfer_len = cmd->bufLen;
+	switch (cmd->dir) {
+	case ZFCP_SCSI_DATA_IN:
+		hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+		break;
+	case ZFCP_SCSI_DATA_OUT:
+		hdr.dxfer_direction = SG_DXFER_TO_DEV;
+		break;
+	default:
+		hdr.dxfer_direction = SG_DXFER_NONE;
+		hdr.dxfer_len = 0;
+	}
+	hdr.sbp = cmd->sense;
+	hdr.mx_sb_len = cmd->senseLen > 255 ? 255 : cmd->senseLen;
+	hdr.timeout = cmd->timeout;
+
+	if (ioctl(fd, SG_IO, &hdr) < 0) {
+		cmd->senseLen = 0;
+		cmd->resid = cmd->bufLen;
+		return HBA_STATUS_ERROR;
+	}
+
+	cmd->scsiStatus = hdr.status;
+	cmd->senseLen = hdr.sb_len_wr;
+	cmd->resid = hdr.resid;
+
+	return sg_io_scsiStatus(cmd, hdr.host_status, hdr.driver_status);
+}
+
+/**
+ * @brief Send a SCSI command to a unit.
+ * @param fd file descriptor of the unit's bsg or sg device
+ * @param *cmd the SCSI command, returns status, sense data and residual
+ * @return
+ *	- HBA_STATUS_ERROR if the command did not reach the device
+ *	- HBA_STATUS_SCSI_CHECK_CONDITION on CHECK CONDITION, sense data is
+ *	returned in cmd->sense
+ *	- HBA_STATUS_ERROR on any other SCSI status but GOOD, the status is
+ *	returned in cmd->scsiStatus
+ *	- HBA_STATUS_OK on success
+ *
+ * The command is sent using the SG_IO version 4 interface of the bsg
+ * device. Data is transferred directly from/to the caller's buffer. If fd
+ * refers to an sg device, which only knows the version 3 interface, the
+ * command is resent using that interface.
+ */
+HBA_STATUS sg_io_sendScsiCmd(int fd, struct vlib_scsi_cmd *cmd)
+{
+	struct sg_io_v4 sg_io;
+
+	if (fd < 0) {
+		cmd->senseLen = 0;
+		cmd->resid = cmd->bufLen;
+		return HBA_STATUS_ERROR;
+	}
+
+	memset(&sg_io, 0, sizeof(sg_io));
+	sg_io.guard = 'Q';
+	sg_io.protocol = BSG_PROTOCOL_SCSI;
+	sg_io.subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD;
+	sg_io.request_len = cmd->cdbLen;
+	sg_io.request = (__u64) cmd->cdb;
+	if (cmd->dir == ZFCP_SCSI_DATA_IN) {
+		sg_io.din_xfer_len = cmd->bufLen;
+		sg_io.din_xferp = (__u64) cmd->buf;
+	} else if (cmd->dir == ZFCP_SCSI_DATA_OUT) {
+		sg_io.dout_xfer_len = cmd->bufLen;
+		sg_io.dout_xferp = (__u64) cmd->buf;
+	}
+	sg_io.max_response_len = cmd->senseLen;
+	sg_io.response = (__u64) cmd->sense;
+	sg_io.timeout = cmd->timeout;
+
+	if (ioctl(fd, SG_IO, &sg_io) < 0) {
+		if (errno == ENOSYS || errno == EINVAL)
+			/* no bsg device */
+			return sg_io_sendScsiCmdV3(fd, cmd);
+		cmd->senseLen = 0;
+		cmd->resid = cmd->bufLen;
+		return HBA_STATUS_ERROR;
+	}
+
+	cmd->scsiStatus = sg_io.device_status;
+	cmd->senseLen = sg_io.response_len;
+	cmd->resid = cmd->dir == ZFCP_SCSI_DATA_OUT ? sg_io.dout_resid :
+						      sg_io.din_resid;
+
+	return sg_io_scsiStatus(cmd, sg_io.transport_status,
+				sg_io.driver_status);
+}
+
+/**
+ * @brief Send a CT request to the fabric.
+ * @param fd file descriptor of the bsg device, see sg_io_getBsgFd()
+ * @param *req the CT request
+ * @param reqSize size of the request
+ * @param *rsp buffer for the response
+ * @param rspSize size of the response buffer
+ * @param *rspLen returns the length of the response, might be NULL
+ * @param timeout in milliseconds
+ * @return
+ *	- HBA_STATUS_ERROR if the request could not be sent
+ *	- HBA_STATUS_OK on success
+ *
+ * The length of the response is derived from the residual count reported by
+ * bsg.
+ */
+HBA_STATUS sg_io_performCTPassThru(int fd, void *req, int reqSize, void *rsp,
+				   int rspSize, HBA_UINT32 *rspLen,
+				   unsigned int timeout)
 {
-	char devName[PATH_MAX];
 	struct fc_bsg_request cdb;
 	struct sg_io_v4 sg_io;
 
 
 	bzero(&cdb, sizeof(cdb));
 	bzero(&sg_io, sizeof(sg_io));
-	snprintf(devName, PATH_MAX, "/dev/bsg/fc_host%d", adapter->ident.host);
 	cdb.msgcode = FC_BSG_HST_CT;
 	memcpy(&cdb.rqst_data.r_ct, req, sizeof(struct fc_bsg_rport_ct));
 						/* copy the preamble into the
@@ -93,25 +334,27 @@ HBA_STATUS sg_io_performCTPassThru(struct vlib_adapter *adapter,
 	sg_io.din_xfer_len = rspSize;
 	sg_io.din_xferp = (__u64) rsp;
 
-	sg_io.timeout = 9000; /* TODO */
+	sg_io.timeout = timeout;
 
-	if (sg_io_performSGIO(devName, &sg_io))
+	if (sg_io_performSGIO(fd, &sg_io))
 		return HBA_STATUS_ERROR;
 
+	if (rspLen)
+		*rspLen = sg_io.din_resid < rspSize ? rspSize - sg_io.din_resid
+						    : 0;
+
 	return HBA_STATUS_OK;
 }
-							
-static HBA_STATUS sg_io_performGIDPN(struct vlib_adapter *adapter,
-						wwn_t portwwn, void *rsp)
+
+static HBA_STATUS sg_io_performGIDPN(int fd, wwn_t portwwn, void *rsp)
 {
-	char devName[PATH_MAX];
 	struct fc_bsg_request cdb;
 	struct gid_pn_req_frame ct;
 
 	struct sg_io_v4 sg_io;
 
-	snprintf(devName, PATH_MAX, "/dev/bsg/fc_host%d", adapter->ident.host);
-
+	memset(&cdb, 0, sizeof(struct fc_bsg_request));
+	memset(&sg_io, 0, sizeof(struct sg_io_v4));
 	memset(&ct, 0, sizeof(struct gid_pn_req_frame));
 	ct.hdr.ct_rev = 1;
 	ct.hdr.ct_fs_type = 0xFC;
@@ -138,52 +381,80 @@ static HBA_STATUS sg_io_performGIDPN(struct vlib_adapter *adapter,
 
 	sg_io.timeout = 2000; /* TODO */
 
-	if (sg_io_performSGIO(devName, &sg_io))
+	if (sg_io_performSGIO(fd, &sg_io))
 		return HBA_STATUS_ERROR;
 
 	return HBA_STATUS_OK;
 }
 
-static fc_id_t getDidFromWWN(struct vlib_adapter *adapter, wwn_t portwwn)
+/**
+ * @brief Look up the D_ID of a port at the name server.
+ * @param *adapter through which the name server is reached
+ * @param portwwn WWPN of the port
+ * @return
+ *	- 0 if the request failed or was rejected
+ *	- D_ID of the port on success
+ *
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * This sends a GID_PN request and waits for the response. Use resolveDid()
+ * to reuse D_IDs known already.
+ */
+fc_id_t sg_io_getDidFromWWN(struct vlib_adapter *adapter, wwn_t portwwn)
 {
 	struct gid_pn_rsp_frame rsp;
-	fc_id_t d_id;
+	HBA_STATUS status;
+	__u8 *fid;
+	int fd;
 
-	if (sg_io_performGIDPN(adapter, portwwn, &rsp))
-		;
+	memset(&rsp, 0, sizeof(rsp));
+	fd = sg_io_getBsgFd(adapter);
+	status = sg_io_performGIDPN(fd, portwwn, &rsp);
+	sg_io_putBsgFd(adapter, fd, status);
+	if (status != HBA_STATUS_OK)
+		return 0;
 
-	if (rsp.hdr.ct_cmd == 0x8002) {
-		/* accept CT */
-		/* convert from u8[3] to 32bit number*/
-		return *((fc_id_t*)&rsp.gid_pn_rsp.fp_fid);
-	}
+	if (rsp.hdr.ct_cmd != 0x8002)
+		/* all other cases including reject ct */
+		return 0;
 
-	/* all other cases including reject ct */
-	return 0;
+	/* accept CT, convert from u8[3] to 32bit number */
+	fid = rsp.gid_pn_rsp.fp_fid;
+	return (fid[0] << 16) | (fid[1] << 8) | fid[2];
 }
 
-HBA_STATUS sg_io_sendRNID(struct vlib_adapter *adapter, wwn_t portwwn,
-							void *rsp, int rspSize)
+/**
+ * @brief Send a RNID ELS to a port.
+ * @param fd file descriptor of the bsg device, see sg_io_getBsgFd()
+ * @param d_id D_ID of the port, see resolveDid()
+ * @param *rsp buffer for the response
+ * @param rspSize size of the response buffer
+ * @param timeout in milliseconds
+ * @return
+ *	- HBA_STATUS_ERROR if the ELS could not be sent
+ *	- HBA_STATUS_OK on success
+ */
+HBA_STATUS sg_io_sendRNID(int fd, fc_id_t d_id, void *rsp, int rspSize,
+			  unsigned int timeout)
 {
-	char devName[PATH_MAX];
 	struct fc_bsg_request cdb;
 	struct fc_els_rnid rnid;
 	struct sg_io_v4 sg_io;
-	fc_id_t d_id;
-	int i;
 
-	d_id = getDidFromWWN(adapter, portwwn);
 	if (d_id == 0)
 		return HBA_STATUS_ERROR;
 
 	memset(&rnid, 0, sizeof(struct fc_els_rnid));
 	memset(&cdb, 0, sizeof(struct fc_bsg_request));
+	memset(&sg_io, 0, sizeof(struct sg_io_v4));
 	rnid.rnid_cmd = ELS_RNID;
 	rnid.rnid_fmt = ELS_RNIDF_GEN;
 	cdb.msgcode = FC_BSG_HST_ELS_NOLOGIN;
 	cdb.rqst_data.h_els.command_code = 0x78;
-	memcpy(cdb.rqst_data.h_els.port_id, (char *)&d_id,
-					sizeof(cdb.rqst_data.h_els.port_id));
+	cdb.rqst_data.h_els.port_id[0] = (d_id >> 16) & 0xff;
+	cdb.rqst_data.h_els.port_id[1] = (d_id >> 8) & 0xff;
+	cdb.rqst_data.h_els.port_id[2] = d_id & 0xff;
 
 	sg_io.guard = 'Q';
 	sg_io.protocol = BSG_PROTOCOL_SCSI;
@@ -195,52 +466,225 @@ HBA_STATUS sg_io_sendRNID(struct vlib_adapter *adapter, wwn_t portwwn,
 	sg_io.din_xfer_len = rspSize; /* common node-identification data + 4 */
 	sg_io.din_xferp = (__u64) rsp;
 
-	sg_io.timeout = 5000;
-
-	sprintf(devName, "/dev/bsg/fc_host%d", adapter->ident.host);
+	sg_io.timeout = timeout;
 
 	memset(rsp, 0, rspSize);
 
-	if (sg_io_performSGIO(devName, &sg_io))
+	if (sg_io_performSGIO(fd, &sg_io))
 		return HBA_STATUS_ERROR;
 
 	return HBA_STATUS_OK;
 }
 
-#if 0
-static void prepareRPS(wwn_t *port_selection, char *flag, fc_id_t *d_id,
-				wwn_t agent_wwn, HBA_UINT32 agent_domain,
-				wwn_t object_wwn, HBA_UINT32 object_port_number)
+/**
+ * @brief Get a buffer for CT and ELS pass-thru requests.
+ * @param size of the buffer
+ * @return
+ *	- NULL if out of memory
+ *	- pointer to a zeroed buffer aligned to VLIB_PT_ALIGN
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * Buffers released with sg_io_freeBuffer() are reused, so requests sent at
+ * a high rate do not allocate memory each time.
+ */
+void *sg_io_allocBuffer(HBA_UINT32 size)
 {
-	if (agent_wwn)
-		/* there is a target port */
-		*d_id = getDidFromWWN(adapter, agent_wwn);
-	else
-		/* no target port, so we pick the domain controller */
-		*d_id = 0xFFFC00 | agent_domain;
+	struct vlib_pt_pool *pool = &vlib_data.pt_pool;
+	struct vlib_pt_buffer **prev, *buf;
+
+	for (prev = &pool->free; *prev; prev = &(*prev)->next) {
+		if ((*prev)->size >= size) {
+			buf = *prev;
+			*prev = buf->next;
+			pool->count--;
+			goto out;
+		}
+	}
 
-	if (object_wwn) {
-		/* the port in question is identified by a wwpn */
-		*flag = 0x02;
-		*port_selection = object_wwn;
-	} else {
-		/* the port in question is identified by a physical port no */
-		*flag = 0x01;
-		*port_selection = object_port_number;
+	if (posix_memalign((void **) &buf, VLIB_PT_ALIGN,
+			   VLIB_PT_ALIGN + size)) {
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return NULL;
 	}
+	buf->size = size;
+out:
+	memset((char *) buf + VLIB_PT_ALIGN, 0, size);
+	return (char *) buf + VLIB_PT_ALIGN;
 }
-#endif
 
-/*HBA_STATUS sg_io_sendRPS(struct vlib_adapter *adapter,
-				wwn_t agent_wwn, HBA_UINT32 agent_domain,
-				wwn_t object_wwn, HBA_UINT32 object_port_number,
-				void *pRspBuffer, HBA_UINT32 *pRspBufferSize)
+/**
+ * @brief Release a buffer obtained with sg_io_allocBuffer().
+ * @param *data the buffer, might be NULL
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+void sg_io_freeBuffer(void *data)
 {
-	fc_id_t d_id;
-	wwn_t port_selection;
-	char flag;
+	struct vlib_pt_pool *pool = &vlib_data.pt_pool;
+	struct vlib_pt_buffer *buf;
 
-	prepareRPS(&port_selection, &flag, &d_id, agent_wwn, agent_domain,
-						object_wwn, object_port_number);
+	if (!data)
+		return;
+
+	buf = (struct vlib_pt_buffer *) ((char *) data - VLIB_PT_ALIGN);
+	if (pool->count >= VLIB_PT_POOL_SIZE) {
+		free(buf);
+		return;
+	}
+
+	buf->next = pool->free;
+	pool->free = buf;
+	pool->count++;
+}
 
-}*/
+/**
+ * @brief Free all buffers kept for reuse.
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+void sg_io_freeBufferPool(void)
+{
+	struct vlib_pt_pool *pool = &vlib_data.pt_pool;
+	struct vlib_pt_buffer *buf;
+
+	while (buf = pool->free) {
+		pool->free = buf->next;
+		free(buf);
+	}
+	pool->count = 0;
+}
+
+/**
+ * @brief Send an ELS to a port and copy the response.
+ * @param fd file descriptor of the bsg device, see sg_io_getBsgFd()
+ * @param d_id D_ID of the port
+ * @param *req the ELS payload, starting with the command code
+ * @param reqSize size of the payload
+ * @param *rsp buffer for the response
+ * @param *rspSize size of the response buffer, returns the length of the
+ *	response
+ * @param timeout in milliseconds
+ * @return
+ *	- HBA_STATUS_ERROR if the ELS could not be sent
+ *	- HBA_STATUS_ERROR_ELS_REJECT if the port answered with LS_RJT
+ *	- HBA_STATUS_ERROR_MORE_DATA if the response was truncated
+ *	- HBA_STATUS_OK on success
+ *
+ * The response is received into a buffer of ELS_RSP_MAX_LENGTH bytes, so
+ * a short response buffer of the caller is detected.
+ */
+static HBA_STATUS sg_io_performELS(int fd, fc_id_t d_id, void *req,
+				   int reqSize, void *rsp, HBA_UINT32 *rspSize,
+				   unsigned int timeout)
+{
+	struct fc_bsg_request cdb;
+	struct sg_io_v4 sg_io;
+	unsigned char buf[ELS_RSP_MAX_LENGTH];
+	HBA_UINT32 len;
+
+	if (d_id == 0)
+		return HBA_STATUS_ERROR;
+
+	memset(&cdb, 0, sizeof(struct fc_bsg_request));
+	memset(&sg_io, 0, sizeof(struct sg_io_v4));
+	memset(buf, 0, sizeof(buf));
+	cdb.msgcode = FC_BSG_HST_ELS_NOLOGIN;
+	cdb.rqst_data.h_els.command_code = *(unsigned char *) req;
+	cdb.rqst_data.h_els.port_id[0] = (d_id >> 16) & 0xff;
+	cdb.rqst_data.h_els.port_id[1] = (d_id >> 8) & 0xff;
+	cdb.rqst_data.h_els.port_id[2] = d_id & 0xff;
+
+	sg_io.guard = 'Q';
+	sg_io.protocol = BSG_PROTOCOL_SCSI;
+	sg_io.subprotocol = BSG_SUB_PROTOCOL_SCSI_TRANSPORT;
+	sg_io.request_len = sizeof(cdb);
+	sg_io.request = (__u64) &cdb;
+	sg_io.dout_xfer_len = reqSize;
+	sg_io.dout_xferp = (__u64) req;
+	sg_io.din_xfer_len = sizeof(buf);
+	sg_io.din_xferp = (__u64) buf;
+
+	sg_io.timeout = timeout;
+
+	if (sg_io_performSGIO(fd, &sg_io))
+		return HBA_STATUS_ERROR;
+
+	len = sg_io.din_resid < sizeof(buf) ? sizeof(buf) - sg_io.din_resid : 0;
+	memset(rsp, 0, *rspSize);
+	memcpy(rsp, buf, min(len, *rspSize));
+	if (len > *rspSize) {
+		*rspSize = len;
+		return HBA_STATUS_ERROR_MORE_DATA;
+	}
+	*rspSize = len;
+
+	if (len && buf[0] == ELS_LS_RJT)
+		return HBA_STATUS_ERROR_ELS_REJECT;
+
+	return HBA_STATUS_OK;
+}
+
+/**
+ * @brief Send a RLS ELS to a port.
+ * @param fd file descriptor of the bsg device, see sg_io_getBsgFd()
+ * @param d_id D_ID of the port, see resolveDid()
+ * @param *rsp buffer for the response
+ * @param *rspSize size of the response buffer, returns the length of the
+ *	response
+ * @param timeout in milliseconds
+ * @return see sg_io_performELS()
+ *
+ * The link error status block of the port itself is requested.
+ */
+HBA_STATUS sg_io_sendRLS(int fd, fc_id_t d_id, void *rsp, HBA_UINT32 *rspSize,
+			 unsigned int timeout)
+{
+	struct fc_els_rls rls;
+
+	memset(&rls, 0, sizeof(struct fc_els_rls));
+	rls.rls_cmd = ELS_RLS;
+	rls.rls_port_id[0] = (d_id >> 16) & 0xff;
+	rls.rls_port_id[1] = (d_id >> 8) & 0xff;
+	rls.rls_port_id[2] = d_id & 0xff;
+
+	return sg_io_performELS(fd, d_id, &rls, sizeof(rls), rsp, rspSize,
+				timeout);
+}
+
+/**
+ * @brief Send a RPS ELS to a port or domain controller.
+ * @param fd file descriptor of the bsg device, see sg_io_getBsgFd()
+ * @param d_id D_ID of the port or domain controller
+ * @param objectWwn WWPN of the port in question, 0 to select it by
+ *	objectPort
+ * @param objectPort physical port number of the port in question
+ * @param *rsp buffer for the response
+ * @param *rspSize size of the response buffer, returns the length of the
+ *	response
+ * @param timeout in milliseconds
+ * @return see sg_io_performELS()
+ */
+HBA_STATUS sg_io_sendRPS(int fd, fc_id_t d_id, wwn_t objectWwn,
+			 HBA_UINT32 objectPort, void *rsp, HBA_UINT32 *rspSize,
+			 unsigned int timeout)
+{
+	struct fc_els_rps rps;
+	wwn_t selection;
+
+	memset(&rps, 0, sizeof(struct fc_els_rps));
+	rps.rps_cmd = ELS_RPS;
+	if (objectWwn) {
+		/* the port in question is identified by a wwpn */
+		rps.rps_flag = FC_ELS_RPS_WWPN;
+		selection = objectWwn;
+	} else {
+		/* the port in question is identified by a physical port no */
+		rps.rps_flag = FC_ELS_RPS_PPN;
+		selection = objectPort;
+	}
+	memcpy(&rps.rps_port_spec, &selection, sizeof(wwn_t));
+
+	return sg_io_performELS(fd, d_id, &rps, sizeof(rps), rsp, rspSize,
+				timeout);
+}
@@ -22,9 +22,44 @@
 #define CT_GIDPN_REQ_LENGTH 24
 #define CT_GIDPN_RESPONSE_LENGTH 20
 
+/* default timeouts of pass-thru requests in milliseconds */
+#define CT_PASSTHRU_TIMEOUT 9000
+#define ELS_RNID_TIMEOUT 5000
+#define ELS_RLS_TIMEOUT 5000
+#define ELS_RPS_TIMEOUT 5000
 
-HBA_STATUS sg_io_sendRNID(struct vlib_adapter *, wwn_t, void *, int);
-HBA_STATUS sg_io_performCTPassThru(struct vlib_adapter *, void*, int, void*,
-									int);
+/* size of the buffer an ELS response is received into */
+#define ELS_RSP_MAX_LENGTH 256
+
+/** @brief SCSI command sent by sg_io_sendScsiCmd() */
+struct vlib_scsi_cmd {
+	unsigned char *cdb;		/**< @brief command descriptor block */
+	unsigned int cdbLen;		/**< @brief length of the CDB */
+	int dir;			/**< @brief ZFCP_SCSI_DATA_* */
+	void *buf;			/**< @brief data buffer */
+	HBA_UINT32 bufLen;		/**< @brief size of the data buffer */
+	HBA_UINT32 resid;		/**< @brief returns residual count */
+	void *sense;			/**< @brief sense buffer */
+	HBA_UINT32 senseLen;		/**< @brief size of the sense buffer,
+					   returns length of sense data */
+	HBA_UINT8 scsiStatus;		/**< @brief returns SCSI status */
+	unsigned int timeout;		/**< @brief timeout in milliseconds */
+};
+
+
+int sg_io_getBsgFd(struct vlib_adapter *);
+void sg_io_putBsgFd(struct vlib_adapter *, int, HBA_STATUS);
+void sg_io_closeBsg(struct vlib_adapter *);
+void *sg_io_allocBuffer(HBA_UINT32);
+void sg_io_freeBuffer(void *);
+void sg_io_freeBufferPool(void);
+HBA_STATUS sg_io_sendScsiCmd(int, struct vlib_scsi_cmd *);
+fc_id_t sg_io_getDidFromWWN(struct vlib_adapter *, wwn_t);
+HBA_STATUS sg_io_sendRNID(int, fc_id_t, void *, int, unsigned int);
+HBA_STATUS sg_io_sendRLS(int, fc_id_t, void *, HBA_UINT32 *, unsigned int);
+HBA_STATUS sg_io_sendRPS(int, fc_id_t, wwn_t, HBA_UINT32, void *, HBA_UINT32 *,
+			 unsigned int);
+HBA_STATUS sg_io_performCTPassThru(int, void *, int, void *, int,
+				   HBA_UINT32 *, unsigned int);
 
 #endif /*VLIB_SG_IO_H_*/
@@ -23,6 +23,42 @@
 
 /* internal helper functions */
 
+/** @brief Repository entry sorted by its SCSI address for reconciliation */
+struct sysfs_key {
+	uint64_t key;		/**< @brief SCSI address within the parent */
+	unsigned int index;	/**< @brief index in the repository */
+};
+
+/** @brief SCSI address of a remote port within its adapter */
+#define SYSFS_PORT_KEY(channel, target) \
+	(((uint64_t) (channel) << 32) | (target))
+
+static int cmpKeys(const void *a, const void *b)
+{
+	const struct sysfs_key *k1 = a, *k2 = b;
+
+	return (k1->key > k2->key) - (k1->key < k2->key);
+}
+
+/**
+ * @brief Find a repository entry in sorted keys.
+ * @param *keys keys sorted by cmpKeys()
+ * @param n number of keys
+ * @param key to look for
+ * @return
+ *	- -1 if there is no such entry
+ *	- index of the entry in the repository
+ */
+static int findKey(const struct sysfs_key *keys, size_t n, uint64_t key)
+{
+	const struct sysfs_key *found;
+	struct sysfs_key k = { .key = key };
+
+	found = bsearch(&k, keys, n, sizeof(*keys), cmpKeys);
+
+	return found ? (int) found->index : -1;
+}
+
 /**
  * @brief add a  port to the adapters repos
  * @param *adapter the adapter to which the add the port to
@@ -38,9 +74,14 @@ static HBA_STATUS addPortByName(struct vlib_adapter *adapter, char *name)
 	char path[PATH_MAX];
 	char attr[ATTR_MAX];
 	int ret;
-	struct vlib_port port;
+	struct vlib_port port, *portLoc;
+
+	/* the names and the D_ID of a known port are not updated anyway */
+	portLoc = getPortFromRepos(adapter, name);
+	if (portLoc && !portLoc->isInvalid)
+		return HBA_STATUS_OK;
 
-	snprintf(path, PATH_MAX, "/sys/class/fc_remote_ports/%s", name);
+	snprintf(path, PATH_MAX, "%s/%s", FC_RPORT_PATH, name);
 
 	strcpy(port.name, name);
 	sscanf(name, "rport-%d:%d-%d", &port.host, &port.channel, &port.target);
@@ -132,81 +173,88 @@ static HBA_STATUS addAdapterByDevPath(char *dev_path)
 }
 
 /**
- * @brief Retrieve adapter attributes.
- * @param **pPortattributes, HBA_ADAPTERATTRIBUTES to be filled
- * @param *adapter to work with
- * @return
- *	- HBA_STATUS_ERROR if any other internal error occurs
- * 	- HBA_STATUS_OK on success.
+ * @brief Read port attributes from a directory in sysfs.
+ * @param *attrs HBA_PORTATTRIBUTES to be filled
+ * @param dirfd file descriptor of the fc_host or fc_remote_port directory
  *
- * This function reads attributes from sysfs to fill in the required
- * information.
+ * Each attribute is read relative to dirfd, so the path of the port is only
+ * resolved once. Attributes that cannot be read are left unset.
  */
-static HBA_STATUS getPortAttributes(HBA_PORTATTRIBUTES **pPortattributes,
-					char *classpath)
+static void getPortAttributesAt(HBA_PORTATTRIBUTES *attrs, int dirfd)
 {
 	char attr[ATTR_MAX];
-	int ret;
 
 	/* Worldwide Port and Node Name */
-	ret = sfhelper_getProperty(classpath, "node_name", attr);
-	if (!ret)
-		vlib_wwn_to_HBA_WWN(strtoull(attr, NULL, 16),
-					&(*pPortattributes)->NodeWWN);
-	ret = sfhelper_getProperty(classpath, "port_name", attr);
-	if (!ret)
-		vlib_wwn_to_HBA_WWN(strtoull(attr, NULL, 16),
-					&(*pPortattributes)->PortWWN);
+	if (!sfhelper_getPropertyAt(dirfd, "node_name", attr))
+		vlib_wwn_to_HBA_WWN(strtoull(attr, NULL, 16), &attrs->NodeWWN);
+	if (!sfhelper_getPropertyAt(dirfd, "port_name", attr))
+		vlib_wwn_to_HBA_WWN(strtoull(attr, NULL, 16), &attrs->PortWWN);
 
 	/* PortFcId */
-	ret = sfhelper_getProperty(classpath, "port_id", attr);
-	if (!ret)
-		(*pPortattributes)->PortFcId = strtoul(attr, NULL, 16);
+	if (!sfhelper_getPropertyAt(dirfd, "port_id", attr))
+		attrs->PortFcId = strtoul(attr, NULL, 16);
 
 	/* Port Type */
-	ret = sfhelper_getProperty(classpath, "port_type", attr);
-	if (!ret)
-		(*pPortattributes)->PortType = vlibCharToIntPortType(attr);
+	if (!sfhelper_getPropertyAt(dirfd, "port_type", attr))
+		attrs->PortType = vlibCharToIntPortType(attr);
 
 	/* Port State */
-	ret = sfhelper_getProperty(classpath, "port_state", attr);
-	if (attr)
-		(*pPortattributes)->PortState =  vlibCharToIntPortState(attr);
+	if (!sfhelper_getPropertyAt(dirfd, "port_state", attr))
+		attrs->PortState = vlibCharToIntPortState(attr);
 
 	/* Supported Classes */
-	ret = sfhelper_getProperty(classpath, "supported_classes", attr);
-	if (!ret)
-		(*pPortattributes)->PortSupportedClassofService =
-						vlibCharToIntCOS(attr);
+	if (!sfhelper_getPropertyAt(dirfd, "supported_classes", attr))
+		attrs->PortSupportedClassofService = vlibCharToIntCOS(attr);
+
 	/* Supported FC4 types, we only support SCSI FCP which is
 	 * represented by 0x0000 0100 in Word 1 */
-	(*pPortattributes)->PortSupportedFc4Types.bits[2] = 0x1;
+	attrs->PortSupportedFc4Types.bits[2] = 0x1;
 
 	/* 0 when port down, otherwise same as above */
-	if ((*pPortattributes)->PortState == HBA_PORTSTATE_ONLINE)
-		(*pPortattributes)->PortActiveFc4Types.bits[2] = 0x1;
+	if (attrs->PortState == HBA_PORTSTATE_ONLINE)
+		attrs->PortActiveFc4Types.bits[2] = 0x1;
 
 	/* Symbolic Name is empty */
 
 	/* OSDeviceName is empty, we do not have a device */
 
 	/* Supported port speeds */
-	ret = sfhelper_getProperty(classpath, "supported_speeds", attr);
-	if (!ret)
-		(*pPortattributes)->PortSupportedSpeed =
-						vlibCharToIntPortSpeed(attr);
+	if (!sfhelper_getPropertyAt(dirfd, "supported_speeds", attr))
+		attrs->PortSupportedSpeed = vlibCharToIntPortSpeed(attr);
 
 	/* port speed */
-	ret = sfhelper_getProperty(classpath, "speed", attr);
-	if (!ret)
-		(*pPortattributes)->PortSpeed = vlibCharToIntPortSpeed(attr);
+	if (!sfhelper_getPropertyAt(dirfd, "speed", attr))
+		attrs->PortSpeed = vlibCharToIntPortSpeed(attr);
 
 	/* max frame size */
-	ret = sfhelper_getProperty(classpath, "maxframe_size", attr);
-	if (!ret)
-		(*pPortattributes)->PortMaxFrameSize = atoi(attr);
+	if (!sfhelper_getPropertyAt(dirfd, "maxframe_size", attr))
+		attrs->PortMaxFrameSize = atoi(attr);
 
 	/* FabricName is empty */
+}
+
+/**
+ * @brief Retrieve port attributes.
+ * @param **pPortattributes, HBA_PORTATTRIBUTES to be filled
+ * @param *classpath path of the port in sysfs
+ * @return
+ *	- HBA_STATUS_ERROR_UNAVAILABLE if the port does not exist
+ * 	- HBA_STATUS_OK on success.
+ *
+ * This function reads attributes from sysfs to fill in the required
+ * information.
+ */
+static HBA_STATUS getPortAttributes(HBA_PORTATTRIBUTES **pPortattributes,
+					char *classpath)
+{
+	int dirfd;
+
+	dirfd = sfhelper_openDirAt(AT_FDCWD, classpath);
+	if (dirfd < 0)
+		return HBA_STATUS_ERROR_UNAVAILABLE;
+
+	getPortAttributesAt(*pPortattributes, dirfd);
+	close(dirfd);
 
 	return HBA_STATUS_OK;
 }
@@ -215,39 +263,112 @@ static HBA_STATUS getPortAttributes(HBA_PORTATTRIBUTES **pPortattributes,
 
 
  /**
- * @brief Read and store all discovered ports of an adapter
+ * @brief Reconcile the discovered ports of an adapter with sysfs
  * @param *adapter pointer to the adapter in which we are interested
  * @return
  *	- HBA_STATUS_ERROR if any other internal error occurs
  * 	- HBA_STATUS_OK on success.
  * @par Locks:
  * 	vlib_data.mutex must be held
+ *
+ * The remote ports listed in sysfs are looked up in the repository by their
+ * SCSI address. Only new and reappearing ones are read, ports that have gone
+ * are invalidated. They keep their index until compactAdapter().
  */
 HBA_STATUS sysfs_createAndReadConfigPorts(struct vlib_adapter *adapter)
 {
-	HBA_STATUS status;
 	sfhelper_dir *dir;
 	char path[PATH_MAX];
 	char *portname;
+	struct vlib_port *port;
+	struct sysfs_key *keys;
+	unsigned int i, host, channel, target, n;
+	char *seen;
+	int k;
 
 	if (adapter->ident.devid == 0)
 		return HBA_STATUS_ERROR;
 
+	n = adapter->ports.used;
+	keys = malloc((n ? n : 1) * sizeof(*keys));
+	seen = calloc(n ? n : 1, 1);
+	if (!keys || !seen) {
+		free(keys);
+		free(seen);
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return HBA_STATUS_ERROR;
+	}
+
+	port = getPortByIndex(adapter, 0);
+	for (i = 0; i < n; ++i, ++port) {
+		keys[i].key = SYSFS_PORT_KEY(port->channel, port->target);
+		keys[i].index = i;
+	}
+	qsort(keys, n, sizeof(*keys), cmpKeys);
+
 	snprintf(path, PATH_MAX, "%s/host%d", adapter->ident.sysfsPath,
 							adapter->ident.host);
 	dir = sfhelper_opendir(path);
-	if (dir == NULL)
+	if (dir == NULL) {
+		free(keys);
+		free(seen);
 		return HBA_STATUS_ERROR;
+	}
 
 	while (portname = sfhelper_getNextDirEnt(dir)) {
-		if (strncmp(portname, "rport", 5) == 0)
-			addPortByName(adapter, portname);
+		if (sscanf(portname, "rport-%u:%u-%u", &host, &channel,
+			   &target) != 3)
+			continue;
+		k = findKey(keys, n, SYSFS_PORT_KEY(channel, target));
+		if (k >= 0) {
+			seen[k] = 1;
+			if (!getPortByIndex(adapter, k)->isInvalid)
+				continue;
+		}
+		addPortByName(adapter, portname);
 	}
-
 	sfhelper_closedir(dir);
+	adapter->portsStale = 0;
+
+	port = getPortByIndex(adapter, 0);
+	for (i = 0; i < n; ++i, ++port) {
+		if (seen[i] || port->isInvalid)
+			continue;
+		port->isInvalid = 1;
+		invalidatePortAttributes(port);
+		sgutils_invalidateUnits(port->host, port->channel,
+					port->target, -1);
+		repositoryChanged();
+	}
+
+	free(keys);
+	free(seen);
 	return HBA_STATUS_OK;
 }
 
+/**
+ * @brief Close the adapters that were not found by an adapter scan.
+ * @par Locks:
+ * 	vlib_data.mutex must be held
+ *
+ * Only adapters that go away change the repository, so cursors over it do
+ * not get stale by a scan that found the same adapters.
+ */
+static void closeUnseenAdapters(void)
+{
+	unsigned int i;
+	struct vlib_adapter *adapter;
+
+	adapter = getAdapterByIndex(0);
+	for (i = 0; i < vlib_data.adapters.used; ++i, ++adapter) {
+		if (adapter->isUnseen && !adapter->isInvalid) {
+			adapter->isInvalid = 1;
+			doCloseAdapter(adapter);
+		}
+		adapter->isUnseen = 0;
+	}
+}
+
 /**
  * @brief Read all adapters from /sys/bus/ccw/drivers/zfcp and add them
  * 	to the repository
@@ -256,18 +377,32 @@ HBA_STATUS sysfs_createAndReadConfigPorts(struct vlib_adapter *adapter)
  * 	- HBA_STATUS_OK on success.
  * @par Locks:
  * 	vlib_data.mutex must be held
+ *
+ * The uevent sequence number is recorded before, see
+ * HBA_RefreshAdapterConfiguration(). Adapters that are not found anymore are
+ * closed.
  */
 HBA_STATUS sysfs_createAndReadConfigAdapter()
 {
 	HBA_STATUS status;
 	int ret, a;
+	unsigned int i;
+	struct vlib_adapter *adapter;
 	sfhelper_dir *dir;
 	char *dev_path;
 	char path[PATH_MAX];
 
+	vlib_data.haveSeqnum = sysfs_readSeqnum(&vlib_data.seqnum) == 0;
+
+	adapter = getAdapterByIndex(0);
+	for (i = 0; i < vlib_data.adapters.used; ++i, ++adapter)
+		adapter->isUnseen = 1;
+
 	dir = sfhelper_opendir(ZFCP_SYSFS_PATH);
-	if (dir == NULL)
+	if (dir == NULL) {
+		closeUnseenAdapters();
 		return HBA_STATUS_OK;
+	}
 
 	/* loop dir entries to find devices of form x.x.xxxx */
 	while (dev_path = sfhelper_getNextDirEnt(dir)) {
@@ -283,6 +418,7 @@ HBA_STATUS sysfs_createAndReadConfigAdapter()
 
 	sfhelper_closedir(dir);
 
+	closeUnseenAdapters();
 	ret = revalidateAdapters();
 	if (ret < 0)
 		status = HBA_STATUS_ERROR;
@@ -294,6 +430,56 @@ HBA_STATUS sysfs_createAndReadConfigAdapter()
 	return status;
 }
 
+/**
+ * @brief Read a unit from sysfs.
+ * @param *unitPath sysfs directory of the SCSI device
+ * @param *unit to be filled, host, channel, target and lun already set
+ * @return
+ *	- -1 if the SCSI device is gone
+ *	- 0 on success
+ */
+static int readUnit(const char *unitPath, struct vlib_unit *unit)
+{
+	char unitPath2[PATH_MAX];
+	char attr[ATTR_MAX];
+	char *sg, *sg2;
+	sfhelper_dir *sg_dir, *sg_dir2;
+	uint32_t sgindex;
+	int ret;
+
+	ret = sfhelper_getProperty((char *) unitPath, "fcp_lun", attr);
+	if (!ret)
+		unit->fcLun = strtoull(attr, NULL, 16);
+	sg_dir = sfhelper_opendir((char *) unitPath);
+	if (sg_dir == NULL)
+		return -1;
+	while (sg = sfhelper_getNextDirEnt(sg_dir)) {
+		ret = sscanf(sg, "scsi_generic:%s", unit->sg_dev);
+		if (ret == 1)
+			/* successful match */
+			break;
+		/* search match without CONFIG_SYSFS_DEPRECATED[_V2] */
+		if (strncmp(sg, "scsi_generic", 13 /* full */) != 0)
+			continue;
+		snprintf(unitPath2, PATH_MAX, "%s/%s", unitPath, sg);
+		sg_dir2 = sfhelper_opendir(unitPath2);
+		if (sg_dir2 == NULL)
+			continue;
+		while (sg2 = sfhelper_getNextDirEnt(sg_dir2)) {
+			if (sscanf(sg2, "sg%u", &sgindex) != 1)
+				continue;
+			snprintf(unit->sg_dev, sizeof(unit->sg_dev),
+				 "%s", sg2);
+			/* successful match */
+			break;
+		}
+		sfhelper_closedir(sg_dir2);
+	}
+	sfhelper_closedir(sg_dir);
+
+	return 0;
+}
+
 /**
  * @brief Get unit configuration information for a port.
  * @param *port for which unit configuration is received
@@ -303,22 +489,23 @@ HBA_STATUS sysfs_createAndReadConfigAdapter()
  * @par Locks:
  *	vlib_data.mutex must be held
  *
- * This function creates and reads private configuration events for all
- * configured units of an port. It enlarges the array where unit data is
- * stored and processes the generated configuration events.
+ * The SCSI devices of the port listed in sysfs are looked up in the
+ * repository by their LUN. Only new and reappearing units are read, units
+ * that have gone are invalidated. They keep their index until
+ * compactAdapter().
  */
 int sysfs_getUnitsFromPort(struct vlib_port *port)
 {
 	char path[PATH_MAX];
-	char unitPath[PATH_MAX], unitPath2[PATH_MAX];
-	char attr[ATTR_MAX];
-	char *sg, *sg2;
-	struct vlib_unit unit;
+	char unitPath[PATH_MAX];
+	char target[NAME_MAX + 1];
+	struct vlib_unit unit, *unitLoc;
 	struct vlib_adapter *adapter;
-	sfhelper_dir *dir, *sg_dir, *sg_dir2;
-	char *dirent;
-	int ret;
-	uint32_t sgindex;
+	struct sysfs_key *keys;
+	sfhelper_dir *dir;
+	char *dirent, *seen;
+	unsigned int i, n;
+	int ret, k;
 
 	adapter = getAdapterByHostNo(port->host);
 	if (!adapter)
@@ -328,72 +515,106 @@ int sysfs_getUnitsFromPort(struct vlib_port *port)
 					adapter->ident.host, port->name);
 
 	dir = sfhelper_opendir(path);
-	if (dir == NULL)
+	if (dir == NULL) {
+		/* remote port is gone, drop its open sg devices */
+		sgutils_invalidateUnits(port->host, port->channel,
+					port->target, -1);
 		return HBA_STATUS_ERROR;
+	}
 
 	/* loop dir entries to find targets */
+	target[0] = '\0';
 	while (dirent = sfhelper_getNextDirEnt(dir)) {
-		if (strncmp(dirent, "target", 6) == 0)
+		if (strncmp(dirent, "target", 6) == 0) {
+			snprintf(target, sizeof(target), "%s", dirent);
 			break;
+		}
 	}
-	if (dirent == NULL)
-		/* no units, no error*/
-		return 0;
-
 	sfhelper_closedir(dir);
 
-	strcat(path, "/");
-	strcat(path, dirent);
+	n = port->units.used;
+	keys = malloc((n ? n : 1) * sizeof(*keys));
+	seen = calloc(n ? n : 1, 1);
+	if (!keys || !seen) {
+		free(keys);
+		free(seen);
+		VLIB_PERROR(ENOMEM, "ERROR");
+		return -1;
+	}
 
-	dir = sfhelper_opendir(path);
-	if (dir == NULL)
-		/* no units, no error */
-		return 0;
+	unitLoc = getUnitByIndex(port, 0);
+	for (i = 0; i < n; ++i, ++unitLoc) {
+		keys[i].key = unitLoc->lun;
+		keys[i].index = i;
+	}
+	qsort(keys, n, sizeof(*keys), cmpKeys);
 
-	while (dirent = sfhelper_getNextDirEnt(dir)) {
-		unit.sg_dev[0] = '\0';
+	/* no target means no units, no error */
+	strcat(path, "/");
+	strcat(path, target);
+	dir = target[0] ? sfhelper_opendir(path) : NULL;
+
+	while (dir && (dirent = sfhelper_getNextDirEnt(dir))) {
+		memset(&unit, 0, sizeof(unit));
 		ret = sscanf(dirent, "%d:%d:%d:%d", &unit.host,
 					&unit.channel, &unit.target, &unit.lun);
 		if (ret != 4)
 			continue;
-		strcpy(unitPath, path);
-		strcat(unitPath, "/");
-		strcat(unitPath, dirent);
-		ret = sfhelper_getProperty(unitPath, "fcp_lun", attr);
-		if (!ret)
-			unit.fcLun = strtoull(attr, NULL, 16);
-		sg_dir = sfhelper_opendir(unitPath);
-		if (sg_dir == NULL)
-			continue;
-		while (sg = sfhelper_getNextDirEnt(sg_dir)) {
-			ret = sscanf(sg, "scsi_generic:%s", &unit.sg_dev);
-			if (ret == 1)
-				/* successful match */
-				break;
-			/* search match without CONFIG_SYSFS_DEPRECATED[_V2] */
-			if (strncmp(sg, "scsi_generic", 13 /* full */) != 0)
-				continue;
-			snprintf(unitPath2, PATH_MAX, "%s/%s", unitPath, sg);
-			sg_dir2 = sfhelper_opendir(unitPath2);
-			if (sg_dir2 == NULL)
+		k = findKey(keys, n, unit.lun);
+		if (k >= 0) {
+			seen[k] = 1;
+			if (!getUnitByIndex(port, k)->isInvalid)
 				continue;
-			while (sg2 = sfhelper_getNextDirEnt(sg_dir2)) {
-				if (sscanf(sg2, "sg%u", &sgindex) != 1)
-					continue;
-				snprintf(unit.sg_dev, sizeof(unit.sg_dev),
-					 "%s", sg2);
-				/* successful match */
-				break;
-			}
-			sfhelper_closedir(sg_dir2);
 		}
-		sfhelper_closedir(sg_dir);
+		snprintf(unitPath, PATH_MAX, "%s/%s", path, dirent);
+		if (readUnit(unitPath, &unit) < 0)
+			continue;
 		addUnitToRepos(port, &unit);
 	}
-	sfhelper_closedir(dir);
+	if (dir)
+		sfhelper_closedir(dir);
+
+	unitLoc = getUnitByIndex(port, 0);
+	for (i = 0; i < n; ++i, ++unitLoc) {
+		if (seen[i] || unitLoc->isInvalid)
+			continue;
+		unitLoc->isInvalid = 1;
+		sgutils_invalidateUnits(unitLoc->host, unitLoc->channel,
+					unitLoc->target, unitLoc->lun);
+		if (unitLoc->fcLun != REPORTLUNS_WLUN)
+			repositoryChanged();
+	}
+
+	free(keys);
+	free(seen);
 	return 0;
 }
 
+/**
+ * @brief Read the current D_ID of a remote port.
+ * @param *port the remote port
+ * @return
+ *	- 0 if the remote port is gone
+ *	- D_ID of the port on success
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * A remote port that logs in again with another D_ID keeps its sysfs
+ * directory and does not send a uevent, so port->did is refreshed here.
+ */
+fc_id_t sysfs_getPortDid(struct vlib_port *port)
+{
+	char path[PATH_MAX];
+	char attr[ATTR_MAX];
+
+	snprintf(path, PATH_MAX, "%s/%s", FC_RPORT_PATH, port->name);
+	if (sfhelper_getProperty(path, "port_id", attr))
+		return 0;
+
+	port->did = strtoul(attr, NULL, 16);
+	return port->did;
+}
+
 /**
  * @brief Retrieve adapter attributes.
  * @param **pPortattributes, HBA_ADAPTERATTRIBUTES to be filled
@@ -408,19 +629,15 @@ int sysfs_getUnitsFromPort(struct vlib_port *port)
 HBA_STATUS sysfs_getDiscoveredPortAttributes(HBA_PORTATTRIBUTES **pAttrs,
 							struct vlib_port *port)
 {
-	sfhelper_dir *dir;
+	HBA_STATUS status;
 	char path[PATH_MAX];
 
 	memset(*pAttrs, 0, sizeof(HBA_PORTATTRIBUTES));
 
-	snprintf(path, PATH_MAX, "/sys/class/fc_remote_ports/%s", port->name);
-	dir = sfhelper_opendir(path);
-
-	if (!dir)
-		return HBA_STATUS_ERROR_UNAVAILABLE;
-	sfhelper_closedir(dir);
-
-	getPortAttributes(pAttrs, path);
+	snprintf(path, PATH_MAX, "%s/%s", FC_RPORT_PATH, port->name);
+	status = getPortAttributes(pAttrs, path);
+	if (status != HBA_STATUS_OK)
+		return status;
 
 	/* not applicable to remote ports at the moment */
 	memset(&(*pAttrs)->PortActiveFc4Types, 0, sizeof(HBA_FC4TYPES));
@@ -429,6 +646,103 @@ HBA_STATUS sysfs_getDiscoveredPortAttributes(HBA_PORTATTRIBUTES **pAttrs,
 	return HBA_STATUS_OK;
 }
 
+/**
+ * @brief Remote ports read by one thread of
+ *	sysfs_getRemotePortsAttributes()
+ */
+struct sysfs_rportSlice {
+	int classfd;			/**< @brief FC_RPORT_PATH */
+	struct sysfs_rport *rports;	/**< @brief first remote port */
+	size_t count;			/**< @brief number of remote ports */
+	pthread_t thread;		/**< @brief thread reading them */
+	unsigned int isThread:1;	/**< @brief thread was started */
+};
+
+/**
+ * @brief Read the attributes of a slice of remote ports.
+ * @param *arg the struct sysfs_rportSlice
+ * @return NULL
+ */
+static void *sysfs_readRports(void *arg)
+{
+	struct sysfs_rportSlice *slice = arg;
+	struct sysfs_rport *rport;
+	int dirfd;
+	size_t i;
+
+	for (i = 0, rport = slice->rports; i < slice->count; ++i, ++rport) {
+		memset(rport->attrs, 0, sizeof(HBA_PORTATTRIBUTES));
+		dirfd = sfhelper_openDirAt(slice->classfd, rport->name);
+		if (dirfd < 0) {
+			rport->status = HBA_STATUS_ERROR_UNAVAILABLE;
+			continue;
+		}
+		getPortAttributesAt(rport->attrs, dirfd);
+		close(dirfd);
+
+		/* not applicable to remote ports at the moment */
+		memset(&rport->attrs->PortActiveFc4Types, 0,
+		       sizeof(HBA_FC4TYPES));
+		memset(&rport->attrs->PortSupportedFc4Types, 0,
+		       sizeof(HBA_FC4TYPES));
+		rport->status = HBA_STATUS_OK;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Retrieve the attributes of many remote ports.
+ * @param *rports the remote ports
+ * @param count number of remote ports
+ * @return
+ *	- HBA_STATUS_ERROR if sysfs cannot be accessed
+ *	- HBA_STATUS_OK on success, the result for each port is in its status
+ *
+ * The attributes are read relative to a directory descriptor of each
+ * remote port, opened relative to FC_RPORT_PATH, so no path is resolved
+ * more than once. Large sets of ports are split into slices of at least
+ * VLIB_SYSFS_SLICE ports, read by up to VLIB_SYSFS_THREADS threads. The
+ * repository is not accessed, so vlib_data.mutex need not be held.
+ */
+HBA_STATUS sysfs_getRemotePortsAttributes(struct sysfs_rport *rports,
+					  size_t count)
+{
+	struct sysfs_rportSlice slices[VLIB_SYSFS_THREADS];
+	unsigned int i, n;
+	int classfd;
+
+	if (count == 0)
+		return HBA_STATUS_OK;
+
+	classfd = sfhelper_openDirAt(AT_FDCWD, FC_RPORT_PATH);
+	if (classfd < 0)
+		return HBA_STATUS_ERROR;
+
+	n = min((count + VLIB_SYSFS_SLICE - 1) / VLIB_SYSFS_SLICE,
+		(size_t) VLIB_SYSFS_THREADS);
+	for (i = 0; i < n; i++) {
+		slices[i].classfd = classfd;
+		slices[i].rports = rports + count * i / n;
+		slices[i].count = count * (i + 1) / n - count * i / n;
+		slices[i].isThread = i > 0 &&
+			pthread_create(&slices[i].thread, NULL,
+				       sysfs_readRports, &slices[i]) == 0;
+	}
+
+	sysfs_readRports(&slices[0]);
+	for (i = 1; i < n; i++) {
+		if (slices[i].isThread)
+			pthread_join(slices[i].thread, NULL);
+		else
+			sysfs_readRports(&slices[i]);
+	}
+
+	close(classfd);
+
+	return HBA_STATUS_OK;
+}
+
 /**
  * @brief Retrieve adapter attributes.
  * @param **pPortattributes, HBA_ADAPTERATTRIBUTES to be filled
@@ -438,14 +752,14 @@ HBA_STATUS sysfs_getDiscoveredPortAttributes(HBA_PORTATTRIBUTES **pAttrs,
  * 	- HBA_STATUS_OK on success.
  *
  * This function reads attributes from sysfs to fill in the required
- * information.
+ * information. NumberofDiscoveredPorts is left 0, the caller takes it from
+ * the repository.
  */
 HBA_STATUS sysfs_getAdapterPortAttributes(HBA_PORTATTRIBUTES **pAttrs,
 						struct vlib_adapter *adapter)
 {
 	sfhelper_dir *dir;
 	char path[PATH_MAX];
-	char *dirent;
 
 	if (adapter->ident.devid == 0)
 		return HBA_STATUS_ERROR_UNAVAILABLE;
@@ -463,21 +777,6 @@ HBA_STATUS sysfs_getAdapterPortAttributes(HBA_PORTATTRIBUTES **pAttrs,
 	snprintf((*pAttrs)->OSDeviceName, sizeof((*pAttrs)->OSDeviceName),
 				"/dev/bsg/fc_host%d", adapter->ident.host);
 
-	snprintf(path, PATH_MAX, "%s/host%d", adapter->ident.sysfsPath,
-						adapter->ident.host);
-
-	dir = sfhelper_opendir(path);
-	if (!dir)
-		return HBA_STATUS_ERROR_UNAVAILABLE;
-
-	while (dirent = sfhelper_getNextDirEnt(dir)) {
-		if (strncmp(dirent, "rport", 5) == 0) {
-			(*pAttrs)->NumberofDiscoveredPorts++;
-			addPortByName(adapter, dirent);
-		}
-	}
-	sfhelper_closedir(dir);
-
 	return HBA_STATUS_OK;
 }
 
@@ -672,3 +971,301 @@ HBA_STATUS sysfs_getPortStatistics(HBA_PORTSTATISTICS **pS,
 
 	return HBA_STATUS_OK;
 }
+
+/**
+ * @brief Open a socket to receive kernel uevents.
+ * @return
+ *	- -1 on error
+ *	- socket file descriptor on success
+ *
+ * The socket must be opened before the action that triggers the awaited
+ * uevent, otherwise the uevent might be missed.
+ */
+int sysfs_openUevents(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;	/* kernel uevents */
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Read the uevent sequence number of the kernel.
+ * @param *seqnum returns the sequence number
+ * @return
+ *	- -1 if the sequence number is not available
+ *	- 0 on success
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The number increases with every uevent, so if it did not change no device
+ * was added, removed or changed. UEVENT_SEQNUM_PATH is kept open, each call
+ * costs a single pread().
+ */
+int sysfs_readSeqnum(unsigned long long *seqnum)
+{
+	char buf[32], *end;
+	ssize_t len;
+
+	if (vlib_data.seqnumFd < 0)
+		vlib_data.seqnumFd = open(UEVENT_SEQNUM_PATH,
+					  O_RDONLY | O_CLOEXEC);
+	if (vlib_data.seqnumFd < 0)
+		return -1;
+
+	len = pread(vlib_data.seqnumFd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	*seqnum = strtoull(buf, &end, 10);
+	if (end == buf)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * @brief Mark the remote ports of all adapters as possibly stale.
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+static void markPortsStale(void)
+{
+	struct vlib_adapter *adapter;
+	unsigned int i;
+
+	adapter = getAdapterByIndex(0);
+	for (i = 0; i < vlib_data.adapters.used; ++i, ++adapter)
+		adapter->portsStale = 1;
+}
+
+/**
+ * @brief Watch ccw devices and remote ports for changes.
+ * @return
+ *	- -1 if no uevent socket can be opened
+ *	- 0 on success
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * The socket is opened on the first call. Call this before reading the
+ * attributes to be cached, so no change in the meantime is missed. Ports
+ * read before the socket was opened are synchronized with sysfs once.
+ */
+int sysfs_watchAdapters(void)
+{
+	if (vlib_data.adapterUeventFd < 0) {
+		vlib_data.adapterUeventFd = sysfs_openUevents();
+		if (vlib_data.adapterUeventFd >= 0)
+			markPortsStale();
+	}
+
+	return vlib_data.adapterUeventFd < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Apply the uevent of a remote port to the repository.
+ * @param *action action of the uevent
+ * @param *name name of the remote port in the form "rport-H:C-T"
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ */
+static void rportUevent(const char *action, char *name)
+{
+	struct vlib_adapter *adapter;
+	struct vlib_port *port;
+	unsigned int host;
+
+	if (sscanf(name, "rport-%u:", &host) != 1)
+		return;
+
+	adapter = getAdapterByHostNo(host);
+	if (!adapter || adapter->ports.allocated == 0)
+		return;
+
+	port = getPortFromRepos(adapter, name);
+	if (port)
+		invalidatePortAttributes(port);
+
+	if (strcmp(action, "add") == 0) {
+		addPortByName(adapter, name);
+	} else if (strcmp(action, "remove") == 0) {
+		if (port && !port->isInvalid) {
+			port->isInvalid = 1;
+			repositoryChanged();
+		}
+	}
+}
+
+/**
+ * @brief Read pending uevents and update the adapters they refer to.
+ * @par Locks:
+ *	vlib_data.mutex must be held
+ *
+ * Any uevent of the ccw device of an adapter drops its attributes, e.g. if
+ * the device is set offline for an adapter replacement. Remote ports are
+ * added to and invalidated in the repository as they come and go, any of
+ * their uevents drops their cached attributes. If uevents were lost, the
+ * attributes of all adapters are dropped and their ports are synchronized
+ * with sysfs on the next use.
+ */
+void sysfs_readAdapterUevents(void)
+{
+	struct vlib_adapter *adapter;
+	char buf[4096], *name, *devpath;
+	unsigned int i;
+	ssize_t len;
+
+	if (vlib_data.adapterUeventFd < 0)
+		return;
+
+	while (1) {
+		len = recv(vlib_data.adapterUeventFd, buf, sizeof(buf) - 1, 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != ENOBUFS)
+				return;
+			adapter = getAdapterByIndex(0);
+			for (i = 0; i < vlib_data.adapters.used;
+			     ++i, ++adapter)
+				invalidateAdapterAttributes(adapter);
+			markPortsStale();
+			continue;
+		}
+		buf[len] = '\0';
+
+		/* "action@devpath", followed by the environment */
+		devpath = strchr(buf, '@');
+		name = strrchr(buf, '/');
+		if (!devpath || !name)
+			continue;
+		*devpath = '\0';
+		name++;
+
+		if (strncmp(name, "rport-", 6) == 0) {
+			rportUevent(buf, name);
+			continue;
+		}
+
+		adapter = getAdapterByIndex(0);
+		for (i = 0; i < vlib_data.adapters.used; ++i, ++adapter) {
+			if (strcmp(adapter->ident.bus_dev_name, name) == 0)
+				invalidateAdapterAttributes(adapter);
+		}
+	}
+}
+
+/**
+ * @brief Check if a SCSI device has an sg device.
+ * @param *hctl name of the SCSI device in the form "H:C:T:L"
+ * @return
+ *	- 0 if there is no sg device (yet)
+ *	- 1 if the sg device exists
+ */
+static int sgDevExists(const char *hctl)
+{
+	char path[PATH_MAX];
+	sfhelper_dir *dir;
+	char *dirent;
+	int found = 0;
+
+	snprintf(path, PATH_MAX, "/sys/bus/scsi/devices/%s", hctl);
+	dir = sfhelper_opendir(path);
+	if (dir == NULL)
+		return 0;
+
+	while (dirent = sfhelper_getNextDirEnt(dir)) {
+		/* "scsi_generic:sgX" or "scsi_generic" directory */
+		if (strncmp(dirent, "scsi_generic", 12) == 0) {
+			found = 1;
+			break;
+		}
+	}
+	sfhelper_closedir(dir);
+
+	return found;
+}
+
+/**
+ * @brief Wait until the sg device of a SCSI device appears.
+ * @param uevent_fd socket opened with sysfs_openUevents(), or -1
+ * @param host SCSI host
+ * @param channel SCSI channel
+ * @param target SCSI id
+ * @param lun SCSI LUN
+ * @param timeout maximal time to wait in milliseconds
+ * @return
+ *	- -1 if the sg device did not appear in time
+ *	- 0 if the sg device exists
+ *
+ * Instead of polling in fixed intervals, the function sleeps until the
+ * kernel announces a new scsi_generic device and then checks sysfs again.
+ * If no uevent socket is available, sysfs is polled.
+ */
+int sysfs_waitForSgDev(int uevent_fd, unsigned int host, unsigned int channel,
+		       unsigned int target, unsigned int lun, int timeout)
+{
+	char hctl[64], buf[4096];
+	struct timespec now, end;
+	struct pollfd pfd;
+	int remaining, len, check;
+
+	snprintf(hctl, sizeof(hctl), "%u:%u:%u:%u", host, channel, target, lun);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += timeout / 1000;
+	end.tv_nsec += (timeout % 1000) * 1000000L;
+	if (end.tv_nsec >= 1000000000L) {
+		end.tv_sec++;
+		end.tv_nsec -= 1000000000L;
+	}
+
+	pfd.fd = uevent_fd;
+	pfd.events = POLLIN;
+
+	check = 1;
+	while (1) {
+		if (check && sgDevExists(hctl))
+			return 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining = (end.tv_sec - now.tv_sec) * 1000 +
+				(end.tv_nsec - now.tv_nsec) / 1000000;
+		if (remaining <= 0)
+			return -1;
+
+		if (uevent_fd < 0) {
+			/* no uevents, fall back to polling */
+			if (remaining > 10)
+				remaining = 10;
+			poll(NULL, 0, remaining);
+			continue;
+		}
+
+		if (poll(&pfd, 1, remaining) <= 0)
+			continue;
+
+		/* only new scsi_generic devices are of interest */
+		check = 0;
+		while ((len = recv(uevent_fd, buf, sizeof(buf) - 1, 0)) > 0) {
+			buf[len] = '\0';
+			if (strncmp(buf, "add@", 4) == 0 &&
+			    strstr(buf, "scsi_generic"))
+				check = 1;
+		}
+	}
+}
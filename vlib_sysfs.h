@@ -22,25 +22,43 @@
 
 #define ZFCP_SYSFS_PATH "/sys/bus/ccw/drivers/zfcp"
 #define FC_HOST_PATH "/sys/class/fc_host"
+#define FC_RPORT_PATH "/sys/class/fc_remote_ports"
+#define UEVENT_SEQNUM_PATH "/sys/kernel/uevent_seqnum"
 
 #define ATTR_MAX 80 /* all attributes are only one line */
 #define DEVNO_LENGTH 8  /* x.x.xxxx -> 8 chars */
+#define SG_DEV_TIMEOUT 2000 /* ms to wait for an sg device to appear */
 
  /**
  * @file vlib_sysfs.h
  * @brief All calls that need the sysfs
  */
 
+/** @brief Remote port read by sysfs_getRemotePortsAttributes() */
+struct sysfs_rport {
+	char name[32];			/**< @brief name as in
+					   fc_remote_ports */
+	HBA_PORTATTRIBUTES *attrs;	/**< @brief attributes to be filled */
+	HBA_STATUS status;		/**< @brief result */
+};
+
 HBA_STATUS sysfs_createAndReadConfigPorts(struct vlib_adapter *);
 HBA_STATUS sysfs_createAndReadConfigAdapter();
 HBA_STATUS sysfs_getDiscoveredPortAttributes(HBA_PORTATTRIBUTES **,
 						struct vlib_port *);
+HBA_STATUS sysfs_getRemotePortsAttributes(struct sysfs_rport *, size_t);
 HBA_STATUS sysfs_getAdapterPortAttributes(HBA_PORTATTRIBUTES **,
 						struct vlib_adapter *);
 HBA_STATUS sysfs_getPortStatistics(HBA_PORTSTATISTICS **,
 						struct vlib_adapter *);
 int sysfs_getUnitsFromPort(struct vlib_port *);
-void sysfs_waitForSgDev(char *);
+fc_id_t sysfs_getPortDid(struct vlib_port *);
+int sysfs_openUevents(void);
+int sysfs_watchAdapters(void);
+void sysfs_readAdapterUevents(void);
+int sysfs_readSeqnum(unsigned long long *);
+int sysfs_waitForSgDev(int, unsigned int, unsigned int, unsigned int,
+			unsigned int, int);
 
 /**
  * @brief Check status of the repository, and possibly revalidate it.
@@ -0,0 +1,212 @@
+/*
+ * Copyright IBM Corp. 2010
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.ibm.com/developerworks/library/os-cpl.html
+ *
+ * File:	zfcphbaapi.h
+ *
+ * Description:
+ * Vendor specific extensions of the ZFCP HBA API Library
+ *
+ */
+
+#ifndef _ZFCPHBAAPI_H_
+#define _ZFCPHBAAPI_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <hbaapi.h>
+
+/*
+ * LUN inventory
+ */
+#define ZFCP_INVENTORY_INQUIRY		0x1	/* standard INQUIRY data */
+#define ZFCP_INVENTORY_READCAPACITY	0x2	/* READ CAPACITY data */
+#define ZFCP_INVENTORY_REPORTLUNS	0x4	/* add LUNs reported by the
+						   targets but not attached */
+#define ZFCP_INVENTORY_IDENTIFY		0x8	/* device identification
+						   (VPD page 0x83) */
+
+typedef struct ZFCP_LunInventoryEntry {
+	HBA_WWN HbaPortWWN;
+	HBA_WWN PortWWN;
+	HBA_UINT64 FcpLun;
+	HBA_UINT32 ScsiHostNumber;
+	HBA_UINT32 ScsiBusNumber;
+	HBA_UINT32 ScsiTargetNumber;
+	HBA_UINT32 ScsiOSLun;
+	char OSDeviceName[16];		/* sg device, empty if not attached */
+	HBA_STATUS InquiryStatus;
+	HBA_STATUS ReadCapacityStatus;
+	HBA_UINT8 PeripheralDeviceType;
+	char VendorIdentification[9];
+	char ProductIdentification[17];
+	char ProductRevisionLevel[5];
+	HBA_UINT64 NumberOfBlocks;
+	HBA_UINT32 BlockLength;
+	HBA_STATUS IdentifyStatus;
+	HBA_LUID LUID;			/* identification descriptor,
+					   as in HBA_FCPSCSIENTRYV2 */
+} ZFCP_LUNINVENTORYENTRY;
+
+typedef struct ZFCP_LunInventory {
+	HBA_UINT32 NumberOfEntries;
+	ZFCP_LUNINVENTORYENTRY entry[1];	/* variable length array */
+} ZFCP_LUNINVENTORY;
+
+HBA_STATUS ZFCP_GetLunInventory(HBA_UINT32, ZFCP_LUNINVENTORY *);
+
+/*
+ * Cursor over FCP target mappings
+ */
+typedef struct ZFCP_FcpMappingCursor *ZFCP_FCPMAPPINGCURSOR;
+
+HBA_STATUS ZFCP_OpenFcpTargetMappingCursor(HBA_HANDLE, HBA_WWN,
+					   ZFCP_FCPMAPPINGCURSOR *);
+HBA_STATUS ZFCP_GetNextFcpTargetMappings(ZFCP_FCPMAPPINGCURSOR,
+					 HBA_FCPTARGETMAPPINGV2 *);
+void ZFCP_CloseFcpTargetMappingCursor(ZFCP_FCPMAPPINGCURSOR);
+
+/*
+ * Cached adapter attributes
+ */
+HBA_STATUS ZFCP_RefreshAdapterAttributes(HBA_HANDLE);
+
+/*
+ * Attributes of all discovered ports
+ */
+HBA_STATUS ZFCP_GetAllDiscoveredPortAttributes(HBA_HANDLE, HBA_UINT32 *,
+					       HBA_PORTATTRIBUTES *);
+
+/*
+ * SCSI pass-through
+ */
+#define ZFCP_SCSI_DATA_NONE	0	/* no data transfer */
+#define ZFCP_SCSI_DATA_IN	1	/* data from the device */
+#define ZFCP_SCSI_DATA_OUT	2	/* data to the device */
+
+HBA_STATUS ZFCP_ScsiPassThru(HBA_HANDLE, HBA_WWN, HBA_UINT64, const void *,
+			     HBA_UINT32, HBA_UINT32, void *, HBA_UINT32 *,
+			     HBA_UINT32, HBA_UINT8 *, void *, HBA_UINT32 *);
+
+/*
+ * Buffers for CT pass-thru, reused by the library
+ */
+void *ZFCP_AllocPassThruBuffer(HBA_UINT32);
+void ZFCP_FreePassThruBuffer(void *);
+HBA_STATUS ZFCP_SendCTPassThruAlloc(HBA_HANDLE, void *, HBA_UINT32, void **,
+				    HBA_UINT32 *);
+
+/*
+ * Asynchronous CT and ELS pass-thru
+ */
+typedef struct ZFCP_PassThruQueue *ZFCP_PASSTHRUQUEUE;
+typedef void (*ZFCP_PASSTHRUCALLBACK)(void *, HBA_STATUS);
+
+HBA_STATUS ZFCP_OpenPassThruQueue(HBA_HANDLE, HBA_UINT32,
+				  ZFCP_PASSTHRUQUEUE *);
+HBA_STATUS ZFCP_SubmitCTPassThru(ZFCP_PASSTHRUQUEUE, void *, HBA_UINT32,
+				 void *, HBA_UINT32, HBA_UINT32,
+				 ZFCP_PASSTHRUCALLBACK, void *);
+HBA_STATUS ZFCP_SubmitRNID(ZFCP_PASSTHRUQUEUE, HBA_WWN, HBA_UINT32, void *,
+			   HBA_UINT32, HBA_UINT32, ZFCP_PASSTHRUCALLBACK,
+			   void *);
+int ZFCP_GetPassThruQueueFd(ZFCP_PASSTHRUQUEUE);
+HBA_STATUS ZFCP_GetPassThruCompletion(ZFCP_PASSTHRUQUEUE, void **,
+				      HBA_STATUS *);
+void ZFCP_ClosePassThruQueue(ZFCP_PASSTHRUQUEUE);
+
+/*
+ * CT request statistics
+ */
+typedef struct ZFCP_CTStatistics {
+	HBA_UINT64 Requests;		/* CT requests sent to the fabric */
+	HBA_UINT64 Accepts;		/* accepted requests */
+	HBA_UINT64 Rejects;		/* rejected requests */
+	HBA_UINT64 BusyRejects;		/* requests rejected as busy */
+	HBA_UINT64 Retries;		/* requests resent after a busy reject */
+	HBA_UINT64 Coalesced;		/* queries answered by an identical
+					   query in flight */
+	HBA_UINT64 Errors;		/* requests that could not be sent */
+	HBA_UINT32 CurrentRate;		/* requests per second, 0 if not
+					   paced */
+} ZFCP_CTSTATISTICS;
+
+HBA_STATUS ZFCP_GetCTStatistics(HBA_HANDLE, ZFCP_CTSTATISTICS *);
+
+/*
+ * Name server queries
+ */
+#define ZFCP_NS_ATTRIBUTES	0x1	/* GA_NXT: names, port type and
+					   FC-4 types */
+#define ZFCP_NS_FEATURES	0x2	/* GFF_ID: FC-4 features */
+
+typedef struct ZFCP_NameServerPort {
+	HBA_WWN PortWWN;		/* zero if listed with GID_FT */
+	HBA_UINT32 PortFcId;
+} ZFCP_NSPORT;
+
+typedef struct ZFCP_NameServerPortList {
+	HBA_UINT32 NumberOfEntries;
+	ZFCP_NSPORT entry[1];		/* variable length array */
+} ZFCP_NSPORTLIST;
+
+typedef struct ZFCP_NameServerPortDetails {
+	HBA_UINT32 PortFcId;		/* set by the caller */
+	HBA_STATUS Status;		/* result of the queries */
+	HBA_UINT8 PortType;		/* as in FC-GS, e.g. 0x01 for N_Port */
+	HBA_WWN PortWWN;
+	HBA_WWN NodeWWN;
+	char PortSymbolicName[256];
+	HBA_FC4TYPES FC4Types;
+	HBA_UINT8 FC4Features[128];	/* 4 bits per FC-4 type */
+} ZFCP_NSPORTDETAILS;
+
+HBA_STATUS ZFCP_GetNameServerPorts(HBA_HANDLE, HBA_UINT8, ZFCP_NSPORTLIST *);
+HBA_STATUS ZFCP_GetNameServerPortDetails(HBA_HANDLE, HBA_UINT32, HBA_UINT32,
+					 ZFCP_NSPORTDETAILS *);
+
+/*
+ * Mirror of the FCP ports registered at the name server
+ */
+typedef struct ZFCP_NameServerMirror {
+	HBA_UINT32 NumberOfEntries;
+	ZFCP_NSPORTDETAILS entry[1];	/* variable length array */
+} ZFCP_NSMIRROR;
+
+HBA_STATUS ZFCP_GetNameServerMirror(HBA_HANDLE, ZFCP_NSMIRROR *);
+HBA_STATUS ZFCP_LookupNameServerPort(HBA_HANDLE, HBA_WWN,
+				     ZFCP_NSPORTDETAILS *);
+
+/*
+ * Link error status of remote ports
+ */
+typedef struct ZFCP_LinkErrorStatus {
+	HBA_WWN PortWWN;
+	HBA_UINT32 PortFcId;
+	HBA_STATUS Status;		/* result of RLS */
+	HBA_UINT32 LinkFailureCount;
+	HBA_UINT32 LossOfSyncCount;
+	HBA_UINT32 LossOfSignalCount;
+	HBA_UINT32 PrimitiveSeqProtocolErrCount;
+	HBA_UINT32 InvalidTxWordCount;
+	HBA_UINT32 InvalidCRCCount;
+} ZFCP_LINKERRORSTATUS;
+
+typedef struct ZFCP_LinkErrorTable {
+	HBA_UINT32 NumberOfEntries;
+	ZFCP_LINKERRORSTATUS entry[1];	/* variable length array */
+} ZFCP_LINKERRORTABLE;
+
+HBA_STATUS ZFCP_GetLinkErrorStatus(HBA_HANDLE, HBA_UINT32,
+				   ZFCP_LINKERRORTABLE *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ZFCPHBAAPI_H_ */